@@ -1,6 +1,8 @@
 /*  
 *   Byte-oriented AES-256 implementation.
 *   All lookup tables replaced with 'on the fly' calculations. 
+*   With AES_TABLES (see aes256.h) the tables are back, built at start-up,
+*   and the whole key schedule is precomputed.
 *
 *   Copyright (c) 2007-2009 Ilya O. Levin, http://www.literatecode.com
 *   Other contributors: Hal Finney
@@ -19,6 +21,14 @@
 */
 #include "aes256.h"
 
+#if defined(AES_TABLES) && !defined(_WIN32) && !defined(NOTHREADS)
+#define AES_THREADS             /* the context is read-only while encrypting */
+#include <pthread.h>
+#include <unistd.h>
+#define MAXWORKERS 16
+#define MINCHUNK   65536L       /* not worth a thread below this */
+#endif
+
 #define F(x)   (((x)<<1) ^ ((((x)>>7) & 1) * 0x1b))
 #define FD(x)  (((x) >> 1) ^ (((x) & 1) ? 0x8d : 0))
 
@@ -295,6 +305,158 @@ void aes_expandDecKey(uint8_t *k, uint8_t *rc)
 } /* aes_expandDecKey */
 
 
+#ifdef AES_TABLES
+
+static uint8_t fsb[256], rsb[256];          /* S-box and its inverse */
+static uint32_t te[4][256], td[4][256];     /* round tables */
+static uint8_t aes_ready;
+
+#define B0(x)  ((uint8_t)((x) >> 24))
+#define B1(x)  ((uint8_t)((x) >> 16))
+#define B2(x)  ((uint8_t)((x) >> 8))
+#define B3(x)  ((uint8_t)(x))
+#define ROR8(x) (((x) >> 8) | ((x) << 24))
+#define GET32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                  ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define PUT32(p, x) ((p)[0] = B0(x), (p)[1] = B1(x), (p)[2] = B2(x), (p)[3] = B3(x))
+
+/* -------------------------------------------------------------------------- */
+uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    uint8_t p = 0;
+
+    while (b) {if (b & 1) p ^= a; a = rj_xtime(a); b >>= 1;}
+
+    return p;
+} /* gf_mul */
+
+/* -------------------------------------------------------------------------- */
+void aes_mkTables(void)
+{
+    register unsigned int i, j;
+    uint8_t s, r;
+
+    for (i = 0; i < 256; i++) fsb[i] = s = rj_sbox(i), rsb[s] = i;
+    for (i = 0; i < 256; i++)
+    {
+        s = fsb[i]; r = rsb[i];
+        te[0][i] = ((uint32_t)rj_xtime(s) << 24) | ((uint32_t)s << 16) |
+                   ((uint32_t)s << 8) | (uint8_t)(rj_xtime(s) ^ s);
+        td[0][i] = ((uint32_t)gf_mul(r, 14) << 24) | ((uint32_t)gf_mul(r, 9) << 16) |
+                   ((uint32_t)gf_mul(r, 13) << 8) | gf_mul(r, 11);
+        for (j = 1; j < 4; j++)
+            te[j][i] = ROR8(te[j-1][i]), td[j][i] = ROR8(td[j-1][i]);
+    }
+    aes_ready = 1;
+} /* aes_mkTables */
+
+/* -------------------------------------------------------------------------- */
+void aes256_init(aes256_context *ctx, uint8_t *k)
+{
+    register unsigned int i, j;
+    uint32_t t, *w = ctx->enckey, *d = ctx->deckey;
+    uint8_t rcon = 1;
+
+    if (!aes_ready) aes_mkTables();
+
+    for (i = 0; i < 8; i++) w[i] = GET32(k + 4 * i);
+    for (i = 8; i < 60; i++)
+    {
+        t = w[i - 1];
+        if ((i & 7) == 0)
+        {
+            t = ((uint32_t)(fsb[B1(t)] ^ rcon) << 24) | ((uint32_t)fsb[B2(t)] << 16) |
+                ((uint32_t)fsb[B3(t)] << 8) | fsb[B0(t)];
+            rcon = rj_xtime(rcon);
+        }
+        else if ((i & 7) == 4)
+            t = ((uint32_t)fsb[B0(t)] << 24) | ((uint32_t)fsb[B1(t)] << 16) |
+                ((uint32_t)fsb[B2(t)] << 8) | fsb[B3(t)];
+        w[i] = w[i - 8] ^ t;
+    }
+
+    /* decryption runs the rounds backwards on InvMixColumns'd keys */
+    for (i = 0; i < 60; i += 4)
+        for (j = 0; j < 4; j++)
+        {
+            t = w[56 - i + j];
+            if (i > 0 && i < 56)
+                t = td[0][fsb[B0(t)]] ^ td[1][fsb[B1(t)]] ^
+                    td[2][fsb[B2(t)]] ^ td[3][fsb[B3(t)]];
+            d[i + j] = t;
+        }
+} /* aes256_init */
+
+/* -------------------------------------------------------------------------- */
+void aes256_done(aes256_context *ctx)
+{
+    register uint8_t i;
+
+    for (i = 0; i < 60; i++) ctx->enckey[i] = ctx->deckey[i] = 0;
+} /* aes256_done */
+
+/* -------------------------------------------------------------------------- */
+void aes256_encrypt_ecb(aes256_context *ctx, uint8_t *buf)
+{
+    register uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    uint32_t *rk = ctx->enckey;
+    register uint8_t i;
+
+    s0 = GET32(buf) ^ rk[0];      s1 = GET32(buf + 4) ^ rk[1];
+    s2 = GET32(buf + 8) ^ rk[2];  s3 = GET32(buf + 12) ^ rk[3];
+    for (i = 13; i--;)
+    {
+        rk += 4;
+        t0 = te[0][B0(s0)] ^ te[1][B1(s1)] ^ te[2][B2(s2)] ^ te[3][B3(s3)] ^ rk[0];
+        t1 = te[0][B0(s1)] ^ te[1][B1(s2)] ^ te[2][B2(s3)] ^ te[3][B3(s0)] ^ rk[1];
+        t2 = te[0][B0(s2)] ^ te[1][B1(s3)] ^ te[2][B2(s0)] ^ te[3][B3(s1)] ^ rk[2];
+        t3 = te[0][B0(s3)] ^ te[1][B1(s0)] ^ te[2][B2(s1)] ^ te[3][B3(s2)] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    rk += 4;
+    t0 = ((uint32_t)fsb[B0(s0)] << 24 | (uint32_t)fsb[B1(s1)] << 16 |
+          (uint32_t)fsb[B2(s2)] << 8 | fsb[B3(s3)]) ^ rk[0];
+    t1 = ((uint32_t)fsb[B0(s1)] << 24 | (uint32_t)fsb[B1(s2)] << 16 |
+          (uint32_t)fsb[B2(s3)] << 8 | fsb[B3(s0)]) ^ rk[1];
+    t2 = ((uint32_t)fsb[B0(s2)] << 24 | (uint32_t)fsb[B1(s3)] << 16 |
+          (uint32_t)fsb[B2(s0)] << 8 | fsb[B3(s1)]) ^ rk[2];
+    t3 = ((uint32_t)fsb[B0(s3)] << 24 | (uint32_t)fsb[B1(s0)] << 16 |
+          (uint32_t)fsb[B2(s1)] << 8 | fsb[B3(s2)]) ^ rk[3];
+    PUT32(buf, t0); PUT32(buf + 4, t1); PUT32(buf + 8, t2); PUT32(buf + 12, t3);
+} /* aes256_encrypt */
+
+/* -------------------------------------------------------------------------- */
+void aes256_decrypt_ecb(aes256_context *ctx, uint8_t *buf)
+{
+    register uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    uint32_t *rk = ctx->deckey;
+    register uint8_t i;
+
+    s0 = GET32(buf) ^ rk[0];      s1 = GET32(buf + 4) ^ rk[1];
+    s2 = GET32(buf + 8) ^ rk[2];  s3 = GET32(buf + 12) ^ rk[3];
+    for (i = 13; i--;)
+    {
+        rk += 4;
+        t0 = td[0][B0(s0)] ^ td[1][B1(s3)] ^ td[2][B2(s2)] ^ td[3][B3(s1)] ^ rk[0];
+        t1 = td[0][B0(s1)] ^ td[1][B1(s0)] ^ td[2][B2(s3)] ^ td[3][B3(s2)] ^ rk[1];
+        t2 = td[0][B0(s2)] ^ td[1][B1(s1)] ^ td[2][B2(s0)] ^ td[3][B3(s3)] ^ rk[2];
+        t3 = td[0][B0(s3)] ^ td[1][B1(s2)] ^ td[2][B2(s1)] ^ td[3][B3(s0)] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    rk += 4;
+    t0 = ((uint32_t)rsb[B0(s0)] << 24 | (uint32_t)rsb[B1(s3)] << 16 |
+          (uint32_t)rsb[B2(s2)] << 8 | rsb[B3(s1)]) ^ rk[0];
+    t1 = ((uint32_t)rsb[B0(s1)] << 24 | (uint32_t)rsb[B1(s0)] << 16 |
+          (uint32_t)rsb[B2(s3)] << 8 | rsb[B3(s2)]) ^ rk[1];
+    t2 = ((uint32_t)rsb[B0(s2)] << 24 | (uint32_t)rsb[B1(s1)] << 16 |
+          (uint32_t)rsb[B2(s0)] << 8 | rsb[B3(s3)]) ^ rk[2];
+    t3 = ((uint32_t)rsb[B0(s3)] << 24 | (uint32_t)rsb[B1(s2)] << 16 |
+          (uint32_t)rsb[B2(s1)] << 8 | rsb[B3(s0)]) ^ rk[3];
+    PUT32(buf, t0); PUT32(buf + 4, t1); PUT32(buf + 8, t2); PUT32(buf + 12, t3);
+} /* aes256_decrypt */
+
+#else /* table-free, key schedule run for every block */
+
 /* -------------------------------------------------------------------------- */
 void aes256_init(aes256_context *ctx, uint8_t *k)
 {
@@ -357,3 +519,178 @@ void aes256_decrypt_ecb(aes256_context *ctx, uint8_t *buf)
     }
     aes_addRoundKey( buf, ctx->key); 
 } /* aes256_decrypt */
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+void aes_ctrAdd(uint8_t *ctr, size_t n)
+{
+    register uint8_t i = 16;
+    unsigned int c;
+
+    while (i-- && n)
+    {
+        c = ctr[i] + (n & 0xff);
+        ctr[i] = c;
+        n = (n >> 8) + (c >> 8);
+    }
+} /* aes_ctrAdd */
+
+/* -------------------------------------------------------------------------- */
+void aes_ctrRun(aes256_context *ctx, uint8_t *ctr, uint8_t *buf, size_t len)
+{
+    uint8_t ks[16];
+    register uint8_t i, n;
+
+    while (len)
+    {
+        for (i = 0; i < 16; i++) ks[i] = ctr[i];
+        aes256_encrypt_ecb(ctx, ks);
+        for (i = 16; i-- && ++ctr[i] == 0;);
+        n = len < 16 ? len : 16;
+        for (i = 0; i < n; i++) buf[i] ^= ks[i];
+        buf += n; len -= n;
+    }
+} /* aes_ctrRun */
+
+/* -------------------------------------------------------------------------- */
+void aes_cbcDecRun(aes256_context *ctx, uint8_t *iv, uint8_t *buf, size_t len)
+{
+    uint8_t *p;
+    register uint8_t i;
+
+    /* last block first, so its predecessor is still ciphertext */
+    for (p = buf + len; p > buf;)
+    {
+        p -= 16;
+        aes256_decrypt_ecb(ctx, p);
+        if (p > buf) for (i = 0; i < 16; i++) p[i] ^= p[i - 16];
+        else for (i = 0; i < 16; i++) p[i] ^= iv[i];
+    }
+} /* aes_cbcDecRun */
+
+#ifdef AES_THREADS
+
+typedef struct {
+    aes256_context *ctx;
+    uint8_t *buf;
+    size_t len;
+    uint8_t iv[16];             /* counter, or the ciphertext before buf */
+    void (*run)(aes256_context *, uint8_t *, uint8_t *, size_t);
+} aes_job;
+
+/* -------------------------------------------------------------------------- */
+static void *aes_worker(void *arg)
+{
+    aes_job *j = arg;
+
+    j->run(j->ctx, j->iv, j->buf, j->len);
+    return NULL;
+} /* aes_worker */
+
+/* -------------------------------------------------------------------------- */
+/* Split whole blocks of buf over the processors; 0 if one would do them all */
+static int aes_parallel(aes256_context *ctx, uint8_t *iv, uint8_t *buf, size_t len, int ctr)
+{
+    aes_job job[MAXWORKERS];
+    pthread_t tid[MAXWORKERS];
+    uint8_t started[MAXWORKERS];
+    size_t chunk, off;
+    long n;
+    int k, i;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > MAXWORKERS) n = MAXWORKERS;
+    if (n > (long)(len / MINCHUNK)) n = len / MINCHUNK;
+    if (n < 2) return 0;
+    chunk = ((len / 16 + n - 1) / n) * 16;
+
+    for (k = 0, off = 0; off < len; k++, off += chunk)
+    {
+        job[k].ctx = ctx;
+        job[k].buf = buf + off;
+        job[k].len = len - off < chunk ? len - off : chunk;
+        job[k].run = ctr ? aes_ctrRun : aes_cbcDecRun;
+        for (i = 0; i < 16; i++) job[k].iv[i] = ctr || !off ? iv[i] : buf[off - 16 + i];
+        if (ctr) aes_ctrAdd(job[k].iv, off / 16);
+    }
+    n = k;
+    /* the ciphertext before each chunk is saved, now it may be overwritten */
+    for (k = 1; k < n; k++)
+        started[k] = pthread_create(&tid[k], NULL, aes_worker, &job[k]) == 0;
+    aes_worker(&job[0]);
+    for (k = 1; k < n; k++)
+        if (started[k]) pthread_join(tid[k], NULL);
+        else aes_worker(&job[k]);
+    return 1;
+} /* aes_parallel */
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+void aes256_ctr_xcrypt(aes256_context *ctx, uint8_t *ctr, uint8_t *buf, size_t len)
+{
+#ifdef AES_THREADS
+    if (aes_parallel(ctx, ctr, buf, len, 1))
+    {
+        aes_ctrAdd(ctr, (len + 15) / 16);
+        return;
+    }
+#endif
+    aes_ctrRun(ctx, ctr, buf, len);
+} /* aes256_ctr_xcrypt */
+
+/* -------------------------------------------------------------------------- */
+int aes256_cbc_encrypt(aes256_context *ctx, uint8_t *iv, uint8_t *buf, size_t len)
+{
+    uint8_t *p, *last = iv, t[16];
+    register uint8_t i, r = len & 15;
+
+    if (len < 16) return len ? -1 : 0;
+    for (p = buf; p + 16 <= buf + len; p += 16)
+    {
+        for (i = 0; i < 16; i++) p[i] ^= last[i];
+        aes256_encrypt_ecb(ctx, p);
+        last = p;
+    }
+    if (r)  /* steal: E(tail ^ C[m]) goes in C[m]'s place, C[m] is cut short */
+    {
+        for (i = 0; i < 16; i++) t[i] = (i < r ? p[i] : 0) ^ last[i];
+        aes256_encrypt_ecb(ctx, t);
+        for (i = 0; i < 16; i++)
+        {
+            if (i < r) p[i] = last[i];
+            last[i] = t[i];
+        }
+    }
+    for (i = 0; i < 16; i++) iv[i] = last[i];
+    return 0;
+} /* aes256_cbc_encrypt */
+
+/* -------------------------------------------------------------------------- */
+int aes256_cbc_decrypt(aes256_context *ctx, uint8_t *iv, uint8_t *buf, size_t len)
+{
+    uint8_t *last, next[16], t[16];
+    register uint8_t i, r = len & 15;
+
+    if (len < 16) return len ? -1 : 0;
+    len -= r;
+    last = buf + len - 16;
+    for (i = 0; i < 16; i++) next[i] = last[i];
+    if (r)  /* put C[m] back together, then it is plain CBC */
+    {
+        for (i = 0; i < 16; i++) t[i] = last[i];
+        aes256_decrypt_ecb(ctx, t);
+        for (i = 0; i < 16; i++)
+        {
+            if (i < r) last[i] = last[16 + i], last[16 + i] ^= t[i];
+            else last[i] = t[i];
+        }
+    }
+#ifdef AES_THREADS
+    if (!aes_parallel(ctx, iv, buf, len, 0))
+#endif
+    aes_cbcDecRun(ctx, iv, buf, len);
+    for (i = 0; i < 16; i++) iv[i] = next[i];
+    return 0;
+} /* aes256_cbc_decrypt */
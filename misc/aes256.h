@@ -18,12 +18,22 @@
 *   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
-#ifdef SMALL_C
-#define u8ptr unsigned char *
-#define aes256_ptr aes256_context *
-#else
-typedef unsigned char * u8ptr;
-typedef aes256_context * aes256_ptr;
+/*
+*   AES_TABLES: the S-boxes and four T-tables per direction are built on
+*   the first aes256_init() (8.5K of static data) and the context holds all
+*   15 round keys of both directions, so a block is 14 rounds of table
+*   lookups with no key schedule work.  It is the default for hosted builds;
+*   Z80 builds, or -DAES_SMALL, keep the table-free code and 96 byte context.
+*/
+#if !defined(AES_TABLES) && !defined(AES_SMALL) && !defined(Z80) && !defined(SMALL_C)
+#define AES_TABLES
+#endif
+
+#ifdef AES_TABLES
+#include <stdint.h>
+#endif
+#ifndef SMALL_C
+#include <stddef.h>
 #endif
 
 #ifndef uint8_t
@@ -35,17 +45,44 @@ extern "C" {
 #endif
 
     typedef struct {
+#ifdef AES_TABLES
+        uint32_t enckey[60];    /* round keys 0..14 */
+        uint32_t deckey[60];    /* round keys 14..0, InvMixColumns applied */
+#else
         uint8_t key[32]; 
         uint8_t enckey[32]; 
         uint8_t deckey[32];
+#endif
     } aes256_context; 
 
+#ifdef SMALL_C
+#define u8ptr unsigned char *
+#define aes256_ptr aes256_context *
+#else
+typedef unsigned char * u8ptr;
+typedef aes256_context * aes256_ptr;
+#endif
+
 
     extern void aes256_init(aes256_context *, uint8_t * /* key */);
     extern void aes256_done(aes256_context *);
     extern void aes256_encrypt_ecb(aes256_context *, uint8_t * /* plaintext */);
     extern void aes256_decrypt_ecb(aes256_context *, uint8_t * /* cipertext */);
 
+    /*
+    *   Buffer modes, in place.  The 16 byte counter or IV is updated so that
+    *   the next call carries on where this one stopped.  CTR counts the whole
+    *   block as a big-endian number, and a partial last block uses up a
+    *   counter value.  CBC takes any length from 16 bytes up; a partial last
+    *   block is handled by ciphertext stealing (NIST CBC-CS2), so it must be
+    *   the last call, and the CBC functions return -1 for 1..15 bytes.
+    *   Hosted builds with AES_TABLES run CTR and CBC decryption of large
+    *   buffers on several threads (link with -pthread, or -DNOTHREADS).
+    */
+    extern void aes256_ctr_xcrypt(aes256_context *, uint8_t * /* counter */, uint8_t * /* buf */, size_t);
+    extern int aes256_cbc_encrypt(aes256_context *, uint8_t * /* iv */, uint8_t * /* buf */, size_t);
+    extern int aes256_cbc_decrypt(aes256_context *, uint8_t * /* iv */, uint8_t * /* buf */, size_t);
+
 #ifdef __cplusplus
 }
 #endif
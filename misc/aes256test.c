@@ -16,37 +16,313 @@
 *   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
 *   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
+
+/*
+*   Known-answer tests for every mode in aes256.c, then a benchmark.
+*
+*   gcc -O2 -pthread -o aes256test aes256test.c aes256.c
+*   gcc -O2 -DAES_SMALL -o aes256test aes256test.c aes256.c    (table-free)
+*   zcc +cpm -create-app -O3 -lm -DAMALLOC aes256test.c aes256.c
+*
+*   Usage: aes256test [MHz]
+*
+*   Cycles per byte come from the time stamp counter on x86, otherwise
+*   from the CPU time and the clock rate given on the command line.  A
+*   Z80 build makes one short pass of each benchmark; where the target
+*   has no clock(), run it under z88dk-ticks for the T-state count.
+*/
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "aes256.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define CYCLES() ((double)__rdtsc())
+#else
+#define CYCLES() 0.0
+#endif
+
+#ifdef Z80
+#define BULK    256             /* bytes per bulk call */
+#define MINTIME 0.0             /* one pass */
+#else
+#ifdef AES_TABLES
+#define BULK    (4L << 20)
+#else
+#define BULK    4096L
+#endif
+#define MINTIME 0.5             /* seconds per measurement */
+#endif
+
 #define DUMP(s, i, buf, sz)  {printf(s); for (i = 0; i < (sz);i++) printf("%02x ", buf[i]);  printf("\n");}
 
-int main (int argc, char *argv[])
+/* FIPS-197 appendix C.3 */
+uint8_t fips_key[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+};
+uint8_t fips_pt[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+uint8_t fips_ct[16] = {
+    0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+    0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+};
+
+/* SP 800-38A appendix F, AES-256 */
+uint8_t sp_key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe,
+    0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+    0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7,
+    0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+};
+uint8_t sp_pt[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+    0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+    0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+    0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+uint8_t sp_ecb[64] = {
+    0xf3, 0xee, 0xd1, 0xbd, 0xb5, 0xd2, 0xa0, 0x3c,
+    0x06, 0x4b, 0x5a, 0x7e, 0x3d, 0xb1, 0x81, 0xf8,
+    0x59, 0x1c, 0xcb, 0x10, 0xd4, 0x10, 0xed, 0x26,
+    0xdc, 0x5b, 0xa7, 0x4a, 0x31, 0x36, 0x28, 0x70,
+    0xb6, 0xed, 0x21, 0xb9, 0x9c, 0xa6, 0xf4, 0xf9,
+    0xf1, 0x53, 0xe7, 0xb1, 0xbe, 0xaf, 0xed, 0x1d,
+    0x23, 0x30, 0x4b, 0x7a, 0x39, 0xf9, 0xf3, 0xff,
+    0x06, 0x7d, 0x8d, 0x8f, 0x9e, 0x24, 0xec, 0xc7
+};
+uint8_t sp_cbc_iv[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+uint8_t sp_cbc[64] = {
+    0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba,
+    0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+    0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d,
+    0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+    0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf,
+    0xa5, 0x30, 0xe2, 0x63, 0x04, 0x23, 0x14, 0x61,
+    0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc,
+    0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b
+};
+uint8_t sp_ctr_iv[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+uint8_t sp_ctr[64] = {
+    0x60, 0x1e, 0xc3, 0x13, 0x77, 0x57, 0x89, 0xa5,
+    0xb7, 0xa7, 0xf5, 0x04, 0xbb, 0xf3, 0xd2, 0x28,
+    0xf4, 0x43, 0xe3, 0xca, 0x4d, 0x62, 0xb5, 0x9a,
+    0xca, 0x84, 0xe9, 0x90, 0xca, 0xca, 0xf5, 0xc5,
+    0x2b, 0x09, 0x30, 0xda, 0xa2, 0x3d, 0xe9, 0x4c,
+    0xe8, 0x70, 0x17, 0xba, 0x2d, 0x84, 0x98, 0x8d,
+    0xdf, 0xc9, 0xc5, 0x8d, 0xb6, 0x7a, 0xad, 0xa6,
+    0x13, 0xc2, 0xdd, 0x08, 0x45, 0x79, 0x41, 0xa6
+};
+
+/* CBC-CS2 of the first 56 bytes of sp_pt: the last two blocks change places */
+uint8_t cs2_ct[56] = {
+    0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba,
+    0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+    0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d,
+    0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+    0x2b, 0xcd, 0x48, 0xe4, 0xd2, 0xb9, 0x34, 0x1b,
+    0x76, 0xcc, 0x1c, 0x8e, 0x12, 0xa4, 0x46, 0x4c,
+    0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf
+};
+
+aes256_context ctx;
+uint8_t buf[64], iv[16], *bulk;
+int failed;
+
+/* -------------------------------------------------------------------------- */
+void check(char *name, uint8_t *got, uint8_t *want, int len)
 {
-    aes256_context ctx; 
-    uint8_t key[32];
-    uint8_t buf[16], i;
+    int i;
 
-    /* put a test vector */
-    for (i = 0; i < sizeof(buf);i++) buf[i] = i * 16 + i;
-    for (i = 0; i < sizeof(key);i++) key[i] = i;
+    printf("%-28s ", name);
+    if (memcmp(got, want, len) == 0) {printf("ok\n"); return;}
+    printf("FAILED\n");
+    DUMP("    got:  ", i, got, len);
+    DUMP("    want: ", i, want, len);
+    failed++;
+} /* check */
 
-    DUMP("txt: ", i, buf, sizeof(buf));
-    DUMP("key: ", i, key, sizeof(key));
-    printf("---\n");
+/* -------------------------------------------------------------------------- */
+void known_answers(void)
+{
+    uint8_t want[64];
+    int i;
 
-    aes256_init(&ctx, key);
+    memcpy(buf, fips_pt, 16);
+    aes256_init(&ctx, fips_key);
     aes256_encrypt_ecb(&ctx, buf);
+    check("FIPS-197 C.3 encrypt", buf, fips_ct, 16);
+    aes256_init(&ctx, fips_key);
+    aes256_decrypt_ecb(&ctx, buf);
+    check("FIPS-197 C.3 decrypt", buf, fips_pt, 16);
 
-    DUMP("enc: ", i, buf, sizeof(buf));
-    printf("tst: 8e a2 b7 ca 51 67 45 bf ea fc 49 90 4b 49 60 89\n");
+    aes256_init(&ctx, sp_key);
+    memcpy(buf, sp_pt, 64);
+    for (i = 0; i < 64; i += 16) aes256_encrypt_ecb(&ctx, buf + i);
+    check("SP 800-38A F.1.5 ECB enc", buf, sp_ecb, 64);
+    for (i = 0; i < 64; i += 16) aes256_decrypt_ecb(&ctx, buf + i);
+    check("SP 800-38A F.1.6 ECB dec", buf, sp_pt, 64);
 
-    aes256_init(&ctx, key);
-    aes256_decrypt_ecb(&ctx, buf);
-    DUMP("dec: ", i, buf, sizeof(buf));
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_encrypt(&ctx, iv, buf, 64);
+    check("SP 800-38A F.2.5 CBC enc", buf, sp_cbc, 64);
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_decrypt(&ctx, iv, buf, 32);      /* two calls, IV carried */
+    aes256_cbc_decrypt(&ctx, iv, buf + 32, 32);
+    check("SP 800-38A F.2.6 CBC dec", buf, sp_pt, 64);
+
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_encrypt(&ctx, iv, buf, 56);
+    check("CBC-CS2 enc, 56 bytes", buf, cs2_ct, 56);
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_decrypt(&ctx, iv, buf, 56);
+    check("CBC-CS2 dec, 56 bytes", buf, sp_pt, 56);
+
+    memcpy(iv, sp_ctr_iv, 16);
+    aes256_ctr_xcrypt(&ctx, iv, buf, 64);
+    check("SP 800-38A F.5.5 CTR enc", buf, sp_ctr, 64);
+    memcpy(iv, sp_ctr_iv, 16);
+    aes256_ctr_xcrypt(&ctx, iv, buf, 64);
+    check("SP 800-38A F.5.6 CTR dec", buf, sp_pt, 64);
+
+    memcpy(buf, sp_ctr, 64);                    /* a partial block uses up */
+    memcpy(iv, sp_ctr_iv, 16);                  /* its counter value, so */
+    aes256_ctr_xcrypt(&ctx, iv, buf, 20);       /* bytes 20..31 are skipped */
+    aes256_ctr_xcrypt(&ctx, iv, buf + 32, 32);
+    memcpy(want, sp_pt, 64);
+    memcpy(want + 20, sp_ctr + 20, 12);
+    check("CTR dec, 20 + 32 bytes", buf, want, 64);
+
+    memcpy(buf, sp_pt, 64);                     /* 1 to 15 bytes are refused */
+    memcpy(iv, sp_cbc_iv, 16);
+    i = aes256_cbc_encrypt(&ctx, iv, buf, 15) == -1 && memcmp(buf, sp_pt, 64) == 0;
+    printf("%-28s %s\n", "CBC refuses 15 bytes", i ? "ok" : "FAILED");
+    if (!i) failed++;
+} /* known_answers */
+
+/* -------------------------------------------------------------------------- */
+/* Whole buffers, long enough to be split over threads, against single blocks */
+void bulk_answers(void)
+{
+    uint8_t *ref;
+    long i;
+    int j;
+
+    if ((ref = malloc(BULK)) == NULL) return;
+    for (i = 0; i < BULK; i++) bulk[i] = ref[i] = (uint8_t)(i * 7 + (i >> 8));
+    aes256_init(&ctx, sp_key);
+
+    memcpy(iv, sp_ctr_iv, 16);
+    aes256_ctr_xcrypt(&ctx, iv, bulk, BULK - 5);
+    memcpy(buf, sp_ctr_iv, 16);
+    for (i = 0; i < BULK - 5; i += 16)
+    {
+        memcpy(buf + 16, buf, 16);
+        aes256_encrypt_ecb(&ctx, buf + 16);
+        for (j = 0; j < 16 && i + j < BULK - 5; j++) ref[i + j] ^= buf[16 + j];
+        for (j = 16; j-- && ++buf[j] == 0;);
+    }
+    for (i = 0; i < BULK && bulk[i] == ref[i]; i++);
+    printf("%-28s %s\n", "CTR bulk = single blocks", i < BULK ? "FAILED" : "ok");
+    if (i < BULK) failed++;
+    check("CTR bulk counter", iv, buf, 16);
+
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_encrypt(&ctx, iv, bulk, BULK);
+    memcpy(iv, sp_cbc_iv, 16);
+    aes256_cbc_decrypt(&ctx, iv, bulk, BULK);
+    memcpy(iv, sp_ctr_iv, 16);
+    aes256_ctr_xcrypt(&ctx, iv, bulk, BULK - 5);
+    for (i = 0; i < BULK && bulk[i] == (uint8_t)(i * 7 + (i >> 8)); i++);
+    printf("%-28s %s\n", "CBC bulk round trip", i < BULK ? "FAILED" : "ok");
+    if (i < BULK) failed++;
+    free(ref);
+} /* bulk_answers */
+
+/* -------------------------------------------------------------------------- */
+void run(int what, long n)
+{
+    while (n--)
+        switch (what)
+        {
+        case 0: aes256_init(&ctx, sp_key); break;
+        case 1: aes256_encrypt_ecb(&ctx, buf); break;
+        case 2: aes256_decrypt_ecb(&ctx, buf); break;
+        case 3: aes256_ctr_xcrypt(&ctx, iv, bulk, BULK); break;
+        case 4: aes256_cbc_encrypt(&ctx, iv, bulk, BULK); break;
+        case 5: aes256_cbc_decrypt(&ctx, iv, bulk, BULK); break;
+        }
+} /* run */
+
+/* -------------------------------------------------------------------------- */
+void bench(char *name, int what, double mhz)
+{
+    clock_t t0;
+    double c0, t, c, bytes;
+    long n;
+
+    aes256_init(&ctx, sp_key);
+    for (n = 1;; n *= 2)
+    {
+        t0 = clock(); c0 = CYCLES();
+        run(what, n);
+        c = CYCLES() - c0;
+        t = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        if (t >= MINTIME || t < 0) break;
+    }
+    if (c <= 0 && mhz > 0) c = t * mhz * 1e6;
+    bytes = (double)n * (what == 0 ? 32 : what < 3 ? 16 : BULK);
+    printf("%-20s %8ld x %-8ld", name, n, what == 0 ? 32L : what < 3 ? 16L : (long)BULK);
+    if (t > 0) printf(" %10.2f MB/s", bytes / t / 1048576.0);
+    else printf(" %15s", "(no clock)");
+    if (c > 0) printf(" %10.1f cycles/byte", c / bytes);
+    printf("\n");
+} /* bench */
+
+/* -------------------------------------------------------------------------- */
+int main (int argc, char *argv[])
+{
+    double mhz = argc > 1 ? atof(argv[1]) : 0;
+
+    if ((bulk = malloc(BULK)) == NULL)
+    {
+        printf("Out of memory\n");
+        return 2;
+    }
+    known_answers();
+    bulk_answers();
+    if (failed)
+    {
+        printf("%d test(s) FAILED\n", failed);
+        return 1;
+    }
+
+    printf("---\n");
+    bench("key setup", 0, mhz);
+    bench("ECB encrypt block", 1, mhz);
+    bench("ECB decrypt block", 2, mhz);
+    bench("CTR buffer", 3, mhz);
+    bench("CBC encrypt buffer", 4, mhz);
+    bench("CBC decrypt buffer", 5, mhz);
 
     aes256_done(&ctx);
+    free(bulk);
 
     return 0;
 } /* main */
@@ -14,8 +14,10 @@
  *   archive.tar                        # Same as -tf archive.tar
  *
  * Features:
- *   - Fully ANSI C89 compatible (no POSIX-specific functions used).
- *   - Uses only the standard C library (stdio.h, string.h, etc.).
+ *   - ANSI C89 compatible.  Besides stat(), the CP/M build uses only
+ *     the standard C library (stdio.h, string.h, etc.).  The Linux build
+ *     also uses POSIX fileno() and Linux copy_file_range() (not with
+ *     -DNO_COPY_RANGE).
  *   - Validates USTAR magic to ensure archive format correctness.
  *   - Appending safely handles existing TAR structure and trailing blocks.
  *   - Automatically overwrites and rewrites final zero blocks.
@@ -23,6 +25,12 @@
  *   - Creates smaller files than (uncompressed) UNIX tar because it puts
  *     only 2 empty blocks at the archive end (as defined in the standard)
  *     instead of padding the archive to a multiple of 10 KiBi.
+ *   - Copies file data in 64 KiBi chunks on hosted builds (CP/M: one
+ *     record), or by copy_file_range() in the kernel on Linux.
+ *   - Hosted builds remember where the archive ends in "archive.tar.end"
+ *     so that -rf need not read all headers again.  The saved offset is
+ *     only used if the last header is still there and still followed by
+ *     the two empty blocks; else the archive is scanned as before.
  *
  * Limitations:
  *   - Flat archives only (no directory tree structure).
@@ -47,7 +55,12 @@
  * License: GPL-3.0-or-later
  */
 
-#define VERSION "20250513"
+#define VERSION "20261018"
+
+#if defined( __linux__ ) && !defined( NO_COPY_RANGE )
+#define _GNU_SOURCE   /* copy_file_range */
+#define COPY_RANGE
+#endif
 
 #include <ctype.h>    /* isprint */
 #include <stdio.h>    /* fopen, fread, fwrite, fclose, printf, sprintf */
@@ -58,10 +71,30 @@
 #ifdef CPM
 #include <cpm.h>
 #endif
+#ifdef COPY_RANGE
+#include <unistd.h>   /* copy_file_range */
+#endif
 
 #define RECORD_SIZE 512
 unsigned char record[ RECORD_SIZE ];
 
+/* file data goes through iobuf, a whole number of records */
+#ifdef __Z88DK
+#define IOBUF_SIZE RECORD_SIZE
+#define iobuf record
+#else
+#define IOBUF_SIZE ( 128 * RECORD_SIZE )
+#define ENDCACHE ".end" /* appended to the archive name */
+static union {
+    long double align; /* no C89 way to ask for more */
+    unsigned char buf[ IOBUF_SIZE ];
+} iobuf_u;
+#define iobuf iobuf_u.buf
+#endif
+
+/* offset of the last header written or found, -1: none */
+long last_header = -1;
+
 #define NAME_SIZE 101
 char filename[ NAME_SIZE ];
 
@@ -132,6 +165,9 @@ int is_block_empty( const unsigned char *block ) {
 int is_valid_tar_header( const unsigned char *header ) { return strncmp( (char *)header + 257, "ustar", 5 ) == 0; }
 
 
+long padded_size( long filesize ) { return ( ( filesize + RECORD_SIZE - 1 ) / RECORD_SIZE ) * RECORD_SIZE; }
+
+
 long find_append_position( FILE *fp ) {
     long filesize, skip, zpos;
 
@@ -154,8 +190,9 @@ long find_append_position( FILE *fp ) {
             return -1; /* Invalid TAR */
 
         /* Get file size and skip content */
+        last_header = ftell( fp ) - RECORD_SIZE;
         filesize = octal_to_long( (char *)( record + 124 ), 12 );
-        skip = ( ( filesize + RECORD_SIZE - 1 ) / RECORD_SIZE ) * RECORD_SIZE;
+        skip = padded_size( filesize );
         fseek( fp, skip, SEEK_CUR );
     }
 
@@ -164,6 +201,67 @@ long find_append_position( FILE *fp ) {
 }
 
 
+#ifdef ENDCACHE
+int header_checksum_ok( const unsigned char *header ) {
+    unsigned int i, checksum;
+
+    checksum = 0;
+    for ( i = 0; i < RECORD_SIZE; ++i )
+        checksum += ( i >= 148 && i < 156 ) ? ' ' : header[ i ];
+    return octal_to_long( (char *)( header + 148 ), 8 ) == (long)checksum;
+}
+
+
+/* the end saved by the last -cf or -rf, if the archive still ends there */
+long cached_append_position( FILE *fp, const char *tarname ) {
+    char cachename[ NAME_SIZE + sizeof( ENDCACHE ) ];
+    FILE *cf;
+    long hdr, end;
+    int ok;
+
+    if ( strlen( tarname ) >= NAME_SIZE )
+        return -1;
+    sprintf( cachename, "%s%s", tarname, ENDCACHE );
+    if ( ( cf = fopen( cachename, "r" ) ) == NULL )
+        return -1;
+    ok = fscanf( cf, "%ld %ld", &hdr, &end ) == 2;
+    fclose( cf );
+    if ( !ok || end < 0 || end % RECORD_SIZE != 0 )
+        return -1;
+
+    /* the chain: the last header must lead to the end ... */
+    if ( hdr >= 0 ) {
+        if ( fseek( fp, hdr, SEEK_SET ) != 0 || fread( record, 1, RECORD_SIZE, fp ) != RECORD_SIZE
+             || !is_valid_tar_header( record ) || !header_checksum_ok( record )
+             || hdr + RECORD_SIZE + padded_size( octal_to_long( (char *)( record + 124 ), 12 ) ) != end )
+            return -1;
+    } else if ( end != 0 )
+        return -1;
+    /* ... and two empty blocks must follow */
+    if ( fseek( fp, end, SEEK_SET ) != 0 || fread( record, 1, RECORD_SIZE, fp ) != RECORD_SIZE
+         || !is_block_empty( record ) || fread( record, 1, RECORD_SIZE, fp ) != RECORD_SIZE
+         || !is_block_empty( record ) )
+        return -1;
+    last_header = hdr;
+    return end;
+}
+
+
+void save_append_position( const char *tarname, long end ) {
+    char cachename[ NAME_SIZE + sizeof( ENDCACHE ) ];
+    FILE *cf;
+
+    if ( strlen( tarname ) >= NAME_SIZE )
+        return;
+    sprintf( cachename, "%s%s", tarname, ENDCACHE );
+    if ( ( cf = fopen( cachename, "w" ) ) == NULL )
+        return;
+    fprintf( cf, "%ld %ld\n", last_header, end );
+    fclose( cf );
+}
+#endif
+
+
 long get_file_size( FILE *f ) {
     long size;
     fseek( f, 0, SEEK_END );
@@ -202,17 +300,50 @@ void write_tar_header( FILE *out, const char *filename, long filesize, long mtim
 }
 
 
+#ifdef COPY_RANGE
+/* copy len bytes from in_off on in to out_off on out in the kernel, */
+/* return the count copied, which is short if it can't be done so */
+long copy_range( FILE *in, long in_off, FILE *out, long out_off, long len ) {
+    loff_t ioff = in_off, ooff = out_off;
+    long done = 0;
+    ssize_t n;
+
+    while ( done < len ) {
+        chk_ctrl_c();
+        n = copy_file_range( fileno( in ), &ioff, fileno( out ), &ooff, len - done, 0 );
+        if ( n <= 0 )
+            break;
+        done += n;
+    }
+    return done;
+}
+#endif
+
+
 void write_file_content( FILE *out, FILE *in, long filesize ) {
-    size_t n;
+    size_t n, want, pad;
     long remaining = filesize;
 
+#ifdef COPY_RANGE
+    long pos, done;
+
+    fflush( out );
+    pos = ftell( out );
+    done = copy_range( in, 0, out, pos, filesize & ~( RECORD_SIZE - 1L ) );
+    fseek( out, pos + done, SEEK_SET );
+    fseek( in, done, SEEK_SET );
+    remaining -= done;
+#endif
     while ( remaining > 0 ) {
         chk_ctrl_c();
-        n = fread( record, 1, RECORD_SIZE, in );
-        if ( n < RECORD_SIZE )
-            memset( record + n, 0, RECORD_SIZE - n );
-        fwrite( record, 1, RECORD_SIZE, out );
-        remaining -= n;
+        want = remaining > IOBUF_SIZE ? IOBUF_SIZE : (size_t)remaining;
+        n = fread( iobuf, 1, want, in );
+        if ( n < want ) /* file got shorter: keep the size in the header */
+            memset( iobuf + n, 0, want - n );
+        pad = (size_t)padded_size( (long)want );
+        memset( iobuf + want, 0, pad - want );
+        fwrite( iobuf, 1, pad, out );
+        remaining -= want;
     }
 }
 
@@ -243,6 +374,7 @@ void write_file( char *filename, FILE *tar ) {
     filesize = get_file_size( in );
     fprintf( stderr, "%s (%ld)\n", filename, filesize );
 
+    last_header = ftell( tar );
     write_tar_header( tar, filename, filesize, mtime );
     write_file_content( tar, in, filesize );
     fclose( in );
@@ -333,7 +465,10 @@ void mode_create_append( int append, int argc, char *argv[] ) {
             perror( "Cannot open archive" );
             exit( 1 );
         }
-        append_pos = find_append_position( tar );
+#ifdef ENDCACHE
+        if ( ( append_pos = cached_append_position( tar, argv[ 2 ] ) ) < 0 )
+#endif
+            append_pos = find_append_position( tar );
         if ( append_pos < 0 ) {
             fprintf( stderr, "Invalid or corrupt TAR archive\n" );
             fclose( tar );
@@ -394,6 +529,9 @@ void mode_create_append( int append, int argc, char *argv[] ) {
 #endif
 
     /* Write final two 512-byte zero blocks */
+#ifdef ENDCACHE
+    save_append_position( argv[ 2 ], ftell( tar ) );
+#endif
     memset( record, 0, RECORD_SIZE );
     fwrite( record, 1, RECORD_SIZE, tar );
     fwrite( record, 1, RECORD_SIZE, tar );
@@ -447,7 +585,8 @@ void mode_list( const char *tarfile ) {
 void mode_extract( const char *tarfile ) {
     FILE *tar, *out;
     long filesize, remaining;
-    int i, to_read;
+    size_t to_read;
+    int i;
 
     tar = fopen( tarfile, "rb" );
     if ( !tar ) {
@@ -482,11 +621,27 @@ void mode_extract( const char *tarfile ) {
         }
 
         remaining = filesize;
+#ifdef COPY_RANGE
+        {
+            long pos, done;
+
+            pos = ftell( tar );
+            done = copy_range( tar, pos, out, 0, filesize );
+            fseek( tar, pos + padded_size( done ), SEEK_SET );
+            fseek( out, done, SEEK_SET );
+            remaining -= done;
+            if ( done < filesize && done % RECORD_SIZE ) { /* stopped inside a record */
+                fseek( tar, pos + done - done % RECORD_SIZE, SEEK_SET );
+                fseek( out, done - done % RECORD_SIZE, SEEK_SET );
+                remaining += done % RECORD_SIZE;
+            }
+        }
+#endif
         while ( remaining > 0 ) {
             chk_ctrl_c();
-            to_read = remaining > RECORD_SIZE ? RECORD_SIZE : (int)remaining;
-            fread( record, 1, RECORD_SIZE, tar );
-            fwrite( record, 1, to_read, out );
+            to_read = remaining > IOBUF_SIZE ? IOBUF_SIZE : (size_t)remaining;
+            fread( iobuf, 1, (size_t)padded_size( (long)to_read ), tar );
+            fwrite( iobuf, 1, to_read, out );
             remaining -= to_read;
         }
         fclose( out );
@@ -503,6 +658,9 @@ void usage( const char *argv0 ) {
     printf( "  %s -rf archive.tar file1 [file2 ...]  # Append files to archive.\n", argv0 );
     printf( "  %s [-tf] archive.tar                  # List all files in archive.\n", argv0 );
     printf( "  %s -xf archive.tar                    # Extract all files from archive.\n", argv0 );
+#ifdef ENDCACHE
+    printf( "-cf and -rf note where the archive ends in archive.tar%s (may be deleted).\n", ENDCACHE );
+#endif
 }
 
 
@@ -0,0 +1,847 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * unzip.c - A small portable ZIP extractor.
+ *
+ * The same tool for CP/M and for the Linux hosts the disk images are
+ * staged on; unzip18.asm and unzip2023.asm remain the smaller and
+ * faster choice on a Z80.
+ *
+ * Usage:
+ *   unzip [-l|-t] archive.zip [name ...]
+ *   -l  list the members instead of extracting them
+ *   -t  test the members (inflate and check the CRC, write nothing)
+ *   name  members to extract, '*' and '?' allowed; default: all
+ *
+ * Features:
+ *   - Reads the central directory once into an index, then seeks
+ *     straight to each selected member.
+ *   - Stored and deflated members (the methods of every zip tool since
+ *     PKZIP 2).  Shrink, reduce and implode are left to the asm ports.
+ *   - Paths are junked: members are extracted into the current directory
+ *     (on CP/M as upper case 8.3 names).
+ *   - Every member is checked against its CRC-32.
+ *   - Hosted builds inflate several members at once, one per thread;
+ *     messages still come out in archive order, and when two members
+ *     have the same name the later one wins, as in a serial run.
+ *
+ * Limitations:
+ *   - No encryption, no ZIP64, no multi-disk archives.
+ *   - File dates and attributes are not restored.
+ *
+ * Building on Linux:
+ *   gcc -O2 -Wall -pthread -o tinyunzip unzip.c
+ *   (-DNOTHREADS: one member after the other)
+ *
+ * Building for CP/M with Z88DK:
+ *   zcc --opt-code-speed +cpm -DAMALLOC -o unzip.com unzip.c
+ */
+
+#define VERSION "20261018"
+
+#include <ctype.h>  /* toupper */
+#include <stdio.h>  /* fopen, fread, fwrite, fseek, printf */
+#include <stdlib.h> /* malloc, free, exit */
+#include <string.h> /* memcmp, strlen, strcpy */
+#ifdef CPM
+#include <cpm.h>
+#endif
+
+#if !defined( __Z88DK ) && !defined( _WIN32 ) && !defined( NOTHREADS )
+#define PARALLEL
+#include <pthread.h>
+#include <unistd.h> /* sysconf */
+#define MAXWORKERS 16
+#endif
+
+#ifdef __Z88DK
+#define NAME_SIZE 13 /* 8.3 */
+#define INBUF_SIZE 256
+#else
+#define NAME_SIZE 256
+#define INBUF_SIZE 16384
+#endif
+
+#define WSIZE 32768U /* deflate window, a power of two */
+#define MAXBITS 15   /* longest code */
+#define MAXLCODES 286
+#define MAXDCODES 30
+#define FIXLCODES 288
+
+/* -------------------- INDEX -------------------- */
+struct entry {
+    char name[ NAME_SIZE ];  /* output name, path junked */
+    unsigned long crc;
+    unsigned long csize;     /* compressed size */
+    unsigned long usize;     /* uncompressed size */
+    unsigned long offset;    /* of the local header */
+    unsigned short method;
+    unsigned short flags;
+    unsigned char selected;
+};
+
+struct entry *entries;
+unsigned int nentries;
+
+unsigned long crctab[ 256 ];
+int listflag, testflag;
+
+/* -------------------- INFLATE STATE -------------------- */
+/* one per member being inflated: the threads each have their own */
+struct inflate {
+    FILE *in;
+    unsigned long left;      /* compressed bytes not read yet */
+    unsigned int inpos, inlen;
+    unsigned long bitbuf;
+    int bitcnt;
+    int err;                 /* input ended or bad data */
+    FILE *out;               /* NULL: test only */
+    unsigned int wpos;       /* next byte in window */
+    unsigned long outcnt;
+    unsigned long crc;
+    short lencnt[ MAXBITS + 1 ], lensym[ FIXLCODES ];
+    short distcnt[ MAXBITS + 1 ], distsym[ MAXDCODES ];
+    unsigned char inbuf[ INBUF_SIZE ];
+    unsigned char window[ WSIZE ];
+};
+
+struct huffman {
+    short *count;
+    short *symbol;
+};
+
+
+/* -------------------- HELPERS -------------------- */
+
+#ifdef CPM
+void chk_ctrl_c( void ) {
+    if ( bdos( 6, 0xff ) == 3 ) { /* Ctrl C was typed */
+        fprintf( stderr, "\n^C\n" );
+        exit( -1 );
+    }
+}
+#else
+#define chk_ctrl_c()
+#endif
+
+
+unsigned int get16( const unsigned char *p ) { return p[ 0 ] | ( p[ 1 ] << 8 ); }
+
+
+unsigned long get32( const unsigned char *p ) {
+    return p[ 0 ] | ( (unsigned long)p[ 1 ] << 8 ) | ( (unsigned long)p[ 2 ] << 16 ) | ( (unsigned long)p[ 3 ] << 24 );
+}
+
+
+void crc_init( void ) {
+    unsigned long c;
+    int i, k;
+
+    for ( i = 0; i < 256; ++i ) {
+        c = i;
+        for ( k = 0; k < 8; ++k )
+            c = c & 1 ? ( c >> 1 ) ^ 0xedb88320L : c >> 1;
+        crctab[ i ] = c;
+    }
+}
+
+
+unsigned long crc_block( unsigned long crc, const unsigned char *p, unsigned int n ) {
+    while ( n-- )
+        crc = ( crc >> 8 ) ^ crctab[ ( crc ^ *p++ ) & 0xff ];
+    return crc;
+}
+
+
+/* '*' and '?' wildcards, case is ignored (CP/M upper cases arguments) */
+int match( const char *pat, const char *name ) {
+    for ( ; *pat; ++pat, ++name ) {
+        if ( *pat == '*' ) {
+            while ( *++pat == '*' )
+                ;
+            if ( !*pat )
+                return 1;
+            for ( ; *name; ++name )
+                if ( match( pat, name ) )
+                    return 1;
+            return 0;
+        }
+        if ( !*name || ( *pat != '?' && toupper( (unsigned char)*pat ) != toupper( (unsigned char)*name ) ) )
+            return 0;
+    }
+    return !*name;
+}
+
+
+/* the output name for a member: no path, on CP/M upper case 8.3 */
+void make_name( char *out, const char *zipname ) {
+    const char *p;
+    int n;
+#ifdef CPM
+    const char *dot;
+#endif
+
+    if ( ( p = strrchr( zipname, '/' ) ) != NULL )
+        zipname = p + 1;
+#ifdef CPM
+    dot = strrchr( zipname, '.' );
+    for ( n = 0, p = zipname; *p && p != dot && n < 8; ++p )
+        out[ n++ ] = toupper( *p & 0x7f );
+    if ( dot != NULL && dot[ 1 ] ) {
+        out[ n++ ] = '.';
+        for ( p = dot + 1; *p && n < 12; ++p )
+            out[ n++ ] = toupper( *p & 0x7f );
+    }
+#else
+    for ( n = 0; zipname[ n ] && n < NAME_SIZE - 1; ++n )
+        out[ n ] = zipname[ n ];
+#endif
+    out[ n ] = '\0';
+}
+
+
+/* -------------------- CENTRAL DIRECTORY -------------------- */
+
+/* offset of the end of central directory record, -1 if there is none */
+long find_eocd( FILE *fp, unsigned char *buf, unsigned int bufsize ) {
+    long size, pos, lo, stop;
+    unsigned int n, i;
+
+    if ( fseek( fp, 0, SEEK_END ) != 0 || ( size = ftell( fp ) ) < 22 )
+        return -1;
+    /* the record is 22 bytes, then a comment of up to 64K */
+    stop = size - 22 - 65535L;
+    if ( stop < 0 )
+        stop = 0;
+    for ( pos = size - 22; pos >= stop; pos = lo - 1 ) {
+        chk_ctrl_c();
+        lo = pos - ( bufsize - 4 ) + 1;
+        if ( lo < stop )
+            lo = stop;
+        n = (unsigned int)( pos - lo ) + 4;
+        if ( fseek( fp, lo, SEEK_SET ) != 0 || fread( buf, 1, n, fp ) != n )
+            return -1;
+        for ( i = n - 4 + 1; i-- > 0; )
+            if ( buf[ i ] == 'P' && buf[ i + 1 ] == 'K' && buf[ i + 2 ] == 5 && buf[ i + 3 ] == 6 )
+                return lo + i;
+    }
+    return -1;
+}
+
+
+/* read the central directory into entries[], return 0 if it is good */
+int read_directory( FILE *fp ) {
+    unsigned char hdr[ 46 ], buf[ 256 ];
+    char zipname[ NAME_SIZE ];
+    unsigned int i, namelen, skip;
+    unsigned long cdoff;
+    long eocd;
+    struct entry *e;
+
+    if ( ( eocd = find_eocd( fp, buf, sizeof( buf ) ) ) < 0 ) {
+        fprintf( stderr, "No zip end of directory record\n" );
+        return -1;
+    }
+    fseek( fp, eocd, SEEK_SET );
+    if ( fread( hdr, 1, 22, fp ) != 22 )
+        return -1;
+    if ( get16( hdr + 4 ) != 0 || get16( hdr + 6 ) != 0 ) {
+        fprintf( stderr, "Multi-disk archives are not supported\n" );
+        return -1;
+    }
+    nentries = get16( hdr + 10 );
+    cdoff = get32( hdr + 16 );
+    if ( nentries == 0xffff || cdoff == 0xffffffffL ) {
+        fprintf( stderr, "ZIP64 archives are not supported\n" );
+        return -1;
+    }
+    if ( nentries == 0 )
+        return 0;
+    if ( ( entries = malloc( nentries * sizeof( struct entry ) ) ) == NULL ) {
+        fprintf( stderr, "Out of memory for %u entries\n", nentries );
+        return -1;
+    }
+
+    fseek( fp, cdoff, SEEK_SET );
+    for ( i = 0; i < nentries; ++i ) {
+        chk_ctrl_c();
+        e = &entries[ i ];
+        if ( fread( hdr, 1, 46, fp ) != 46 || memcmp( hdr, "PK\1\2", 4 ) != 0 ) {
+            fprintf( stderr, "Bad central directory entry %u\n", i + 1 );
+            return -1;
+        }
+        e->flags = get16( hdr + 8 );
+        e->method = get16( hdr + 10 );
+        e->crc = get32( hdr + 16 );
+        e->csize = get32( hdr + 20 );
+        e->usize = get32( hdr + 24 );
+        e->offset = get32( hdr + 42 );
+        namelen = get16( hdr + 28 );
+        skip = get16( hdr + 30 ) + get16( hdr + 32 ); /* extra, comment */
+        if ( namelen < NAME_SIZE ) {
+            fread( zipname, 1, namelen, fp );
+            zipname[ namelen ] = '\0';
+        } else {
+            fread( zipname, 1, NAME_SIZE - 1, fp );
+            zipname[ NAME_SIZE - 1 ] = '\0';
+            skip += namelen - ( NAME_SIZE - 1 );
+        }
+        /* a directory entry ends in '/': nothing to extract */
+        e->selected = namelen > 0 && zipname[ strlen( zipname ) - 1 ] != '/';
+        make_name( e->name, zipname );
+        fseek( fp, skip, SEEK_CUR );
+    }
+    return 0;
+}
+
+
+/* -------------------- INFLATE -------------------- */
+/* after Mark Adler's puff.c: codes are decoded a bit at a time */
+
+static const short lbase[ 29 ] = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                   31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lext[ 29 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                          2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short dbase[ 30 ] = { 1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char dext[ 30 ] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+int next_byte( struct inflate *s ) {
+    unsigned int n;
+
+    if ( s->inpos == s->inlen ) {
+        n = s->left > INBUF_SIZE ? INBUF_SIZE : (unsigned int)s->left;
+        if ( n == 0 || ( n = fread( s->inbuf, 1, n, s->in ) ) == 0 ) {
+            s->err = 1;
+            return 0;
+        }
+        s->left -= n;
+        s->inlen = n;
+        s->inpos = 0;
+    }
+    return s->inbuf[ s->inpos++ ];
+}
+
+
+int bits( struct inflate *s, int need ) {
+    unsigned long val = s->bitbuf;
+
+    while ( s->bitcnt < need ) {
+        val |= (unsigned long)next_byte( s ) << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return (int)( val & ( ( 1L << need ) - 1 ) );
+}
+
+
+void flush_window( struct inflate *s ) {
+    chk_ctrl_c();
+    s->crc = crc_block( s->crc, s->window, s->wpos );
+    if ( s->out != NULL && fwrite( s->window, 1, s->wpos, s->out ) != s->wpos )
+        s->err = 2;
+    s->wpos = 0;
+}
+
+
+int decode( struct inflate *s, const struct huffman *h ) {
+    int len, code, first, count, index;
+
+    code = first = index = 0;
+    for ( len = 1; len <= MAXBITS; ++len ) {
+        code |= bits( s, 1 );
+        count = h->count[ len ];
+        if ( code - count < first )
+            return h->symbol[ index + ( code - first ) ];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+
+/* 0: complete code, > 0: incomplete, < 0: over-subscribed */
+int construct( struct huffman *h, const short *length, int n ) {
+    int symbol, len, left;
+    short offs[ MAXBITS + 1 ];
+
+    for ( len = 0; len <= MAXBITS; ++len )
+        h->count[ len ] = 0;
+    for ( symbol = 0; symbol < n; ++symbol )
+        h->count[ length[ symbol ] ]++;
+    if ( h->count[ 0 ] == n )
+        return 0;
+    left = 1;
+    for ( len = 1; len <= MAXBITS; ++len ) {
+        left <<= 1;
+        left -= h->count[ len ];
+        if ( left < 0 )
+            return left;
+    }
+    offs[ 1 ] = 0;
+    for ( len = 1; len < MAXBITS; ++len )
+        offs[ len + 1 ] = offs[ len ] + h->count[ len ];
+    for ( symbol = 0; symbol < n; ++symbol )
+        if ( length[ symbol ] != 0 )
+            h->symbol[ offs[ length[ symbol ] ]++ ] = symbol;
+    return left;
+}
+
+
+/* literals and matches up to the end of block code */
+int codes( struct inflate *s, const struct huffman *lencode, const struct huffman *distcode ) {
+    int symbol;
+    unsigned int len, dist, from;
+
+    for ( ;; ) {
+        symbol = decode( s, lencode );
+        if ( symbol < 0 || s->err )
+            return -1;
+        if ( symbol < 256 ) {
+            s->window[ s->wpos++ ] = symbol;
+            s->outcnt++;
+            if ( s->wpos == WSIZE )
+                flush_window( s );
+            continue;
+        }
+        if ( symbol == 256 )
+            return 0;
+        symbol -= 257;
+        if ( symbol >= 29 )
+            return -1;
+        len = lbase[ symbol ] + bits( s, lext[ symbol ] );
+        symbol = decode( s, distcode );
+        if ( symbol < 0 || symbol >= 30 )
+            return -1;
+        dist = dbase[ symbol ] + bits( s, dext[ symbol ] );
+        if ( dist > s->outcnt || s->err )
+            return -1;
+        s->outcnt += len;
+        from = ( s->wpos - dist ) & ( WSIZE - 1 );
+        while ( len-- ) {
+            s->window[ s->wpos++ ] = s->window[ from++ ];
+            from &= WSIZE - 1;
+            if ( s->wpos == WSIZE )
+                flush_window( s );
+        }
+    }
+}
+
+
+int stored( struct inflate *s ) {
+    unsigned int len;
+
+    s->bitbuf = 0; /* to a byte boundary */
+    s->bitcnt = 0;
+    len = bits( s, 16 );
+    if ( ( (unsigned int)bits( s, 16 ) ^ 0xffff ) != len || s->err )
+        return -1;
+    s->outcnt += len;
+    while ( len-- ) {
+        s->window[ s->wpos++ ] = next_byte( s );
+        if ( s->wpos == WSIZE )
+            flush_window( s );
+    }
+    return s->err ? -1 : 0;
+}
+
+
+int fixed( struct inflate *s ) {
+    struct huffman lencode, distcode;
+    short lengths[ FIXLCODES ];
+    int symbol;
+
+    lencode.count = s->lencnt;
+    lencode.symbol = s->lensym;
+    distcode.count = s->distcnt;
+    distcode.symbol = s->distsym;
+    for ( symbol = 0; symbol < 144; ++symbol )
+        lengths[ symbol ] = 8;
+    for ( ; symbol < 256; ++symbol )
+        lengths[ symbol ] = 9;
+    for ( ; symbol < 280; ++symbol )
+        lengths[ symbol ] = 7;
+    for ( ; symbol < FIXLCODES; ++symbol )
+        lengths[ symbol ] = 8;
+    construct( &lencode, lengths, FIXLCODES );
+    for ( symbol = 0; symbol < MAXDCODES; ++symbol )
+        lengths[ symbol ] = 5;
+    construct( &distcode, lengths, MAXDCODES );
+    return codes( s, &lencode, &distcode );
+}
+
+
+int dynamic( struct inflate *s ) {
+    static const unsigned char order[ 19 ] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    struct huffman lencode, distcode;
+    short lengths[ MAXLCODES + MAXDCODES ];
+    int nlen, ndist, ncode, index, symbol, len, err;
+
+    lencode.count = s->lencnt;
+    lencode.symbol = s->lensym;
+    distcode.count = s->distcnt;
+    distcode.symbol = s->distsym;
+    nlen = bits( s, 5 ) + 257;
+    ndist = bits( s, 5 ) + 1;
+    ncode = bits( s, 4 ) + 4;
+    if ( nlen > MAXLCODES || ndist > MAXDCODES )
+        return -1;
+    for ( index = 0; index < ncode; ++index )
+        lengths[ order[ index ] ] = bits( s, 3 );
+    for ( ; index < 19; ++index )
+        lengths[ order[ index ] ] = 0;
+    if ( construct( &lencode, lengths, 19 ) != 0 )
+        return -1;
+
+    index = 0;
+    while ( index < nlen + ndist ) {
+        if ( ( symbol = decode( s, &lencode ) ) < 0 || s->err )
+            return -1;
+        if ( symbol < 16 )
+            lengths[ index++ ] = symbol;
+        else {
+            len = 0;
+            if ( symbol == 16 ) {
+                if ( index == 0 )
+                    return -1;
+                len = lengths[ index - 1 ];
+                symbol = 3 + bits( s, 2 );
+            } else if ( symbol == 17 )
+                symbol = 3 + bits( s, 3 );
+            else
+                symbol = 11 + bits( s, 7 );
+            if ( index + symbol > nlen + ndist )
+                return -1;
+            while ( symbol-- )
+                lengths[ index++ ] = len;
+        }
+    }
+    if ( lengths[ 256 ] == 0 )
+        return -1;
+    /* incomplete codes are only allowed for a single length */
+    err = construct( &lencode, lengths, nlen );
+    if ( err < 0 || ( err > 0 && nlen - lencode.count[ 0 ] != 1 ) )
+        return -1;
+    err = construct( &distcode, lengths + nlen, ndist );
+    if ( err < 0 || ( err > 0 && ndist - distcode.count[ 0 ] != 1 ) )
+        return -1;
+    return codes( s, &lencode, &distcode );
+}
+
+
+int inflate( struct inflate *s ) {
+    int last, err;
+
+    do {
+        last = bits( s, 1 );
+        switch ( bits( s, 2 ) ) {
+        case 0:
+            err = stored( s );
+            break;
+        case 1:
+            err = fixed( s );
+            break;
+        case 2:
+            err = dynamic( s );
+            break;
+        default:
+            err = -1;
+        }
+        if ( err != 0 || s->err )
+            return -1;
+    } while ( !last );
+    return 0;
+}
+
+
+/* -------------------- EXTRACT -------------------- */
+
+#ifdef PARALLEL
+#define MSG_SIZE ( 2 * NAME_SIZE + 64 )
+#else
+#define MSG_SIZE 80
+#endif
+
+/*
+ * Extract (or test) entry e from the archive open on fp into outname,
+ * using s; the outcome goes to msg.  Returns 0 if the member is good.
+ */
+int extract( FILE *fp, struct entry *e, const char *outname, struct inflate *s, char *msg ) {
+    unsigned char hdr[ 30 ];
+    unsigned int n;
+    int err;
+
+    if ( e->flags & 1 ) {
+        sprintf( msg, "%s: encrypted, skipped", e->name );
+        return -1;
+    }
+    if ( e->method != 0 && e->method != 8 ) {
+        sprintf( msg, "%s: method %u not supported", e->name, e->method );
+        return -1;
+    }
+    if ( fseek( fp, e->offset, SEEK_SET ) != 0 || fread( hdr, 1, 30, fp ) != 30
+         || memcmp( hdr, "PK\3\4", 4 ) != 0 ) {
+        sprintf( msg, "%s: bad local header", e->name );
+        return -1;
+    }
+    fseek( fp, get16( hdr + 26 ) + get16( hdr + 28 ), SEEK_CUR );
+
+    s->out = NULL;
+    if ( !testflag && ( s->out = fopen( outname, "wb" ) ) == NULL ) {
+        sprintf( msg, "%s: cannot create", e->name );
+        return -1;
+    }
+    s->in = fp;
+    s->left = e->csize;
+    s->inpos = s->inlen = 0;
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+    s->err = 0;
+    s->wpos = 0;
+    s->outcnt = 0;
+    s->crc = 0xffffffffL;
+
+    if ( e->method == 8 )
+        err = inflate( s );
+    else {
+        err = 0;
+        while ( s->outcnt < e->usize && !s->err ) {
+            n = e->usize - s->outcnt > WSIZE ? WSIZE : (unsigned int)( e->usize - s->outcnt );
+            for ( s->wpos = 0; s->wpos < n; )
+                s->window[ s->wpos++ ] = next_byte( s );
+            s->outcnt += n;
+            flush_window( s );
+        }
+    }
+    if ( s->wpos )
+        flush_window( s );
+    if ( s->out != NULL && fclose( s->out ) != 0 )
+        s->err = 2;
+
+    if ( s->err == 2 )
+        sprintf( msg, "%s: write error", e->name );
+    else if ( err || s->err )
+        sprintf( msg, "%s: bad compressed data", e->name );
+    else if ( ( s->crc ^ 0xffffffffL ) != e->crc || s->outcnt != e->usize )
+        sprintf( msg, "%s: CRC error", e->name );
+    else {
+        sprintf( msg, "%s (%lu) %s", e->name, e->usize, testflag ? "OK" : "extracted" );
+        return 0;
+    }
+    return -1;
+}
+
+
+#ifdef PARALLEL
+/*
+ * The workers take the selected members in archive order, each with
+ * its own stream and inflate state, and write to a temporary name;
+ * main() renames and reports each member once it and all before it
+ * are done, so the output matches a serial run.
+ */
+struct report {
+    char msg[ MSG_SIZE ];
+    int err;
+    char done;
+};
+
+const char *zipfile;
+struct report *reports;
+unsigned int nextentry;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+
+
+void tmp_name( char *out, unsigned int i ) { sprintf( out, "%s.$%u", entries[ i ].name, i ); }
+
+
+void *worker( void *arg ) {
+    struct inflate *s;
+    char tmp[ NAME_SIZE + 16 ];
+    unsigned int i;
+    FILE *fp;
+
+    s = malloc( sizeof( struct inflate ) );
+    fp = fopen( zipfile, "rb" );
+    for ( ;; ) {
+        pthread_mutex_lock( &lock );
+        while ( nextentry < nentries && !entries[ nextentry ].selected )
+            ++nextentry;
+        i = nextentry++;
+        pthread_mutex_unlock( &lock );
+        if ( i >= nentries )
+            break;
+        if ( s == NULL || fp == NULL ) {
+            sprintf( reports[ i ].msg, "%s: out of memory", entries[ i ].name );
+            reports[ i ].err = -1;
+        } else {
+            tmp_name( tmp, i );
+            reports[ i ].err = extract( fp, &entries[ i ], tmp, s, reports[ i ].msg );
+        }
+        pthread_mutex_lock( &lock );
+        reports[ i ].done = 1;
+        pthread_cond_signal( &ready );
+        pthread_mutex_unlock( &lock );
+    }
+    if ( fp != NULL )
+        fclose( fp );
+    free( s );
+    return arg;
+}
+
+
+/* -1 if no thread could be started, else the error count */
+int pextract( const char *archive, unsigned int nsel ) {
+    pthread_t tid[ MAXWORKERS ];
+    char tmp[ NAME_SIZE + 16 ];
+    long ncpu;
+    unsigned int i;
+    int nw, errors;
+
+    if ( ( ncpu = sysconf( _SC_NPROCESSORS_ONLN ) ) > MAXWORKERS )
+        ncpu = MAXWORKERS;
+    if ( ncpu > (long)nsel )
+        ncpu = nsel;
+    if ( ncpu < 2 || ( reports = calloc( nentries, sizeof( struct report ) ) ) == NULL )
+        return -1;
+    zipfile = archive;
+    nextentry = 0;
+    for ( nw = 0; nw < ncpu; ++nw )
+        if ( pthread_create( &tid[ nw ], NULL, worker, NULL ) != 0 )
+            break;
+    if ( nw == 0 ) {
+        free( reports );
+        return -1;
+    }
+    errors = 0;
+    for ( i = 0; i < nentries; ++i ) {
+        if ( !entries[ i ].selected )
+            continue;
+        pthread_mutex_lock( &lock );
+        while ( !reports[ i ].done )
+            pthread_cond_wait( &ready, &lock );
+        pthread_mutex_unlock( &lock );
+        if ( !testflag ) {
+            tmp_name( tmp, i );
+            if ( reports[ i ].err == 0 ) {
+                remove( entries[ i ].name );
+                if ( rename( tmp, entries[ i ].name ) != 0 ) {
+                    sprintf( reports[ i ].msg, "%s: cannot rename %s", entries[ i ].name, tmp );
+                    reports[ i ].err = -1;
+                }
+            } else
+                remove( tmp );
+        }
+        printf( "%s\n", reports[ i ].msg );
+        if ( reports[ i ].err )
+            ++errors;
+    }
+    while ( nw-- > 0 )
+        pthread_join( tid[ nw ], NULL );
+    free( reports );
+    return errors;
+}
+#endif
+
+
+/* -------------------- MAIN -------------------- */
+
+void list( void ) {
+    static const char *methods[] = { "Stored", "Shrunk", "Reduce1", "Reduce2", "Reduce3",
+                                     "Reduce4", "Implode", "?", "Deflate" };
+    unsigned long usum, csum;
+    unsigned int i, n;
+
+    usum = csum = 0;
+    n = 0;
+    printf( "   Length     Size  Method   Name\n" );
+    for ( i = 0; i < nentries; ++i ) {
+        if ( !entries[ i ].selected )
+            continue;
+        printf( "%9lu %8lu  %-7s  %s\n", entries[ i ].usize, entries[ i ].csize,
+                entries[ i ].method <= 8 ? methods[ entries[ i ].method ] : "?", entries[ i ].name );
+        usum += entries[ i ].usize;
+        csum += entries[ i ].csize;
+        ++n;
+    }
+    printf( "%9lu %8lu           %u files\n", usum, csum, n );
+}
+
+
+void usage( const char *argv0 ) {
+    printf( "Tiny UNZIP version %s\n", VERSION );
+    printf( "Usage: %s [-l|-t] archive.zip [name ...]\n", argv0 );
+    printf( "  -l  list the members\n" );
+    printf( "  -t  test the members\n" );
+}
+
+
+int main( int argc, char *argv[] ) {
+    static struct inflate state; /* 33K: not on the stack */
+    char msg[ MSG_SIZE ];
+    unsigned int i, nsel;
+    int a, k, errors;
+    FILE *fp;
+
+#ifdef CPM
+    if ( !**argv )
+        *argv = "unzip"; /* argv[0] CP/M is the empty string ("") */
+#endif
+    for ( a = 1; a < argc && argv[ a ][ 0 ] == '-'; ++a ) {
+        if ( toupper( (unsigned char)argv[ a ][ 1 ] ) == 'L' )
+            listflag = 1;
+        else if ( toupper( (unsigned char)argv[ a ][ 1 ] ) == 'T' )
+            testflag = 1;
+        else {
+            usage( *argv );
+            return 1;
+        }
+    }
+    if ( a >= argc ) {
+        usage( *argv );
+        return 1;
+    }
+    if ( ( fp = fopen( argv[ a ], "rb" ) ) == NULL ) {
+        perror( argv[ a ] );
+        return 1;
+    }
+    if ( read_directory( fp ) != 0 )
+        return 1;
+
+    /* members named on the command line, default all */
+    nsel = 0;
+    for ( i = 0; i < nentries; ++i ) {
+        if ( entries[ i ].selected && a + 1 < argc ) {
+            for ( k = a + 1; k < argc && !match( argv[ k ], entries[ i ].name ); ++k )
+                ;
+            entries[ i ].selected = k < argc;
+        }
+        nsel += entries[ i ].selected;
+    }
+
+    if ( listflag ) {
+        list();
+        return 0;
+    }
+    crc_init();
+#ifdef PARALLEL
+    if ( ( errors = pextract( argv[ a ], nsel ) ) >= 0 ) {
+        fclose( fp );
+        return errors ? 2 : 0;
+    }
+#endif
+    errors = 0;
+    for ( i = 0; i < nentries; ++i ) {
+        if ( !entries[ i ].selected )
+            continue;
+        if ( extract( fp, &entries[ i ], entries[ i ].name, &state, msg ) != 0 )
+            ++errors;
+        printf( "%s\n", msg );
+    }
+    fclose( fp );
+    return errors ? 2 : 0;
+}
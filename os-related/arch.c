@@ -14,6 +14,10 @@
  * Build example:
  * zcc +cpm -create-app -O3 -Dunix -DAMALLOC -oarch arch.c
  *
+ * On Unix, "arch -t", run in a scratch directory, checks that update
+ * keeps every member, on archives laid out by older arch as well:
+ * gcc -Dunix -o arch arch.c && ./arch -t
+ *
  * CP/M emulators note:
  *    only text files created by CP/M programs will be processed correctly!
  */
@@ -53,6 +57,7 @@ description
 	.s.i -8;p	Print files on standard output
 	.s.i -8;r	Replace, same as update
 	.s.i -8;l	List archive contents (directory)
+	.s.i -8;n	Keep a member index at the end of the archive
 	.s.i -8;u	Update, same as replace
 	.s.i -8;x	Extract named files
 	.s.i -8;v	Verbose
@@ -119,6 +124,24 @@ archive file format
 	fields are ignored.  On Dec operating systems, file.name is
 	forced to lowercase.
 
+	On Unix (not the CP/M build), update works on the archive where
+	it is.  New files are appended, and a replaced file is rewritten
+	over its old text if it fits.  If it does not fit, the old text
+	is turned into filler and the file is appended, so it then comes
+	after the members that followed it: the order of the members
+	changes.  (The c option builds an archive afresh, in the order of
+	the files given.)  Filler is a member called ".archpad", which
+	arch and archx skip.  The archive is copied, dropping the filler,
+	only by delete, or when update cannot work in place, as when an
+	older arch has added files after the index.
+
+	With the n option, the archive ends with a member called
+	".archidx".  It holds one line per member, giving the name and
+	the offset of its header, and a last line giving the offset of
+	".archidx" itself.  archx -x uses it to go straight to a member.
+	Once an archive has an index, arch keeps it up to date.  Older
+	versions of archx extract the two members as ordinary files.
+
 diagnostics
 
 	Diagnostic messages should be self-explanatory
@@ -176,11 +199,23 @@ extern	FILE		*fnext();	/* Open next wild card file	*/
 #define unlink(a) remove(a)
 #endif
 
+/*
+ * Update in place needs byte offsets and ftruncate()
+ */
+#if defined(unix) && !defined(Z80)
+#define	INPLACE
+#include	<unistd.h>
+#endif
+
 #ifdef	tolower
 #undef	tolower
 #endif
 
 #define	TEMPNAME	"ar.tmp"
+#define	INDEXNAME	".archidx"	/* Member index, at the end	*/
+#define	PADNAME		".archpad"	/* Space left by a replaced file */
+#define	PADMIN		13		/* Smallest filler member	*/
+#define	internal(n)	(strcmp(n, INDEXNAME) == 0 || strcmp(n, PADNAME) == 0)
 
 typedef struct filename {
 	char namepart[10];
@@ -198,6 +233,18 @@ typedef struct List {
 	char		*l_filename;	/* directory file name		*/
 } LIST;
 
+/*
+ * Member chains together the archive members and where they are.
+ */
+
+typedef struct Member {
+	struct Member	*m_next;	/* -> next member		*/
+	char		*m_name;	/* archive name			*/
+	char		*m_file;	/* file to append in its place	*/
+	long		m_start;	/* offset of the header		*/
+	long		m_end;		/* offset of the next header	*/
+} MEMBER;
+
 /*
  * Global storage
  */
@@ -220,6 +267,15 @@ int		extract		= 0;	/* Get files from archive	*/
 int		print		= 0;	/* Write files to stdout	*/
 int		errorflag	= 0;	/* Set on fatal error		*/
 LIST		*list		= NULL;	/* String list header		*/
+MEMBER		*members	= NULL;	/* Members, in archive order	*/
+MEMBER		**mtail		= &members;
+FILE		*idxfd		= NULL;	/* Archive the members go to	*/
+int		indexflag	= FALSE; /* Write a member index	*/
+int		hadindex	= FALSE; /* Archive had an index	*/
+
+extern	MEMBER		*addmember();	/* Note where a member is	*/
+extern	void		writepad();	/* Filler up to a member's end	*/
+extern	void		writeindex();	/* Member index at the end	*/
 
 arcopy(infd, outfd)
 register FILE	*infd;
@@ -455,7 +511,7 @@ dodirectory()
 {
 	text[0] = EOS;
 	while (gethdr(arfd)) {
-		if (findarg(arname, NULL)) {
+		if (!internal(arname) && findarg(arname, NULL)) {
 			printf(text);
 		}
 		arcopy(arfd, NULL);		/* Skip file		*/
@@ -535,6 +591,10 @@ int		printflag;	/* TRUE to print, FALSE to extract	*/
 	outfd = (printflag) ? stdout : NULL;
 	text[0] = EOS;
 	while (gethdr(arfd)) {
+		if (internal(arname)) {
+			arcopy(arfd, NULL);
+			continue;
+		}
 		if (!findarg(arname, NULL)) {
 			if (verbose) {
 				fprintf(logfd, "Skipping \"%s\"\n", arname);
@@ -630,6 +690,8 @@ char		*why;		/* Why are we here -- for verbosity	*/
 			fprintf(logfd, "%s archive member \"%s\" (%s)\n",
 				why, name, filename);
 		}
+		if (outfd == idxfd)
+			addmember(name, ftell(outfd));
 		fprintf(outfd, "-h- %s\t%s\t%s\n", name, timetext, filename);
 		arimport(infd, outfd, filename);
 		fclose(infd);
@@ -650,6 +712,15 @@ int		ecount;
 {
 	text[0] = EOS;			/* Signal gethdr initialization	*/
 	while (gethdr(infd)) {
+		/*
+		 * Filler and the old index are dropped
+		 */
+		if (internal(arname)) {
+			if (strcmp(arname, INDEXNAME) == 0)
+				hadindex = TRUE;
+			arcopy(infd, NULL);
+			continue;
+		}
 		/*
 		 * We have a file, is it selected?
 		 */
@@ -664,6 +735,7 @@ int		ecount;
 			/*
 			 * Not selected for update, copy to the new archive
 			 */
+			addmember(arname, ftell(outfd));
 			do_fputs(text, outfd);
 			arcopy(infd, outfd);
 		}
@@ -681,8 +753,11 @@ dodelete()
 	if (list == NULL) {
 		fatal("Delete by name only");
 	}
+	idxfd = newfd;
 	ecount = replace(arfd, newfd, FALSE, 0);
 	notfound();
+	if (hadindex || indexflag)
+		writeindex(newfd);
 	fclose(arfd);
 	fclose(newfd);
 	if (ecount == 0) {
@@ -935,6 +1010,7 @@ usage()
 \td\tDelete named files\n\
 \ti\tInsert named files\n\
 \tl\tList archive directory\n\
+\tn\tKeep a member index at the end (for archx -x)\n\
 \tp\tPrint named files on standard output\n\
 \tr\tReplace named files\n\
 \tu\tUpdate -- replace named files\n\
@@ -999,6 +1075,214 @@ register int	c;
 	return ((isupper(c)) ? c + ('a' - 'A') : c);
 }*/
 
+MEMBER *
+addmember(name, start)
+char		*name;
+long		start;
+/*
+ * Note a member at the end of the member chain
+ */
+{
+	register MEMBER	*mp;
+
+	if ((mp = (MEMBER *)malloc(sizeof(MEMBER))) == NULL
+	 || (mp->m_name = (char *)malloc(strlen(name) + 1)) == NULL)
+		fatal("Out of memory in addmember");
+	strcpy(mp->m_name, name);
+	mp->m_file = NULL;
+	mp->m_start = start;
+	mp->m_end = -1L;
+	mp->m_next = NULL;
+	*mtail = mp;
+	mtail = &mp->m_next;
+	return (mp);
+}
+
+long
+scanarchive(fd)
+FILE		*fd;
+/*
+ * Note where each member starts and ends, and where the index is.
+ * Returns where new members go: the index, or the end.  Older arch
+ * copied the index like a member and added files after it: if
+ * anything follows the index, return -1L, the archive has to be
+ * copied.
+ */
+{
+	register MEMBER	*mp;
+	long		pos, index;
+	int		after;
+
+	mp = NULL;
+	index = -1L;
+	after = FALSE;
+	rewind(fd);
+	for (pos = 0L; fgets(text, sizeof text, fd) != NULL; pos = ftell(fd)) {
+		if (!gethdr(fd))
+			continue;
+		if (mp != NULL)
+			mp->m_end = pos;
+		mp = NULL;
+		if (index >= 0L)
+			after = TRUE;
+		if (strcmp(arname, INDEXNAME) == 0) {
+			hadindex = TRUE;
+			index = pos;
+		}
+		else
+			mp = addmember(arname, pos);
+	}
+	text[0] = EOS;
+	fseek(fd, 0L, SEEK_END);
+	pos = ftell(fd);
+	if (mp != NULL)
+		mp->m_end = pos;
+	return (after ? -1L : index >= 0L ? index : pos);
+}
+
+void
+writepad(fd, end)
+FILE		*fd;
+long		end;
+/*
+ * Fill the archive up to end with a filler member.
+ */
+{
+	register long	left;
+
+	fprintf(fd, "-h- %s\n", PADNAME);
+	while ((left = end - ftell(fd)) > 0) {
+		if (left > 200)
+			left = 200;
+		while (--left > 0)
+			putc(' ', fd);
+		putc('\n', fd);
+	}
+}
+
+void
+writeindex(fd)
+FILE		*fd;
+/*
+ * Write the member index at the end of the archive
+ */
+{
+	register MEMBER	*mp;
+	long		start;
+
+	start = ftell(fd);
+	fprintf(fd, "-h- %s\n", INDEXNAME);
+	for (mp = members; mp != NULL; mp = mp->m_next)
+		if (!internal(mp->m_name))
+			fprintf(fd, "%s %10ld\n", mp->m_name, mp->m_start);
+	fprintf(fd, "%s %10ld\n", INDEXNAME, start);
+}
+
+int
+inplace()
+/*
+ * Update the archive where it is.  Return FALSE, before changing
+ * anything, if it has to be copied after all.
+ */
+{
+#ifdef	INPLACE
+	register MEMBER	*mp;
+	register LIST	*lp;
+	FILE		*scratch;
+	long		end, size;
+	int		ecount, n;
+
+	if ((end = scanarchive(arfd)) < 0L)
+		return (FALSE);
+	/*
+	 * A replaced member that doesn't fit becomes filler,
+	 * so it must have room for the filler header.
+	 */
+	for (mp = members; mp != NULL; mp = mp->m_next)
+		if (findarg(mp->m_name, NULL)
+		 && mp->m_end - mp->m_start < PADMIN)
+			return (FALSE);
+	fclose(arfd);
+	fclose(newfd);
+	if ((arfd = fopen(arfilename, "r+")) == NULL)
+		cant(arfilename, "open for update");
+	if ((scratch = fopen(TEMPNAME, "w+")) == NULL)
+		cant(TEMPNAME, "create archive work file");
+	newfd = NULL;
+	idxfd = arfd;
+
+	ecount = 0;
+	for (mp = members; mp != NULL; mp = mp->m_next) {
+		if (!findarg(mp->m_name, filename))
+			continue;
+		if (freopen(TEMPNAME, "w+", scratch) == NULL)
+			cant(TEMPNAME, "create archive work file");
+		if ((n = addfile(mp->m_name, filename, scratch, 0,
+				"Replaced")) != 0) {
+			ecount += n;	/* Old text stays		*/
+			continue;
+		}
+		size = ftell(scratch);
+		fseek(arfd, mp->m_start, SEEK_SET);
+		if (size == mp->m_end - mp->m_start
+		 || size + PADMIN <= mp->m_end - mp->m_start) {
+			rewind(scratch);
+			while (fgets(text, sizeof text, scratch) != NULL)
+				do_fputs(text, arfd);
+			if (size < mp->m_end - mp->m_start)
+				writepad(arfd, mp->m_end);
+		}
+		else {
+			writepad(arfd, mp->m_end);
+			if ((mp->m_file = (char *)malloc(strlen(filename) + 1))
+					== NULL)
+				fatal("Out of memory in inplace");
+			strcpy(mp->m_file, filename);
+		}
+	}
+	fclose(scratch);
+	unlink(TEMPNAME);
+
+	/*
+	 * What didn't fit, and new files, go over the old index
+	 */
+	fseek(arfd, end, SEEK_SET);
+	for (mp = members; mp != NULL; mp = mp->m_next) {
+		if (mp->m_file != NULL) {
+			ecount += addfile(mp->m_name, mp->m_file, arfd, 0,
+					"Replaced");
+			mp->m_name = PADNAME;
+		}
+	}
+	for (lp = list; lp != NULL; lp = lp->l_next) {
+		if (!lp->l_flag) {
+			ecount += addfile(lp->l_arname, lp->l_filename,
+					arfd, 0, "Added");
+			lp->l_flag = TRUE;
+		}
+	}
+	if (hadindex || indexflag)
+		writeindex(arfd);
+	fflush(arfd);
+	if (ftruncate(fileno(arfd), ftell(arfd)) != 0
+	 || fclose(arfd) == EOF)
+		cant(arfilename, "update");
+	if (ecount) {
+		fprintf(stderr, "completed with %d errors\n", ecount);
+		if (logging)
+			fprintf(logfd, "completed with %d errors\n", ecount);
+	}
+	return (TRUE);
+#else
+	/*
+	 * CP/M files end on a record, and line ends take two
+	 * bytes: the sizes can't be worked out from the text.
+	 */
+	return (FALSE);
+#endif
+}
+
+void
 doupdate()
 /*
  * Update existing files, add argv[1]..argv[argc-1] at end
@@ -1007,8 +1291,18 @@ doupdate()
 	register int	ecount;
 	register LIST	*lp;
 
+	if (!newarchive && inplace())
+		return;
+	/*
+	 * Copy to a new archive
+	 */
 	ecount = 0;
+	idxfd = newfd;
+	members = NULL;
+	mtail = &members;
+	hadindex = FALSE;
 	if (!newarchive) {
+		rewind(arfd);
 		ecount = replace(arfd, newfd, TRUE, 0);
 	}
 	for (lp = list; lp != NULL; lp = lp->l_next) {
@@ -1018,6 +1312,8 @@ doupdate()
 			lp->l_flag = TRUE;
 		}
 	}
+	if (hadindex || indexflag)
+		writeindex(newfd);
 	if (newarchive) {
 		fclose(newfd);
 		if (ecount) {
@@ -1046,6 +1342,123 @@ doupdate()
 	}
 }
 
+#ifdef	INPLACE
+/*
+ * Update check, arch -t: archives laid out by older arch and by this
+ * one are updated by running this program (self), then read back.
+ */
+static char	*tcase[][4] = {
+	/* archive as written, file and its new text, members after */
+	{ "ta.txt:AAA|tb.txt:BBB|.archidx:|tc.txt:CCC|",
+	  "ta.txt", "AAAAAA",
+	  "ta.txt:AAAAAA|tb.txt:BBB|tc.txt:CCC|" },
+	{ "ta.txt:AAA|.archidx:|tb.txt:BBB|.archidx:|",
+	  "ta.txt", "XYZ",
+	  "ta.txt:XYZ|tb.txt:BBB|" },
+	{ "ta.txt:AAA|tb.txt:BBB|.archidx:|",
+	  "ta.txt", "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA",
+	  "tb.txt:BBB|ta.txt:AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA|" },
+	{ "ta.txt:AAA|tb.txt:BBB|.archidx:|",
+	  "tc.txt", "CCC",
+	  "ta.txt:AAA|tb.txt:BBB|tc.txt:CCC|" },
+};
+
+int
+readback(arname, got)
+char		*arname;
+char		*got;
+/*
+ * Put "name:text|" for each file in the archive into got.  Return
+ * FALSE unless it ends with an index that points at every member.
+ */
+{
+	register FILE	*fd;
+	char		line[200], name[100], *gp;
+	long		pos, at, index;
+	int		ok;
+
+	got[0] = EOS;
+	if ((fd = fopen(arname, "r")) == NULL)
+		return (FALSE);
+	gp = got;
+	index = -1L;
+	for (pos = 0L; fgets(line, sizeof line, fd) != NULL; pos = ftell(fd)) {
+		line[strcspn(line, "\n")] = EOS;
+		if (strncmp(line, "-h- ", 4) == 0) {
+			sscanf(line + 4, "%99s", name);
+			index = strcmp(name, INDEXNAME) == 0 ? pos : -1L;
+			if (!internal(name))
+				gp += sprintf(gp, "%s:", name);
+		}
+		else if (index < 0L && !internal(name))
+			gp += sprintf(gp, "%s|", line);
+	}
+	ok = index >= 0L;
+	if (ok) {
+		fseek(fd, index, SEEK_SET);
+		fgets(line, sizeof line, fd);
+		while (ok && fscanf(fd, "%99s %ld", name, &at) == 2) {
+			pos = ftell(fd);
+			fseek(fd, at, SEEK_SET);
+			ok = fgets(line, sizeof line, fd) != NULL
+			  && strncmp(line, "-h- ", 4) == 0
+			  && strncmp(line + 4, name, strlen(name)) == 0;
+			fseek(fd, pos, SEEK_SET);
+		}
+	}
+	fclose(fd);
+	return (ok);
+}
+
+int
+archtest(self)
+char		*self;
+/*
+ * Run the cases, return the number of failures
+ */
+{
+	register FILE	*fd;
+	register char	*tp;
+	char		cmd[200], got[400];
+	int		i, bad, ok;
+
+	bad = 0;
+	for (i = 0; i < sizeof tcase / sizeof tcase[0]; i++) {
+		/*
+		 * Write the archive, a member to a line
+		 */
+		if ((fd = fopen("artest.arc", "w")) == NULL)
+			cant("artest.arc", "create");
+		for (tp = tcase[i][0]; *tp != EOS; tp++) {
+			if (tp == tcase[i][0] || tp[-1] == '|')
+				fprintf(fd, "-h- ");
+			putc(*tp == ':' || *tp == '|' ? '\n' : *tp, fd);
+			if (*tp == ':' && tp[1] == '|')
+				tp++;
+		}
+		fclose(fd);
+		if ((fd = fopen(tcase[i][1], "w")) == NULL)
+			cant(tcase[i][1], "create");
+		fprintf(fd, "%s\n", tcase[i][2]);
+		fclose(fd);
+
+		sprintf(cmd, "%s -u artest.arc %s 2>/dev/null", self, tcase[i][1]);
+		ok = system(cmd) == 0
+		  && readback("artest.arc", got)
+		  && strcmp(got, tcase[i][3]) == 0;
+		printf("case %d: %s\n", i + 1, ok ? "ok" : "FAILED");
+		if (!ok) {
+			printf("    got:  %s\n    want: %s\n", got, tcase[i][3]);
+			bad++;
+		}
+		unlink(tcase[i][1]);
+		unlink("artest.arc");
+	}
+	printf(bad ? "%d case(s) FAILED\n" : "update keeps every member\n", bad);
+	return (bad);
+}
+#endif
+
 main(argc, argv)
 int		argc;			/* Arg count			*/
 char		*argv[];		/* Arg vector			*/
@@ -1060,6 +1473,10 @@ char		*argv[];		/* Arg vector			*/
 #ifdef vms
 	argc = getredirection(argc,argv);
 #endif
+#ifdef	INPLACE
+	if (argc == 2 && strcmp(argv[1], "-t") == 0)
+		exit(archtest(argv[0]));
+#endif
 
 	/*
 	 * Setup the time of day, erasing trailing '\n'
@@ -1098,6 +1515,10 @@ char		*argv[];		/* Arg vector			*/
 					directory = 1;
 					break;
 
+				case 'n':	/* Member index		*/
+					indexflag = TRUE;
+					break;
+
 				case 'i':	/* Insert		*/
 				case 'r':	/* Replace		*/
 				case 'u':	/* Update modified	*/
@@ -44,13 +44,14 @@ index		text file archiver extraction
 synopsis
 
 	archx archive_files
+	archx -x archive member...
 
 description
 
 	Archx manages archives (libraries) of source files, allowing
 	a large number of small files to be stored without using
 	excessive system resources.  Archx extracts all files from
-	an archive.
+	an archive.  With -x, only the named members are extracted.
 
 	If no archive_name file is given, the standard input is read.
 	Archive header records are echoed to the standard output.
@@ -74,6 +75,13 @@ archive file format
 	This is needed if archives are distributed by mail
 	and arrive with initial routing and subject information.
 
+	Members called ".archpad" (space left by arch when a file
+	was replaced) and ".archidx" (the member index written by
+	arch -n) are skipped.  With -x, archx looks a member up in
+	the index and goes straight to it.  Without an index, or
+	if the index is out of date, the archive is read from the
+	start.
+
 diagnostics
 
 	Diagnostic messages should be self-explanatory
@@ -117,6 +125,13 @@ bugs
 #define	GOTCHA	1
 #define	NOGOOD	2
 
+/*
+ * Members written by arch that are not files
+ */
+#define	INDEXNAME	".archidx"	/* Member index, at the end	*/
+#define	PADNAME		".archpad"	/* Space left by a replaced file */
+#define	internal(n)	(strcmp(n, INDEXNAME) == 0 || strcmp(n, PADNAME) == 0)
+
 char		text[255];		/* Working text line		*/
 char		name[81];		/* Current archive member name	*/
 char		filename[81];		/* Working file name		*/
@@ -244,6 +259,10 @@ process()
 	while ((i = gethdr()) != DONE) {
 	    switch (i) {
 	    case GOTCHA:
+		if (internal(name)) {
+		    arskip();
+		    continue;
+		}
 		if ((outfd = fopen(name, "w")) == NULL) {
 		    perror(name);
 		    fprintf(stderr, "Can't create \"%s\"\n", name);
@@ -270,6 +289,103 @@ process()
 }
 
 
+long
+lookup(member)
+char		*member;
+/*
+ * Find member in the index of the archive open on stdin.
+ * Return the offset of its header, or -1L if there is no index
+ * or member is not in it.
+ */
+{
+#ifndef	RATFOR
+	char			entry[81];
+	long			pos;
+
+	/*
+	 * The last line gives the offset of the index
+	 */
+	if (fseek(stdin, 0L, SEEK_END) != 0
+	 || (pos = ftell(stdin)) < 0L)
+	    return (-1L);
+	fseek(stdin, (pos > 64L) ? pos - 64L : 0L, SEEK_SET);
+	pos = -1L;
+	while (fgets(text, sizeof text, stdin) != NULL) {
+	    if (sscanf(text, "%80s %ld", entry, &pos) != 2
+	     || strcmp(entry, INDEXNAME) != 0)
+		pos = -1L;
+	}
+	text[0] = EOS;
+	if (pos < 0L
+	 || fseek(stdin, pos, SEEK_SET) != 0
+	 || gethdr() != GOTCHA
+	 || strcmp(name, INDEXNAME) != 0)
+	    return (-1L);
+	while (fgets(text, sizeof text, stdin) != NULL
+	    && sscanf(text, "%80s %ld", entry, &pos) == 2
+	    && strcmp(entry, INDEXNAME) != 0) {
+	    if (strcmp(entry, member) == 0)
+		return (pos);
+	}
+#endif
+	return (-1L);
+}
+
+
+void
+export1()
+/*
+ * Extract the member whose header was just read
+ */
+{
+	register FILE		*outfd;
+
+	if ((outfd = fopen(name, "w")) == NULL) {
+	    perror(name);
+	    fprintf(stderr, "Can't create \"%s\"\n", name);
+	    return;
+	}
+	arexport(outfd);
+	fclose(outfd);
+}
+
+
+int
+extractone(member)
+char		*member;
+/*
+ * Extract member from the archive open on stdin.
+ * Return FALSE if it isn't there.
+ */
+{
+	register int		i;
+	long			pos;
+
+	if ((pos = lookup(member)) >= 0L) {
+	    text[0] = EOS;
+	    if (fseek(stdin, pos, SEEK_SET) == 0
+	     && gethdr() == GOTCHA
+	     && strcmp(name, member) == 0) {
+		export1();
+		return (TRUE);
+	    }
+	}
+	/*
+	 * No index, or it is out of date: read through the archive
+	 */
+	rewind(stdin);
+	text[0] = EOS;
+	while ((i = gethdr()) != DONE) {
+	    if (i == GOTCHA && strcmp(name, member) == 0) {
+		export1();
+		return (TRUE);
+	    }
+	    arskip();
+	}
+	return (FALSE);
+}
+
+
 main(argc, argv)
 int		argc;			/* Arg count			*/
 char		*argv[];		/* Arg vector			*/
@@ -283,6 +399,22 @@ char		*argv[];		/* Arg vector			*/
 	status = IO_SUCCESS;
 	if (argc == 1)
 	    process();
+	else if (strcmp(argv[1], "-x") == 0) {
+	    if (argc < 4) {
+		fprintf(stderr, "Usage: archx -x archive member...\n");
+		exit(IO_ERROR);
+	    }
+	    if (freopen(argv[2], "r", stdin) == NULL) {
+		perror(argv[2]);
+		exit(IO_ERROR);
+	    }
+	    for (i = 3; i < argc; i++) {
+		if (!extractone(argv[i])) {
+		    fprintf(stderr, "\"%s\" is not in %s\n", argv[i], argv[2]);
+		    status = IO_ERROR;
+		}
+	    }
+	}
 	else {
 	    for (i = 1; i < argc; i++) {
 		if (freopen(argv[i], "r", stdin) != NULL)
@@ -0,0 +1,555 @@
+/*
+ *	cbench - compression benchmark for the packers in this directory
+ *
+ *	Runs each packer/unpacker pair over a small corpus and reports the
+ *	compression ratio, the speed both ways and the peak memory of each
+ *	program, as a table or as tab separated lines for scripts.
+ *
+ *	Hosted (POSIX) only, it runs the tools as child processes:
+ *	gcc -O2 -o cbench cbench.c
+ *
+ *	The tools are looked for in the current directory (see -b):
+ *	gcc -O2 -o sq sq.c
+ *	gcc -O2 -DUSQ -o usq usq.c unpack.c
+ *	gcc -O2 -o crunch crunch.c
+ *	gcc -O2 -DUNCRUNCH -o uncr uncrunch.c unpack.c
+ *	gcc -O2 -o lzencode lzencode.c
+ *	gcc -O2 -DUNLZHUF -o lzdecode lzdecode.c unpack.c
+ *	gcc -O2 -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER -pthread -o lar lar.c unpack.c
+ *
+ *	Usage: cbench [-m] [-b dir] [-r n] [-w dir] [file ...]
+ *		-m	machine readable output, one tab separated line per test
+ *		-b dir	where the tools are (default .)
+ *		-r n	best time of n runs (default 3)
+ *		-w dir	work directory (default cbench.d), left for inspection
+ *
+ *	Without file names the corpus is made up from this tree, run it
+ *	from os-related:
+ *		TEXT.TXT	the text documents here, CR/LF and ^Z padded
+ *		Z80.COM		generated Z80 code with CP/M style messages
+ *		SCR.SCR		the SCREEN$ images in ../graphics/scr
+ *		SRC.C		the C sources here
+ *	Files given on the command line are benchmarked as F1.DAT, F2.DAT...
+ *	(sq keeps names within 12 characters).
+ *
+ *	The "lar" rows pack with crunch or sq, then store the result in a
+ *	library and time 'lar e' on it.  There is no crLZH packer in the
+ *	tree, so lar's LZH path is not covered.  arch only stores text
+ *	files and has nothing to compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAXCORPUS	32
+#define SECTOR		128
+#define CTRLZ		0x1a
+
+struct codec {
+	char	*name;
+	char	*enc;		/* packer */
+	char	*dec;		/* unpacker */
+	char	mid;		/* letter put into the type, 0: named by us */
+	int	lbr;		/* unpacked out of a library by lar */
+} codecs[] = {
+	{ "sq",		"sq",		"usq",		'Q',	0 },
+	{ "crunch",	"crunch",	"uncr",		'Z',	0 },
+	{ "lzhuf",	"lzencode",	"lzdecode",	0,	0 },
+	{ "lar/sq",	"sq",		"lar",		'Q',	1 },
+	{ "lar/lzw",	"crunch",	"lar",		'Z',	1 },
+};
+#define NCODECS	(sizeof(codecs) / sizeof(codecs[0]))
+
+char	*corpus[MAXCORPUS];
+int	ncorpus;
+char	bindir[PATH_MAX];
+char	workdir[PATH_MAX];
+char	indir[PATH_MAX], outdir[PATH_MAX];
+int	repeats = 3;
+int	machine;
+
+unsigned long seed = 1;
+
+int rnd(int n)
+{
+	seed = seed * 1103515245L + 12345;
+	return (int) ((seed >> 16) & 0x7fff) % n;
+}
+
+
+void fatal(char *msg, char *arg)
+{
+	fprintf(stderr, "cbench: %s%s\n", msg, arg);
+	exit(1);
+}
+
+
+/* name of a file in the work area */
+char *path(char *dir, char *name)
+{
+	static char buf[2][PATH_MAX];
+	static int n;
+
+	n ^= 1;
+	if (snprintf(buf[n], PATH_MAX, "%s/%s", dir, name) >= PATH_MAX)
+		fatal("path too long: ", name);
+	return buf[n];
+}
+
+
+long fsize(char *name)
+{
+	struct stat st;
+
+	return stat(name, &st) == 0 ? (long) st.st_size : -1L;
+}
+
+
+/* append a file to f, with CR/LF line ends if crlf; false if missing */
+int append(FILE *f, char *name, int crlf)
+{
+	FILE *in;
+	int c;
+
+	if ((in = fopen(name, "rb")) == NULL)
+		return 0;
+	while ((c = getc(in)) != EOF) {
+		if (crlf && c == '\n')
+			putc('\r', f);
+		if (crlf && c == '\r')
+			continue;
+		putc(c, f);
+	}
+	fclose(in);
+	return 1;
+}
+
+
+int cmpname(const void *a, const void *b)
+{
+	return strcmp(*(char **) a, *(char **) b);
+}
+
+
+/* append all the files of dir ending in ext, in name order */
+void appenddir(FILE *f, char *dir, char *ext)
+{
+	DIR *d;
+	struct dirent *e;
+	char *names[1024];
+	int i, n, l;
+
+	if ((d = opendir(dir)) == NULL)
+		return;
+	for (n = 0; n < 1024 && (e = readdir(d)) != NULL; ) {
+		l = strlen(e->d_name) - strlen(ext);
+		if (l > 0 && strcmp(e->d_name + l, ext) == 0)
+			names[n++] = strdup(e->d_name);
+	}
+	closedir(d);
+	qsort(names, n, sizeof(char *), cmpname);
+	for (i = 0; i < n; i++) {
+		append(f, path(dir, names[i]), 0);
+		free(names[i]);
+	}
+}
+
+
+/* Z80 code: short routines of the common instructions, calling each */
+/* other, with '$' terminated messages in between as CP/M programs have */
+void z80code(FILE *f, long size)
+{
+	static unsigned char ops1[] = {		/* no operand */
+		0x7e, 0x77, 0x23, 0x2b, 0x13, 0x1b, 0x78, 0x79, 0x7a, 0x7b,
+		0x47, 0x4f, 0x57, 0x5f, 0xb7, 0xaf, 0xeb, 0x19, 0x09, 0xc5,
+		0xd5, 0xe5, 0xf5, 0xc1, 0xd1, 0xe1, 0xf1, 0x3c, 0x3d, 0x05
+	};
+	static unsigned char ops2[] = {		/* byte operand */
+		0x3e, 0x06, 0x0e, 0x16, 0x1e, 0xfe, 0xe6, 0xc6, 0xd6, 0x36
+	};
+	static unsigned char ops3[] = {		/* word operand */
+		0x21, 0x11, 0x01, 0x3a, 0x32, 0x2a, 0x22, 0xcd, 0xc3, 0xca
+	};
+	static char *msgs[] = {
+		"Can't open file$", "Disk full$", "Directory full$",
+		"Type Y to continue: $", "Done.$", "Bad checksum$",
+		"Usage: PROG file$", "Read error$", "Write error$"
+	};
+	unsigned short subs[64];
+	long pos;
+	int i, n;
+
+	for (i = 0; i < 64; i++)
+		subs[i] = 0x0100 + rnd(0x3f00);
+	for (pos = 0; pos < size; ) {
+		if (rnd(16) == 0) {
+			fputs(msgs[n = rnd(sizeof(msgs) / sizeof(msgs[0]))], f);
+			pos += strlen(msgs[n]);
+			continue;
+		}
+		for (n = 8 + rnd(40); n-- > 0 && pos < size; )
+			switch (rnd(10)) {
+			case 0: case 1: case 2: case 3: case 4:
+				putc(ops1[rnd(sizeof(ops1))], f);
+				pos += 1;
+				break;
+			case 5: case 6:
+				putc(ops2[rnd(sizeof(ops2))], f);
+				putc(rnd(4) ? rnd(16) : rnd(256), f);
+				pos += 2;
+				break;
+			case 7:
+				putc(rnd(2) ? 0x20 : 0x28, f);	/* jr nz/z */
+				putc(256 - 2 - rnd(20), f);
+				pos += 2;
+				break;
+			default:
+				putc(ops3[rnd(sizeof(ops3))], f);
+				i = subs[rnd(64)];
+				putc(i & 0xff, f);
+				putc(i >> 8, f);
+				pos += 3;
+			}
+		putc(0xc9, f);	/* ret */
+		pos++;
+	}
+}
+
+
+/* close a corpus file, padding it to the CP/M record size */
+void endfile(FILE *f, char *name)
+{
+	long n;
+
+	for (n = ftell(f); n % SECTOR != 0; n++)
+		putc(CTRLZ, f);
+	if (fclose(f) != 0)
+		fatal("can't write ", name);
+	if (n == 0) {
+		remove(name);
+		fprintf(stderr, "cbench: %s left out, nothing found for it\n", name);
+		return;
+	}
+	corpus[ncorpus++] = strdup(strrchr(name, '/') + 1);
+}
+
+
+void mkcorpus(void)
+{
+	static char *docs[] = {
+		"sq-tutorial.txt", "grep.txt", "formatmw.doc", "nroman.nro",
+		"CPM/diskdoc.txt"
+	};
+	FILE *f;
+	char name[PATH_MAX];
+	int i;
+
+	strcpy(name, path(indir, "TEXT.TXT"));
+	if ((f = fopen(name, "wb")) == NULL)
+		fatal("can't create ", name);
+	for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++)
+		append(f, docs[i], 1);
+	endfile(f, name);
+
+	strcpy(name, path(indir, "Z80.COM"));
+	if ((f = fopen(name, "wb")) == NULL)
+		fatal("can't create ", name);
+	z80code(f, 48L * 1024);
+	endfile(f, name);
+
+	strcpy(name, path(indir, "SCR.SCR"));
+	if ((f = fopen(name, "wb")) == NULL)
+		fatal("can't create ", name);
+	appenddir(f, "../graphics/scr", ".scr");
+	endfile(f, name);
+
+	strcpy(name, path(indir, "SRC.C"));
+	if ((f = fopen(name, "wb")) == NULL)
+		fatal("can't create ", name);
+	appenddir(f, ".", ".c");
+	endfile(f, name);
+}
+
+
+/* the name sq and crunch give: 'mid' as the second letter of the type */
+char *packedname(char *name, char mid)
+{
+	static char buf[32];
+	char *p;
+
+	if (mid == 0) {
+		snprintf(buf, sizeof(buf), "%s.LZH", name);
+		return buf;
+	}
+	strcpy(buf, name);
+	if ((p = strrchr(buf, '.')) == NULL)
+		strcat(buf, mid == 'Q' ? ".SQ" : ".Z");
+	else if (strlen(p) == 1)
+		strcat(buf, mid == 'Q' ? "SQ" : "Z");
+	else if (strlen(p) == 2) {
+		p[2] = mid;
+		p[3] = '\0';
+	} else
+		p[2] = mid;
+	return buf;
+}
+
+
+/* store one file in a library of its own, as the only member */
+void mklbr(char *lbr, char *member)
+{
+	unsigned char dir[SECTOR];
+	FILE *f, *in;
+	char *p, *src;
+	long len, nsecs;
+	int c, i;
+
+	src = path(indir, member);
+	if ((len = fsize(src)) < 0 || (in = fopen(src, "rb")) == NULL
+	    || (f = fopen(lbr, "wb")) == NULL)
+		fatal("can't make the library for ", member);
+	nsecs = (len + SECTOR - 1) / SECTOR;
+
+	memset(dir, ' ', sizeof(dir));
+	for (i = 0; i < 4; i++) {
+		dir[i * 32] = i < 2 ? 0x00 : 0xff;
+		memset(dir + i * 32 + 12, 0, 20);
+	}
+	dir[14] = 1;				/* directory: 1 sector */
+	p = strchr(member, '.');
+	memcpy(dir + 33, member, p ? p - member : strlen(member));
+	if (p)
+		memcpy(dir + 41, p + 1, strlen(p + 1));
+	dir[44] = 1;				/* member at sector 1 */
+	dir[46] = nsecs & 0xff;
+	dir[47] = nsecs >> 8;
+	fwrite(dir, 1, SECTOR, f);
+
+	while ((c = getc(in)) != EOF)
+		putc(c, f);
+	for (; len % SECTOR != 0; len++)
+		putc(CTRLZ, f);
+	fclose(in);
+	if (fclose(f) != 0)
+		fatal("can't write ", lbr);
+}
+
+
+/* run a tool in dir, quietly; its wall time and peak memory (KB) */
+void run(char *dir, char *prog, char *a1, char *a2, char *a3,
+	 double *secs, long *maxkb)
+{
+	struct timeval t0, t1;
+	struct rusage ru;
+	char *argv[5];
+	int status, fd;
+	pid_t pid;
+
+	argv[0] = path(bindir, prog);
+	argv[1] = a1;
+	argv[2] = a2;
+	argv[3] = a3;
+	argv[4] = NULL;
+
+	gettimeofday(&t0, NULL);
+	if ((pid = fork()) < 0)
+		fatal("can't fork", "");
+	if (pid == 0) {
+		if (chdir(dir) != 0)
+			_exit(127);
+		if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+			dup2(fd, 0);
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &ru) < 0)
+		fatal("lost the child running ", prog);
+	gettimeofday(&t1, NULL);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+		fatal("can't run ", argv[0]);
+	*secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+#ifdef __APPLE__
+	*maxkb = ru.ru_maxrss / 1024;		/* bytes there */
+#else
+	*maxkb = ru.ru_maxrss;
+#endif
+}
+
+
+/* same contents? */
+int same(char *a, char *b)
+{
+	FILE *fa, *fb;
+	int c, ok;
+
+	if ((fa = fopen(a, "rb")) == NULL)
+		return 0;
+	if ((fb = fopen(b, "rb")) == NULL) {
+		fclose(fa);
+		return 0;
+	}
+	while ((c = getc(fa)) == getc(fb) && c != EOF)
+		;
+	ok = c == EOF;
+	fclose(fa);
+	fclose(fb);
+	return ok;
+}
+
+
+double mbs(long bytes, double secs)
+{
+	return secs > 0 ? bytes / secs / 1e6 : 0;
+}
+
+
+void bench(char *name, struct codec *c)
+{
+	char packed[32], src[PATH_MAX], plain[PATH_MAX], lower[PATH_MAX];
+	char *p;
+	double t, enct, dect;
+	long kb, enckb, deckb, size, psize;
+	int i, ok;
+
+	strcpy(packed, packedname(name, c->mid));
+	strcpy(src, path(indir, name));
+	strcpy(plain, path(outdir, name));
+	size = fsize(src);
+	/* uncr writes lower case names */
+	strcpy(lower, plain);
+	for (p = lower + strlen(outdir); *p; p++)
+		*p = tolower(*p);
+
+	enct = dect = 1e30;
+	enckb = deckb = 0;
+	for (i = 0; i < repeats; i++) {
+		remove(path(indir, packed));
+		if (c->mid)
+			run(indir, c->enc, name, NULL, NULL, &t, &kb);
+		else
+			run(indir, c->enc, name, packed, NULL, &t, &kb);
+		if (t < enct)
+			enct = t;
+		if (kb > enckb)
+			enckb = kb;
+	}
+	if ((psize = fsize(path(indir, packed))) < 0) {
+		fprintf(stderr, "cbench: %s made no %s\n", c->enc, packed);
+		return;
+	}
+	if (c->lbr) {
+		strcpy(plain, path(indir, "BENCH.LBR"));
+		mklbr(plain, packed);
+		strcpy(plain, path(outdir, name));
+	}
+
+	ok = 1;
+	for (i = 0; i < repeats && ok; i++) {
+		remove(plain);
+		remove(lower);
+		if (c->lbr)
+			run(outdir, c->dec, "e", "../in/BENCH.LBR", NULL, &t, &kb);
+		else if (c->mid)
+			run(outdir, c->dec, path("../in", packed), NULL, NULL, &t, &kb);
+		else
+			run(outdir, c->dec, path("../in", packed), name, NULL, &t, &kb);
+		if (t < dect)
+			dect = t;
+		if (kb > deckb)
+			deckb = kb;
+		ok = same(src, fsize(plain) >= 0 ? plain : lower);
+	}
+
+	if (machine)
+		printf("%s\t%s\t%ld\t%ld\t%.4f\t%.3f\t%.3f\t%ld\t%ld\t%s\n",
+			name, c->name, size, psize, (double) psize / size,
+			mbs(size, enct), mbs(size, dect), enckb, deckb,
+			ok ? "ok" : "FAIL");
+	else
+		printf("%-9s %-8s %8ld %8ld %6.1f%% %8.2f %8.2f %7ld %7ld %s\n",
+			name, c->name, size, psize, 100.0 * psize / size,
+			mbs(size, enct), mbs(size, dect), enckb, deckb,
+			ok ? "" : "FAIL");
+	fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+	char *bin = ".", *work = "cbench.d", name[16];
+	FILE *f;
+	int i, j;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+		switch (argv[i][1]) {
+		case 'm':
+			machine = 1;
+			break;
+		case 'b':
+		case 'r':
+		case 'w':
+			if (i + 1 == argc)
+				fatal("missing value for ", argv[i]);
+			if (argv[i][1] == 'b')
+				bin = argv[++i];
+			else if (argv[i][1] == 'w')
+				work = argv[++i];
+			else if ((repeats = atoi(argv[++i])) < 1)
+				repeats = 1;
+			break;
+		default:
+			fatal("Usage: cbench [-m] [-b dir] [-r n] [-w dir] [file ...]", "");
+		}
+
+	/* children change directory, so the paths must be absolute */
+	if (realpath(bin, bindir) == NULL)
+		fatal("no such directory: ", bin);
+	mkdir(work, 0777);
+	if (realpath(work, workdir) == NULL)
+		fatal("can't create ", work);
+	strcpy(indir, path(workdir, "in"));
+	strcpy(outdir, path(workdir, "out"));
+	mkdir(indir, 0777);
+	mkdir(outdir, 0777);
+
+	if (i == argc)
+		mkcorpus();
+	for (j = 1; i < argc && ncorpus < MAXCORPUS; i++, j++) {
+		sprintf(name, "F%d.DAT", j);
+		if ((f = fopen(path(indir, name), "wb")) == NULL)
+			fatal("can't create ", name);
+		if (!append(f, argv[i], 0))
+			fatal("can't read ", argv[i]);
+		fclose(f);
+		if (fsize(path(indir, name)) == 0)
+			fprintf(stderr, "cbench: %s is empty, left out\n", argv[i]);
+		else
+			corpus[ncorpus++] = strdup(name);
+	}
+
+	if (machine)
+		printf("file\tcodec\tsize\tpacked\tratio\tpack_mbs\tunpack_mbs\tpack_kb\tunpack_kb\tcheck\n");
+	else {
+		printf("File      Codec        Size   Packed  Ratio  Pack MB/s Unp MB/s Pack KB  Unp KB\n");
+		printf("------------------------------------------------------------------------------\n");
+	}
+	for (i = 0; i < ncorpus; i++)
+		for (j = 0; j < NCODECS; j++)
+			bench(corpus[i], &codecs[j]);
+	return 0;
+}
@@ -1,31 +1,277 @@
 #include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
 
 /*
  *	CHK.C	32 bit checksum generator.  Generates
  *	and prints checksums for all files specified
  *	on the command line.
  *
- *	Usage: CHK [files]
+ *	Usage: CHK [-c] [files]
+ *
+ *	-c	print the CRC-32 of each file (as zip, PNG and
+ *		most manifests have it) rather than the sum of
+ *		its bytes
  *
  *	Compile with PACC -R or "_getargs() wildcard expansion"
  *	if you want it to handle wildcards, e.g. CHK *.EXE
+ *
+ *	zcc +cpm -create-app -O3 chk.c
+ *	gcc -O2 -pthread -o chk chk.c
+ *
+ *	Hosted builds map each file into memory, sum it a word
+ *	at a time, and work on several files at once, one per
+ *	thread; the results still come out in argument order.
+ *	-DNOTHREADS checks one file after the other.
  */
 
-unsigned long	chk;		/* checksum accumulator */
-unsigned char	c;		/* character read from file */
-FILE *		infile;		/* input file handle */
+#if !defined(Z80) && !defined(_WIN32)
+#define	MMAP
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/mman.h>
+#ifndef NOTHREADS
+#define	PARALLEL
+#include	<pthread.h>
+#define	MAXWORKERS	16
+#endif
+#endif
+
+#ifdef Z80
+#define	BUFSIZE		512
+#define	CRC_SLICES	1
+#else
+#define	BUFSIZE		65536
+#define	CRC_SLICES	8
+#endif
+
+int		crcflag;	/* -c: CRC-32 rather than the sum */
+unsigned long	crctab[CRC_SLICES][256];
+
+struct result {
+	unsigned long	chk;	/* checksum or CRC */
+	char		ok;	/* file could be read */
+	char		done;
+};
+
+
+/* CRC-32 tables, reflected 0xEDB88320; crctab[k] carries */
+/* a byte k places further on, for 8 bytes per step */
+void crcinit()
+{
+	unsigned long c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ 0xEDB88320L : c >> 1;
+		crctab[0][i] = c;
+	}
+	for (k = 1; k < CRC_SLICES; k++)
+		for (i = 0; i < 256; i++)
+			crctab[k][i] = (crctab[k - 1][i] >> 8)
+				^ crctab[0][crctab[k - 1][i] & 0xff];
+}
+
+
+unsigned long crcblock(unsigned long crc, unsigned char *p, unsigned long n)
+{
+#if CRC_SLICES == 8
+	unsigned long hi;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		crc ^= p[0] | (unsigned long) p[1] << 8
+			| (unsigned long) p[2] << 16 | (unsigned long) p[3] << 24;
+		hi = p[4] | (unsigned long) p[5] << 8
+			| (unsigned long) p[6] << 16 | (unsigned long) p[7] << 24;
+		crc = crctab[7][crc & 0xff] ^ crctab[6][(crc >> 8) & 0xff]
+			^ crctab[5][(crc >> 16) & 0xff] ^ crctab[4][crc >> 24]
+			^ crctab[3][hi & 0xff] ^ crctab[2][(hi >> 8) & 0xff]
+			^ crctab[1][(hi >> 16) & 0xff] ^ crctab[0][hi >> 24];
+	}
+#endif
+	while (n--)
+		crc = (crc >> 8) ^ crctab[0][(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+
+unsigned long sumblock(unsigned long chk, unsigned char *p, unsigned long n)
+{
+#ifndef Z80
+	/* eight bytes per step, in four 16 bit lanes of a 64 bit word; */
+	/* a lane takes at most 2*255 a step, so 128 steps fit */
+	const unsigned long long m = 0x00ff00ff00ff00ffULL;
+	unsigned long long w, acc;
+	int k;
+
+	while (n >= 8) {
+		acc = 0;
+		for (k = 0; k < 128 && n >= 8; k++, n -= 8, p += 8) {
+			memcpy(&w, p, 8);
+			acc += (w & m) + ((w >> 8) & m);
+		}
+		chk += (acc & 0xffff) + ((acc >> 16) & 0xffff)
+			+ ((acc >> 32) & 0xffff) + (acc >> 48);
+	}
+#endif
+	while (n--)
+		chk += *p++;
+	return chk;
+}
+
+
+void check(char *name, struct result *r)
+{
+#ifndef PARALLEL
+	static unsigned char sbuf[BUFSIZE];
+#endif
+	unsigned char *buf;
+	unsigned long chk;
+	size_t n;
+	FILE *infile;
+#ifdef MMAP
+	struct stat st;
+	void *map;
+	int fd;
+#endif
+
+	r->ok = 0;
+	chk = crcflag ? 0xffffffffL : 0;
+#ifdef MMAP
+	if ((fd = open(name, O_RDONLY)) < 0)
+		return;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+	    && (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+	       != MAP_FAILED) {
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		chk = crcflag ? crcblock(chk, map, st.st_size)
+			: sumblock(chk, map, st.st_size);
+		munmap(map, st.st_size);
+		close(fd);
+		r->chk = crcflag ? chk ^ 0xffffffffL : chk;
+		r->ok = 1;
+		return;
+	}
+	close(fd);
+#endif
+	if ((infile = fopen(name, "rb")) == NULL)
+		return;
+#ifdef PARALLEL
+	/* not the shared buffer: other threads may be here too */
+	if ((buf = malloc(BUFSIZE)) == NULL) {
+		fclose(infile);
+		return;
+	}
+#else
+	buf = sbuf;
+#endif
+	while ((n = fread(buf, 1, BUFSIZE, infile)) != 0)
+		chk = crcflag ? crcblock(chk, buf, n) : sumblock(chk, buf, n);
+	fclose(infile);
+#ifdef PARALLEL
+	free(buf);
+#endif
+	r->chk = crcflag ? chk ^ 0xffffffffL : chk;
+	r->ok = 1;
+}
+
+
+void report(char *name, struct result *r)
+{
+	if (r->ok)
+		printf("%s: %8.8lX\n", name, r->chk);
+	else
+		fprintf(stderr, "Cannot open %s\n", name);
+}
+
+
+#ifdef PARALLEL
+/* the workers take the files in argument order, main() prints */
+/* each result as soon as it and all before it are ready */
+char **		files;
+int		nfiles, nextfile;
+struct result *	results;
+pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t	ready = PTHREAD_COND_INITIALIZER;
+
+void *worker(void *arg)
+{
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		i = nextfile++;
+		pthread_mutex_unlock(&lock);
+		if (i >= nfiles)
+			return NULL;
+		check(files[i], &results[i]);
+		pthread_mutex_lock(&lock);
+		results[i].done = 1;
+		pthread_cond_signal(&ready);
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+/* false if no thread could be started */
+int pcheck(int argc, char **argv)
+{
+	pthread_t tid[MAXWORKERS];
+	long ncpu;
+	int i, nw;
+
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) > MAXWORKERS)
+		ncpu = MAXWORKERS;
+	if (ncpu > argc)
+		ncpu = argc;
+	if (ncpu < 2 || (results = calloc(argc, sizeof(struct result))) == NULL)
+		return 0;
+	files = argv;
+	nfiles = argc;
+	for (nw = 0; nw < ncpu; nw++)
+		if (pthread_create(&tid[nw], NULL, worker, NULL) != 0)
+			break;
+	if (nw == 0) {
+		free(results);
+		return 0;
+	}
+	for (i = 0; i < argc; i++) {
+		pthread_mutex_lock(&lock);
+		while (!results[i].done)
+			pthread_cond_wait(&ready, &lock);
+		pthread_mutex_unlock(&lock);
+		report(argv[i], &results[i]);
+	}
+	while (nw-- > 0)
+		pthread_join(tid[nw], NULL);
+	free(results);
+	return 1;
+}
+#endif
+
 
 main(int argc, char ** argv)
 {
+	struct result r;
+
+	if (argc > 1 && (strcmp(argv[1], "-c") == 0
+	    || strcmp(argv[1], "-C") == 0)) {
+		crcflag = 1;
+		crcinit();
+		--argc;
+		++argv;
+	}
+#ifdef PARALLEL
+	if (pcheck(argc - 1, argv + 1))
+		return 0;
+#endif
 	while(--argc) {		/* while there are more arguments */
 		++argv;		/* point at next file argument */
-		if (infile = fopen(argv[0], "rb")) {
-			chk = 0;
-			while (fread(&c, sizeof(c), 1, infile))
-				chk += c;
-			fclose(infile);
-			printf("%s: %8.8lX\n", argv[0], chk);
-		} else
-			fprintf(stderr, "Cannot open %s\n", argv[0]);
+		check(argv[0], &r);
+		report(argv[0], &r);
 	}
+	return 0;
 }
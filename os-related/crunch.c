@@ -0,0 +1,647 @@
+
+/* zcc +cpm -create-app -O3 --opt-code-size -ocrunch crunch.c */
+/* gcc -o crunch crunch.c */
+
+
+/*----------------------------------------------------------------------------*/
+/*  CRUNCH/C - LZW cruncher writing the Z-80 CP/M CRUNCH 2.x format           */
+/*		read back by uncrunch.c and by lar.c -DUNCRUNCH		      */
+/*----------------------------------------------------------------------------*/
+/*  The code stream is generated so that the decoder, run step by step,      */
+/*  ends up with exactly the tables the encoder works from:                  */
+/*    - codes grow from 9 to 12 bits one entry early, as in enterx(),       */
+/*    - a new entry is made for the previous code once the next code is     */
+/*      known, so the "WsWsW" exception is never produced,                  */
+/*    - once the table is full, entries are reassigned through entfil(),    */
+/*      which needs xlatbl kept exactly as CRUNCH 2.3 / uncrunch keep it,   */
+/*    - as in CRUNCH 2.x, the ratio of the first RSTGAP bytes after the     */
+/*      table has filled up is kept; after that the ratio of each RSTGAP     */
+/*      bytes is checked and a reset code is sent when it is worse than      */
+/*      the kept one by more than 1/RSTSLACK, or better by as much: the      */
+/*      table was then filled from data unlike what now follows.             */
+/*  Lookups for the encoder itself go through a separate hashed trie, as    */
+/*  entfil() moves codes to new strings without updating xlatbl.           */
+/*----------------------------------------------------------------------------*/
+/*  Usage : crunch [-r] file ...                                            */
+/*	-r	do not use adaptive reset					      */
+/*  The output name has 'Z' as the middle letter of the type (FOO.TXT ->    */
+/*  FOO.TZT), or 'Z' appended to a short type (FOO.C -> FOO.CZ, FOO -> FOO.Z) */
+/*                                                                            */
+/*  Round trip check (not in the CP/M build), from a scratch directory:     */
+/*	gcc -DUNCRUNCH -o uncr uncrunch.c unpack.c			      */
+/*	crunch -t [uncr]						      */
+/*  crunches an empty file, text, random bytes and text with random bytes  */
+/*  in the middle, unpacks each with uncr (default ./uncr) and compares    */
+/*  the bytes.  The exit status is the number of failures.                 */
+/*----------------------------------------------------------------------------*/
+
+#define VERSION "1.0"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define TABLE_SIZE  4096	/*size of main lzw table for 12 bit codes*/
+#define XLATBL_SIZE 5003	/*size of physical translation table*/
+#define HASH_SIZE   4096	/*buckets of the encoder's trie*/
+
+/*special values for predecessor in table*/
+#define NOPRED 0x6fff		/*no predecessor in table*/
+#define EMPTY  0x8000		/*empty table entry (xlatbl only)*/
+#define REFERENCED 0x2000	/*table entry referenced if this bit set*/
+#define IMPRED 0x7fff		/*impossible predecessor*/
+
+#define EOFCOD 0x100		/*special code for end-of-file*/
+#define RSTCOD 0x101		/*special code for adaptive reset*/
+#define NULCOD 0x102		/*special filler code*/
+#define SPRCOD 0x103		/*spare special code*/
+
+#define REPEAT_CHARACTER 0x90	/*following byte is repeat count*/
+
+#define REFLEVEL 0x20		/*written as reference revision level*/
+#define SIGLEVEL 0x20		/*significant revision level, uncrunch wants 2.x*/
+
+#define RSTGAP   4096		/*input bytes between ratio checks*/
+#define RSTSLACK 4		/*reset when ratio changes by more than 1/4*/
+
+#define NOPEEK (-2)
+#define NOCODE (-1)
+
+/*main lzw table, as kept by the decoder*/
+struct entry {
+	short predecessor;	/*index to previous entry, if any*/
+	unsigned char suffix;	/*character suffixed to previous entries*/
+} table[TABLE_SIZE];
+
+/*auxilliary physical translation table*/
+/*translates hash to main table index*/
+short xlatbl[XLATBL_SIZE];
+
+/*encoder's trie: (predecessor,suffix) -> code, chained through hnext*/
+short hhead[HASH_SIZE];
+short hnext[TABLE_SIZE];
+
+/*decoder state, mirrored*/
+unsigned char	codlen;		/*variable code length in bits (9-12)*/
+short	trgmsk;			/*mask for codes of current length*/
+unsigned char	fulflg;		/*full flag - set once main table is full*/
+short	entry;			/*next available main table entry*/
+unsigned char	entflg; 	/*inhibit entering the next code*/
+int	lastpr;			/*last code sent*/
+
+/*encoder state*/
+unsigned long	putbuf;		/*bits waiting to be written*/
+int	putbit;			/*number of bits in putbuf*/
+unsigned short	cksum;		/*checksum of all bytes read*/
+int	peekc;			/*byte read ahead by the repeat stage*/
+unsigned char	rptq[4];	/*output of the repeat stage*/
+int	rptlen, rptpos;
+int	noreset;		/*adaptive reset disabled*/
+unsigned long	insize;		/*bytes read from the input file*/
+unsigned long	outsize;	/*bytes written to the output file*/
+unsigned long	chkin;		/*repeat stage output at the last ratio check*/
+unsigned long	chkbits;	/*code bits at the last ratio check*/
+unsigned long	rptout;		/*bytes from the repeat stage*/
+unsigned long	codbits;	/*code bits sent*/
+unsigned long	fullratio;	/*bits per 256 bytes once the table was full*/
+
+FILE 	*infd;			/*currently open input file*/
+FILE 	*outfd;			/*currently open output file*/
+
+
+
+/*hash pred/suff into xlatbl pointer*/
+/*duplicates the hash algorithm used by CRUNCH 2.3*/
+short *hash(int pred, int suff, int *disploc)
+	{
+	register int hashval;
+
+	hashval=((((pred>>4) & 0xff) ^suff) | ((pred&0xf)<<8)) + 1;
+	*disploc=hashval-XLATBL_SIZE;
+	return (xlatbl + hashval);
+	}
+
+
+/*find an empty entry in xlatbl which hashes from this predecessor/suffix*/
+/*combo, and store the index of the next available lzw table entry in it*/
+void figure(int pred, int suff)
+	{
+	auto int disp;
+	register short *p;
+	p=hash(pred,suff,&disp);
+
+	/*follow secondary hash chain as necessary to find an empty slot*/
+	while(((*p)&0xffff) != EMPTY)
+		{
+		p+=disp;
+		if(p<xlatbl || p > xlatbl+XLATBL_SIZE)
+			p+=XLATBL_SIZE;
+		}
+
+	/*stuff next available index into this slot*/
+	*p=entry;
+	}
+
+
+/*trie bucket of a predecessor/suffix pair*/
+#define trihash(pred,suff) ((((pred)<<4)^((pred)>>8)^(suff))&(HASH_SIZE-1))
+
+/*look up the code for string pred+suff, NOCODE if not in the table*/
+int child(int pred, int suff)
+	{
+	register int code;
+
+	for(code=hhead[trihash(pred,suff)]; code!=NOCODE; code=hnext[code])
+		if(((table[code].predecessor)&0xfff)==pred && table[code].suffix==suff)
+			return code;
+	return NOCODE;
+	}
+
+
+/*add a code to the trie under its current string*/
+void trilink(int code)
+	{
+	register int h;
+
+	h=trihash((table[code].predecessor)&0xfff,table[code].suffix);
+	hnext[code]=hhead[h];
+	hhead[h]=code;
+	}
+
+
+/*take a code out of the trie*/
+void triunlink(int code)
+	{
+	register short *p;
+
+	p=&hhead[trihash((table[code].predecessor)&0xfff,table[code].suffix)];
+	while(*p!=code)
+		p=&hnext[*p];
+	*p=hnext[code];
+	}
+
+
+/*enter the next code into the lzw table*/
+void enterx(int pred, int suff)
+	{
+	register struct entry *ep;
+	ep = &table[entry];
+
+	/*update xlatbl to point to this entry*/
+	figure(pred,suff);
+
+	/*make the new entry*/
+	ep->predecessor = (short)pred;
+	ep->suffix = (unsigned char)suff;
+	if(entry>=0x100 && pred<TABLE_SIZE)
+		trilink(entry);
+	entry++;
+
+	/*if only one entry of the current code length remains, update to*/
+	/*next code length because the decoder is reading one code ahead*/
+	if(entry >= trgmsk)
+		{
+		if(codlen<12)
+			{
+			codlen++;
+			trgmsk=(trgmsk<<1)|1;
+			}
+		else
+			{
+			fulflg++;
+			}
+		}
+	}
+
+
+/*attempt to reassign an existing code which has*/
+/*been defined, but never referenced*/
+void entfil(int pred, int suff)
+	{
+	auto int disp;
+	register struct entry *ep;
+	short *p;
+	p=hash(pred,suff,&disp);
+
+	/*search the candidate codes (all those which hash from this new*/
+	/*predecessor and suffix) for an unreferenced one*/
+	while(*p!=(short)EMPTY){
+
+		/*candidate code*/
+		ep = &table[*p];
+		if(((ep->predecessor)&REFERENCED)==0){
+			/*entry reassignable, so do it!*/
+			triunlink(*p);
+			ep->predecessor=pred;
+			ep->suffix=suff;
+			trilink(*p);
+			break;
+		}
+
+		p+=disp;
+		if(p<xlatbl || p > xlatbl+XLATBL_SIZE)
+			p+=XLATBL_SIZE;
+	}
+}
+
+
+/*initialize the lzw and physical translation tables*/
+void initb2(void)
+	{
+	register int i;
+
+	/*first mark all entries of xlatbl and the trie as empty*/
+	for(i=0;i<XLATBL_SIZE;i++) xlatbl[i]=EMPTY;
+	for(i=0;i<HASH_SIZE;i++) hhead[i]=NOCODE;
+
+	trgmsk=0x1ff;	/*nine bits*/
+	codlen=9;	/*    "    */
+	fulflg=0;	/*table empty*/
+	entry=0;	/*    "      */
+	entflg=1;	/*first code always atomic*/
+	lastpr=NOPRED;
+
+	/*enter atomic and reserved codes into lzw table*/
+	for(i=0;i<0x100;i++) enterx(NOPRED,i);	/*first 256 atomic codes*/
+	for(i=0;i<4;i++) enterx(IMPRED,0);	/*reserved codes*/
+	}
+
+
+/*write a code of length "codlen" bits to the output file bit-stream*/
+void putcode(int code)
+	{
+	putbuf=(putbuf<<codlen)|code;
+	putbit+=codlen;
+	codbits+=codlen;
+	while(putbit>=8)
+		{
+		putbit-=8;
+		putc((int)(putbuf>>putbit)&0xff,outfd);
+		outsize++;
+		}
+	}
+
+
+/*send a code and update the tables the way the decoder will*/
+/*(first is the first byte of the string for this code)*/
+void sendcode(int code, int first)
+	{
+	putcode(code);
+	table[code].predecessor |= REFERENCED;
+
+	if(fulflg!=2)
+		{
+		if(entflg==0) enterx(lastpr,first);
+		else entflg=0;
+		}
+	else
+		entfil(lastpr,first);
+	lastpr=code;
+	}
+
+
+/*read a byte from the input file, checksumming it*/
+int readc(void)
+	{
+	register int c;
+
+	if(peekc!=NOPEEK)
+		{
+		c=peekc;
+		peekc=NOPEEK;
+		return c;
+		}
+	if((c=getc(infd))!=EOF)
+		{
+		cksum+=c;
+		insize++;
+		}
+	return c;
+	}
+
+
+/*return the next byte of input with runs folded into*/
+/*REPEAT_CHARACTER sequences, undone by send() in uncrunch*/
+int getrpt(void)
+	{
+	register int c, d, n;
+
+	if(rptpos<rptlen)
+		return rptq[rptpos++];
+	rptpos=rptlen=0;
+	if((c=readc())==EOF)
+		return EOF;
+
+	if(c==REPEAT_CHARACTER)
+		{
+		/*the repeat byte itself goes out as 0x90 0x00*/
+		rptq[rptlen++]=REPEAT_CHARACTER;
+		rptq[rptlen++]=0;
+		}
+	else
+		{
+		for(n=1; n<255; n++)
+			if((d=readc())!=c)
+				{
+				peekc=d;
+				break;
+				}
+		rptq[rptlen++]=c;
+		if(n==2)
+			rptq[rptlen++]=c;
+		else if(n>2)
+			{
+			/*0x90 n repeats the last byte n-1 more times*/
+			rptq[rptlen++]=REPEAT_CHARACTER;
+			rptq[rptlen++]=n;
+			}
+		}
+	rptout+=rptlen;
+	return rptq[rptpos++];
+	}
+
+
+/*check whether the input has changed enough to start afresh:*/
+/*the ratio of the last RSTGAP bytes is compared to the one kept*/
+/*when the table filled up, a table full of incompressible data*/
+/*is as much in the way of text that follows as the other way round*/
+int wantreset(void)
+	{
+	unsigned long ratio;
+
+	if(noreset)
+		return 0;
+	if(fulflg!=2)
+		{
+		/*windows start once the table is full*/
+		chkin=rptout;
+		chkbits=codbits;
+		return 0;
+		}
+	if(rptout-chkin<RSTGAP)
+		return 0;
+	ratio=((codbits-chkbits)<<8)/(rptout-chkin);
+	chkin=rptout;
+	chkbits=codbits;
+	if(fullratio==~0UL)
+		{
+		fullratio=ratio;
+		return 0;
+		}
+	return ratio>fullratio+fullratio/RSTSLACK
+	    || ratio<fullratio-fullratio/RSTSLACK;
+	}
+
+
+/*crunch one file*/
+void crunch(char *filename)
+	{
+	char outfn[80];
+	char *p, *name;
+	int c, code, next, first;
+
+	if((infd=fopen(filename,"rb"))==NULL)
+		{
+		printf("***** can't open %s\n",filename);
+		return;
+		}
+
+	/*build the output name: middle letter of the type becomes 'Z'*/
+	strncpy(outfn,filename,sizeof(outfn)-4);
+	outfn[sizeof(outfn)-4]='\0';
+	name=outfn;
+	for(p=outfn; *p; p++)
+		if(*p=='/' || *p=='\\' || *p==':') name=p+1;
+	p=outfn+strlen(outfn);
+	c=(p>outfn && islower(p[-1]))?'z':'Z';
+	if((p=strrchr(name,'.'))==NULL)
+		strcat(outfn,c=='z'?".z":".Z");
+	else if(strlen(p)<3)
+		strcat(outfn,c=='z'?"z":"Z");
+	else
+		p[2]=isupper(p[1])?'Z':'z';
+	printf("%s --> %s",filename,outfn);
+
+	if((outfd=fopen(outfn,"wb"))==NULL)
+		{
+		printf("\n***** can't create %s\n",outfn);
+		fclose(infd);
+		return;
+		}
+
+	/*header: magic, original name (always with a dot), info bytes*/
+	putc(0x76,outfd);
+	putc(0xfe,outfd);
+	for(p=filename; *p; p++)
+		if(*p=='/' || *p=='\\' || *p==':') filename=p+1;
+	for(p=filename; *p; p++)
+		putc(toupper(*p),outfd);
+	if(strchr(filename,'.')==NULL)
+		putc('.',outfd);
+	putc('\0',outfd);
+	putc(REFLEVEL,outfd);
+	putc(SIGLEVEL,outfd);
+	putc(0,outfd);		/*error detection: checksum follows*/
+	putc(0,outfd);		/*spare*/
+
+	/*initialize variables for crunching a file*/
+	putbuf=0;
+	putbit=0;
+	cksum=0;
+	peekc=NOPEEK;
+	rptlen=rptpos=0;
+	insize=outsize=0;
+	rptout=codbits=chkin=chkbits=0;
+	fullratio=~0UL;
+	initb2();
+
+	/*main encoding loop: extend the string while the table knows it*/
+	if((code=getrpt())!=EOF)
+		{
+		first=code;
+		while((c=getrpt())!=EOF)
+			{
+			if((next=child(code,c))!=NOCODE)
+				{
+				code=next;
+				continue;
+				}
+			sendcode(code,first);
+			if(wantreset())
+				{
+				putcode(RSTCOD);
+				initb2();
+				fullratio=~0UL;
+				}
+			code=first=c;
+			}
+		sendcode(code,first);
+		}
+	putcode(EOFCOD);
+
+	/*pad out the last byte, then the checksum*/
+	if(putbit)
+		{
+		putc((int)(putbuf<<(8-putbit))&0xff,outfd);
+		outsize++;
+		}
+	putc(cksum&0xff,outfd);
+	putc(cksum>>8,outfd);
+
+	if(ferror(outfd))
+		printf("\n***** error writing %s",outfn);
+	else if(insize)
+		printf(" (%ld%%)",100L-(long)(outsize*100L/insize));
+	printf("\n");
+
+	fclose(infd);
+	fclose(outfd);
+	}
+
+
+#ifndef Z80
+/*made-up input for crunch_test(): 0 empty, 1 text, 2 random bytes,*/
+/*3 text with random bytes in the middle; returns the length*/
+long testdata(int what, unsigned char *buf)
+	{
+	static char *words[] = {
+		"int","char","the","return","if","for","while","(c)","=",
+		"0;","buffer","table","entry","code","{","}","/*","*/",
+		"printf(\"%s\\n\",","name);","struct","unsigned","long",
+		"else","break;","NULL","->","++","file","of","a","to" };
+	register char *w;
+	long n, len, run;
+	int col;
+
+	len=what==0 ? 0 : what==2 ? 100000L : 600000L;
+	srand(what);
+	for(n=col=0; n<len; )
+		{
+		if(what==2 || (what==3 && n>=200000L && n<300000L))
+			{
+			buf[n++]=rand()>>4;
+			continue;
+			}
+		if(col==0)
+			{
+			/*indent, now and then with a run longer than 255*/
+			for(run=rand()%50 ? rand()%4 : 300; run>0 && n<len; run--)
+				buf[n++]='\t';
+			}
+		else
+			buf[n++]=' ';
+		for(w=words[rand()%(sizeof(words)/sizeof(words[0]))]; *w && n<len; col++)
+			buf[n++]=*w++;
+		if(++col>60 && n<len)
+			{
+			buf[n++]='\n';
+			col=0;
+			}
+		}
+	return len;
+	}
+
+
+/*round trip check: crunch made-up files, unpack them with uncr*/
+/*and compare the bytes; returns the number of failures*/
+int crunch_test(char *uncr)
+	{
+	static char *what[] = {"empty","text","random","mixed"};
+	char name[16], cmd[256];
+	unsigned char *buf;
+	long len, n;
+	int t, c, bad;
+	FILE *fd;
+
+	if((buf=malloc(600000L))==NULL)
+		{
+		printf("***** out of memory\n");
+		return 1;
+		}
+	bad=0;
+	for(t=0; t<4; t++)
+		{
+		/*crunch and drop the original, uncr puts it back*/
+		sprintf(name,"crtest%d.dat",t);
+		len=testdata(t,buf);
+		if((fd=fopen(name,"wb"))==NULL)
+			{
+			printf("***** can't create %s\n",name);
+			return bad+1;
+			}
+		fwrite(buf,1,len,fd);
+		fclose(fd);
+		crunch(name);
+		remove(name);
+		name[9]='z';
+		sprintf(cmd,"%s %s >/dev/null",uncr,name);
+		c=system(cmd);
+		remove(name);
+		name[9]='a';
+
+		n=0;
+		if(c==0 && (fd=fopen(name,"rb"))!=NULL)
+			{
+			while(n<len && (c=getc(fd))!=EOF && c==buf[n])
+				n++;
+			if(n==len && getc(fd)!=EOF)
+				n=-1;
+			fclose(fd);
+			}
+		else
+			n=-1;
+		remove(name);
+		if(n==len)
+			printf("%-8s %7ld bytes: ok\n",what[t],len);
+		else
+			{
+			printf("%-8s %7ld bytes: FAILED",what[t],len);
+			if(n>=0)
+				printf(" at byte %ld",n);
+			printf("\n");
+			bad++;
+			}
+		}
+	free(buf);
+	printf(bad ? "%d test(s) FAILED\n" : "uncr gives back every file\n",bad);
+	return bad;
+	}
+#endif
+
+
+int main(int argc, char *argv[])
+	{
+#ifndef Z80
+	if(argc>1 && strcmp(argv[1],"-t")==0)
+		exit(crunch_test(argc>2 ? argv[2] : "./uncr"));
+#endif
+
+	/*usage check*/
+	if(argc>1 && strcmp(argv[1],"-r")==0)
+		{
+		noreset=1;
+		argc--;
+		argv++;
+		}
+	if(argc-- < 2)
+		{
+		printf("Usage : crunch [-r] <file_name> ...\n");
+		printf("        -r  no adaptive reset\n");
+#ifndef Z80
+		printf("        crunch -t [uncr]  round trip check\n");
+#endif
+		exit(0);
+		}
+
+	/*who am i*/
+	printf("CRUNCH/C Version %s\n\n",VERSION);
+
+	/*do all the files specified*/
+	while(argc--) crunch(*++argv);
+
+	exit(0);
+	}
+
+
+/*end of source file*/
@@ -75,6 +75,12 @@ FILE *fd_crypt;
 #define NUL	'\0'
 
 #define SECSIZ 128
+#if defined(Z80) || defined(BDSC_COMPAT)
+#define BLKSIZ	(8*SECSIZ)
+#else
+#define BLKSIZ	65536	/* hosted: big blocks, XORed a word at a time */
+#define WIDE
+#endif
 #define FALSE 0
 #define TRUE 1
 #define	ERROR -1
@@ -321,6 +327,58 @@ for (i=0; i< length/2; i++)
 #endif
 
 
+#ifdef WIDE
+/*************************************************************
+	the key stream for a block is made first, in a buffer of
+its own, then the block is XORed with it a word at a time (a
+loop simple enough for the compiler to put in vector registers).
+The stream is the same rand() sequence as the byte loop gives.
+*************************************************************/
+union block {
+	char c[BLKSIZ];
+	unsigned long w[BLKSIZ / sizeof(unsigned long)];
+} cryptblk, keyblk;
+
+#ifdef __GLIBC__
+/* glibc's rand() is random(), which takes a lock on every call;
+   random_r() on a state seeded the same way gives the same numbers */
+struct random_data rbuf;
+char rstate[128];
+
+void crypt_seed (unsigned int s)
+{
+memset (&rbuf, 0, sizeof rbuf);
+initstate_r (s, rstate, sizeof rstate, &rbuf);
+}
+#else
+#define crypt_seed(s)	srand(s)
+#endif
+
+void crypt_block (int n)
+{
+int i;
+unsigned long *d, *k;
+#ifdef __GLIBC__
+int32_t r;
+
+for (i=0; i<n; i++) {
+	random_r (&rbuf, &r);
+	keyblk.c[i] = r%0xff;
+	}
+#else
+for (i=0; i<n; i++)
+	keyblk.c[i] = rand()%0xff;
+#endif
+d = cryptblk.w;
+k = keyblk.w;
+for (i=0; i < n/(int)sizeof(unsigned long); i++)
+	d[i] ^= k[i];
+for (i *= sizeof(unsigned long); i<n; i++)
+	cryptblk.c[i] ^= keyblk.c[i];
+}
+#endif
+
+
 /*********************************************************************
  returns index of t in s, ERROR if not found.  Thanx to Kernighan
  and Ritchie, p. 67
@@ -348,7 +406,11 @@ void main(int argc, char **argv)
 char filename[30], filecrypt[30], after[10];
 char key[100], t[100], argument[100];
 char *comarg;
-char cryptbuf [8*SECSIZ];
+#ifdef WIDE
+char *cryptbuf = cryptblk.c;
+#else
+char cryptbuf [BLKSIZ];
+#endif
 int i, l;
 
 debug = FALSE;
@@ -455,15 +517,19 @@ while (--argc)
 
 #ifdef BDSC_COMPAT
 	nrand (-1, seed[0], seed[1], seed[2] );
+#else
+#ifdef WIDE
+	crypt_seed(seed[0]+256*seed[1]+512*seed[2]);
 #else
 	srand(seed[0]+256*seed[1]+512*seed[2]);
+#endif
 #endif
 	
 	if DEBUG printf("\nfd_in=%d, fd_crypt=%d",fd_in,fd_crypt);
 	fine = FALSE;	/* musical end */
 	while (!fine)
 	      { 
-			nread=fread(cryptbuf, 1, 8*SECSIZ, fd_in);
+			nread=fread(cryptbuf, 1, BLKSIZ, fd_in);
 		  /*
 			if (OK > (nread = read (fd_in, cryptbuf, 8)))
 		      { printf("\nread returned %d for <%s>",
@@ -472,11 +538,15 @@ while (--argc)
 			ERROR_EXIT();
 		      }
 			  */
+#ifdef WIDE
+		crypt_block (nread);
+#else
 		for (i=0; i<nread; i++)
 #ifdef BDSC_COMPAT
 			cryptbuf[i] ^= nrand(1,0,0,0);
 #else
 			cryptbuf[i] ^= rand()%0xff;
+#endif
 #endif
 		//if (nread != write (fd_crypt, cryptbuf, nread))
 		if (fwrite(cryptbuf, 1, nread, fd_crypt) < nread)
@@ -484,7 +554,7 @@ while (--argc)
 			if DEBUG printf("\nfd_crypt=%d",fd_crypt);
 			ERROR_EXIT();
 		      }
-		if (nread == 0 || nread != (8*SECSIZ))	fine = TRUE;
+		if (nread == 0 || nread != BLKSIZ)	fine = TRUE;
 	      }
 	if (OK != fclose (fd_in))
 		printf("\nerror closing file <%s>", filename);
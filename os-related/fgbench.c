@@ -0,0 +1,225 @@
+// fgrep.c is compiled in, with unsigned chars as it needs under gcc:
+//  gcc -O2 -funsigned-char -o fgbench fgbench.c
+
+
+/* FGBENCH.C - Time the Construction of the FGREP Automaton
+ *
+ * Builds the FSA of FGREP.C from a list of strings, made up (random
+ * lower case words) or read from a file as by "fgrep -f", and prints
+ * the time taken by each stage, "enter()" of the strings,
+ * "bd_table()" and "bd_move()", and the strings per second for the
+ * whole build, best of a few runs. Each string is then run through
+ * the FSA, which must find it.
+ *
+ * USAGE: fgbench [count [repeats]]	(100000 words, best of 3)
+ *	  fgbench -f <file> [repeats]
+ */
+
+#define FGBENCH		/* FGREP.C without its "main()" */
+char *strupr(char *str);
+#include "fgrep.c"
+#include <time.h>
+
+char **str_list;	/* The strings, in "str_text" */
+char *str_text;
+unsigned long n_str;	/* How many there are */
+
+
+/* STRUPR() - Map string "str" to upper case. The C library may not
+ *	      have it.
+ */
+
+char *strupr(char *str)
+{
+  register char *temp;
+
+  for(temp = str; *temp; temp++)
+    *temp = toupper(*temp);
+  return str;
+}
+
+
+/* USAGE() - Show the command line and exit with status 2 */
+
+void usage()
+{
+  fprintf(stderr,"Usage: fgbench [count [repeats]]\n");
+  fprintf(stderr,"       fgbench -f <file> [repeats]\n");
+  exit(2);
+}
+
+
+/* LAP() - Return the CPU seconds since "*start" and restart it */
+
+double lap(clock_t *start)
+{
+  clock_t now = clock();
+  double secs = (double)(now - *start) / CLOCKS_PER_SEC;
+
+  *start = now;
+  return secs;
+}
+
+
+/* MK_STRINGS() - Make up "n_str" words of 4 to 12 lower case
+ *		  letters.
+ */
+
+void mk_strings()
+{
+  unsigned long i;
+  char *temp;
+  int len;
+
+  str_list = (char **)malloc(n_str * sizeof(char *));
+  str_text = temp = malloc(n_str * 13);
+  if(!str_list || !str_text)
+    error(MEM_ERR,NULL);
+  srand(1);
+  for(i = 0; i < n_str; i++)
+  {
+    str_list[i] = temp;
+    for(len = 4 + rand() % 9; len > 0; len--)
+      *temp++ = 'a' + rand() % 26;
+    *temp++ = '\0';
+  }
+}
+
+
+/* RD_STRINGS() - Read the strings from "file", one per line, as
+ *		  "bd_go()" does.
+ */
+
+void rd_strings(char *file)
+{
+  static char buffer[MAX_LINE];
+  unsigned long size;
+  char *temp,
+       *nl;
+  FILE *str_fd;
+
+  if(!(str_fd = fopen(file,"r")))
+  {
+    fprintf(stderr,"Can't open string file %s\n",file);
+    exit(2);
+  }
+
+  /* Count the lines and their bytes first */
+
+  for(n_str = size = 0; fgets(buffer,MAX_LINE,str_fd); n_str++)
+    size += strlen(buffer) + 1;
+  str_list = (char **)malloc((n_str ? n_str : 1) * sizeof(char *));
+  str_text = temp = malloc(size + 1);
+  if(!str_list || !str_text)
+    error(MEM_ERR,NULL);
+
+  rewind(str_fd);
+  for(n_str = 0; fgets(buffer,MAX_LINE,str_fd); )
+  {
+    if((nl = strchr(buffer,'\n')))
+      *nl = '\0';
+    if(!buffer[0])
+      continue;		/* "enter()" can't take "" */
+    str_list[n_str++] = strcpy(temp,buffer);
+    temp += strlen(temp) + 1;
+  }
+  fclose(str_fd);
+}
+
+
+/* FSA_FREE() - Give back all the memory of the FSA, ready for the
+ *		next build.
+ */
+
+void fsa_free()
+{
+  char *blk;
+
+  while((blk = arena_blk))
+  {
+    arena_blk = *(char **)blk;
+    free(blk);
+  }
+  arena_used = ARENA_BLK;
+  free(fsa_next);
+  free(fsa_out);
+  fsa_next = 0;
+  n_states = 0;
+}
+
+
+/*** Main Body of Program ***/
+
+int main(int argc,char **argv)
+{
+  double secs[4],	/* enter, bd_table, bd_move, total */
+	 best[4];
+  unsigned long i;
+  int rep,
+      repeats,
+      c;
+  clock_t start;
+
+  if(argc > 2 && !strcmp(argv[1],"-f"))
+  {
+    rd_strings(argv[2]);
+    repeats = argc > 3 ? atoi(argv[3]) : 3;
+  }
+  else
+  {
+    n_str = argc > 1 ? atol(argv[1]) : 100000;
+    repeats = argc > 2 ? atoi(argv[2]) : 3;
+    if(n_str)
+      mk_strings();
+  }
+  if(!n_str || repeats < 1)
+    usage();
+
+  for(rep = 0; rep < repeats; rep++)
+  {
+    fsa_free();
+    start = clock();
+
+    /* As "bd_go()", with the strings already in memory */
+
+    for(c = 1; c <= 127; c++)
+      MZ[c] = &FAIL_STATE;
+    for(i = 0; i < n_str; i++)
+      enter(str_list[i]);
+    for(c = 1; c <= 127; c++)
+      if(MZ[c] == &FAIL_STATE)
+	MZ[c] = NULL;
+    secs[0] = lap(&start);
+
+    bd_table();
+    secs[1] = lap(&start);
+
+    bd_move();
+    secs[2] = lap(&start);
+
+    secs[3] = secs[0] + secs[1] + secs[2];
+    for(c = 0; c < 4; c++)
+      if(!rep || secs[c] < best[c])
+	best[c] = secs[c];
+  }
+
+  /* Every string must be found */
+
+  for(i = 0; i < n_str; i++)
+    if(run_fsa(str_list[i]) != TRUE)
+    {
+      fprintf(stderr,"*** FAILED - \"%s\" not found ***\n",str_list[i]);
+      exit(1);
+    }
+
+  printf("%lu strings, %lu states, ",n_str,(unsigned long)n_states);
+  if(fsa_next)
+    printf("%u entry rows (%.1f MB table)\n",fsa_ncls,
+	(double)(n_states + 1) * fsa_ncls * sizeof(STATE) / 1048576.0);
+  else
+    printf("no table\n");
+  printf("enter %7.3f s  bd_table %7.3f s  bd_move %7.3f s  total %7.3f s"
+      "  %9.0f strings/s\n",best[0],best[1],best[2],best[3],
+      best[3] > 0 ? n_str / best[3] : 0.0);
+  return 0;
+}
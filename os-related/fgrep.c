@@ -5,6 +5,11 @@
 // With optimizations:
 //  zcc +cpm -create-app -DAMALLOC -compiler=sdcc -SO3 --max-allocs-per-node400000 -pragma-define:CRT_INITIALIZE_BSS=0 FGREP.c
 
+// gcc needs -funsigned-char: with a signed char the "char litchar
+// <= 127" loops of "bd_go()" never end. strupr() must come from the
+// C library (see fgbench.c otherwise):
+//  gcc -O2 -funsigned-char -o fgrep fgrep.c
+
 
 /* 
 HEADER: 	CUG
@@ -166,24 +171,25 @@ ENDREF
 #define STR_ERR	   3
 #define MEM_ERR	   4
 
+#ifdef Z80		/* Largest full 256-wide transition table */
+#define DENSE_MAX  4096L	/* (bytes), see "bd_table()" */
+#define ARENA_BLK  1024		/* Bytes malloc()'d at a time for the FSA */
+#else
+#define DENSE_MAX  262144L
+#define ARENA_BLK  1048576
+#endif
+
 
 
 /*** Typedefs ***/
 
 typedef signed char BOOL;	/* Boolean flag */
+typedef unsigned int STATE;	/* FSA state number */
 
 
 
 /*** Data Structures ***/
 
-/* Queue element */
-
-typedef struct queue
-{
-  struct state_el *st_ptr;
-  struct queue *next_el;
-} QUEUE;
-
 /* Transition element */
 
 typedef struct transition
@@ -201,6 +207,7 @@ typedef struct state_el
   TRANSITION *mv_ls;	/* Pointer to head of "move" list */
   struct state_el *fail_state;	/* "failure" transition state */
   char *out_str;	/* Terminal state message (if any) */
+  STATE st_num;		/* Number in the transition table */
 } FSA;
 
 
@@ -222,6 +229,29 @@ FSA FAIL_STATE;
 
 FSA *MZ[128];	/* State 0 of FSA */
 
+/* The "move" transitions of the FSA are kept in a flat transition
+ * table (see "bd_table()"). The "move" transition of state number
+ * "st" on input "c" is "fsa_next[st * fsa_ncls + fsa_cls[c]]".
+ * State number 0 is State 0, and the states numbered "fsa_term"
+ * and up are the terminal states. If there was no room for the
+ * table, "fsa_next" is NULL and the "move" lists are used.
+ */
+
+STATE *fsa_next = 0;	/* Transition table */
+char **fsa_out;		/* Terminal state messages */
+unsigned char fsa_cls[256];	/* Input character classes */
+unsigned int fsa_ncls;	/* Table row length */
+STATE fsa_term;		/* First terminal state */
+STATE n_states = 0;	/* States made by "create()" */
+
+/* The states, transitions and strings of the FSA are never freed
+ * one at a time, so they are carved out of ARENA_BLK byte blocks,
+ * each starting with a pointer to the one before.
+ */
+
+char *arena_blk = 0;		/* Current block */
+unsigned int arena_used = ARENA_BLK;	/* Bytes of it in use */
+
 BOOL vflag = FALSE,	/* Command-line option flags */
      cflag = FALSE,
      lflag = FALSE,
@@ -311,7 +341,7 @@ FSA *move(FSA *st_ptr,char litchar)
    */
 
   if(!st_ptr)
-    return MZ[litchar];
+    return MZ[(unsigned char)litchar];
   else
   {
     /* Point to the head of the linked list of "move" transitions
@@ -357,7 +387,7 @@ FSA *go(FSA *st_ptr,char litchar)
    */
 
   if(!st_ptr)
-    return MZ[litchar];
+    return MZ[(unsigned char)litchar];
   else
   {
     /* Point to the head of the linked list of "go" transitions
@@ -390,12 +420,16 @@ FSA *go(FSA *st_ptr,char litchar)
  *	       as input. Return TRUE if match, FALSE otherwise.
  */
 
+BOOL run_table(char *str);
+
 BOOL run_fsa(char *str)
 {
   register FSA *st_ptr;
   char *message = NULL;
   BOOL msg_flag = FALSE;
 
+  if(fsa_next && xflag == FALSE)
+    return run_table(str);
   st_ptr = NULL;	/* Initialize FSA */
   if(xflag == FALSE)
   {
@@ -414,17 +448,18 @@ BOOL run_fsa(char *str)
 	st_ptr = move(st_ptr,*str);
       }
       str++;
-      if(st_ptr)
-	if(st_ptr->out_str)	/* Terminal state? */
-	  if(pflag == TRUE)
-	  {
-	    /* Save terminal state message */
-
-	    message = st_ptr->out_str;
-	    msg_flag = TRUE;
-	  }
-	  else
-	    return TRUE;
+      if(st_ptr && st_ptr->out_str)	/* Terminal state? */
+      {
+	if(pflag == TRUE)
+	{
+	  /* Save terminal state message */
+
+	  message = st_ptr->out_str;
+	  msg_flag = TRUE;
+	}
+	else
+	  return TRUE;
+      }
     }
     if(message)  /* Print any remaining terminal state message */
       printf("--> %s\n",message);
@@ -443,6 +478,64 @@ BOOL run_fsa(char *str)
 }
 
 
+/* RUN_TABLE() - As "run_fsa()", but with the "move" transitions
+ *		 taken from the transition table.
+ */
+
+BOOL run_table(char *str)
+{
+  register unsigned char *s;
+  register STATE st;
+  char *message = NULL;
+  BOOL msg_flag = FALSE;
+
+  s = (unsigned char *)str;
+  st = 0;
+  if(pflag == FALSE)
+  {
+    /* Stop at the first terminal state */
+
+    if(fsa_ncls == 256)
+    {
+      while(*s)
+	if((st = fsa_next[(st << 8) + *s++]) >= fsa_term)
+	  return TRUE;
+    }
+    else
+    {
+      while(*s)
+	if((st = fsa_next[st * fsa_ncls + fsa_cls[*s++]]) >= fsa_term)
+	  return TRUE;
+    }
+    return FALSE;
+  }
+  while(*s)
+  {
+    st = fsa_next[st * fsa_ncls + fsa_cls[*s]];
+
+    /* Print terminal state message and update FSA */
+
+    if(st == 0 && message)
+    {
+      printf("--> %s\n",message);
+      message = NULL;
+      st = fsa_next[fsa_cls[*s]];
+    }
+    s++;
+    if(st >= fsa_term)
+    {
+      /* Save terminal state message */
+
+      message = fsa_out[st];
+      msg_flag = TRUE;
+    }
+  }
+  if(message)  /* Print any remaining terminal state message */
+    printf("--> %s\n",message);
+  return msg_flag;
+}
+
+
 /* PROC_FILE() - Run the FSA on the input file "in_file". Returns
  *		 TRUE if a match was found, FALSE otherwise.
  */
@@ -468,7 +561,7 @@ BOOL proc_file(char *in_file,BOOL prt_flag)
 
   while(fgets(buffer,MAX_LINE,in_fd))
   {
-    if(nl = index(buffer,'\n'))  /* Remove newline */
+    if((nl = index(buffer,'\n')))  /* Remove newline */
       *nl = '\0';
 #ifdef CP_M
     if(fflag == FALSE || yflag == TRUE)
@@ -505,17 +598,34 @@ BOOL proc_file(char *in_file,BOOL prt_flag)
 
 
 
+/* ARENA() - Return "size" bytes of memory for the FSA */
+
+void *arena(unsigned int size)
+{
+  char *blk;
+
+  /* Keep everything aligned for a pointer */
+
+  size = (size + sizeof(char *) - 1) & ~(sizeof(char *) - 1);
+  if(arena_used + size > ARENA_BLK)
+  {
+    if(!(blk = malloc(ARENA_BLK)))
+      error(MEM_ERR,NULL);
+    *(char **)blk = arena_blk;
+    arena_blk = blk;
+    arena_used = sizeof(char *);
+  }
+  blk = arena_blk + arena_used;
+  arena_used += size;
+  return blk;
+}
+
+
 /* STRSAVE() - Save a string somewhere in memory */
 
 char *strsave(char *str)
 {
-  char *p;
-
-  if(p = malloc(strlen(str) + 1))
-    strcpy(p,str);
-  else
-    error(MEM_ERR,NULL);
-  return p;
+  return strcpy((char *)arena(strlen(str) + 1),str);
 }
 
 
@@ -527,8 +637,7 @@ TRANSITION *insert(FSA *st_ptr,char litchar)
 {
   TRANSITION *current;
     
-  if(!(current = (TRANSITION *)malloc(sizeof(TRANSITION))))
-    error(MEM_ERR,NULL);
+  current = (TRANSITION *)arena(sizeof(TRANSITION));
   current->lchar = litchar;
   current->nextst_ptr = st_ptr;
   current->next_el = NULL;
@@ -542,11 +651,11 @@ FSA *create()
 {
   FSA *st_ptr;
 
-  if(!(st_ptr = (FSA *)malloc(sizeof(FSA))))
-    error(MEM_ERR,NULL);
+  st_ptr = (FSA *)arena(sizeof(FSA));
   st_ptr->go_ls = st_ptr->mv_ls = NULL;
   st_ptr->fail_state = NULL;
   st_ptr->out_str = NULL;
+  st_ptr->st_num = ++n_states;
   return st_ptr;
 }
 
@@ -588,7 +697,7 @@ void enter(char *str)
      */
 
     if(!st_ptr)
-      nextst_ptr = MZ[*temp++] = create();
+      nextst_ptr = MZ[(unsigned char)*temp++] = create();
     else if(!(current = st_ptr->go_ls))
     {
       nextst_ptr = create();
@@ -633,7 +742,7 @@ void bd_go(char *str)
    */
 
   for(litchar = 1; litchar <= 127; litchar++)
-    MZ[litchar] = &FAIL_STATE;
+    MZ[(unsigned char)litchar] = &FAIL_STATE;
 
   /* If the -f option was selected, get the newline-separated
    * strings from the file "str" one at a time and enter them
@@ -648,7 +757,7 @@ void bd_go(char *str)
 
     while(fgets(buffer,MAX_LINE,str_fd))
     {
-      if(nl = index(buffer,'\n'))	/* Remove the newline */
+      if((nl = index(buffer,'\n')))	/* Remove the newline */
 	*nl = '\0';
       if(yflag == TRUE)
 	stoupper(buffer);
@@ -659,7 +768,7 @@ void bd_go(char *str)
   else
   {
     if(yflag == TRUE)
-      stoupper(buffer);
+      stoupper(str);
     enter(str);
   }
 
@@ -670,58 +779,127 @@ void bd_go(char *str)
    */
 
   for(litchar = 1; litchar <= 127; litchar++)
-    if(MZ[litchar] == &FAIL_STATE)
-      MZ[litchar] = NULL;
+    if(MZ[(unsigned char)litchar] == &FAIL_STATE)
+      MZ[(unsigned char)litchar] = NULL;
 }
 
 
 
-/* DELETE_QUEUE() - Delete an instance from the head of queue */
+/* BD_TABLE() - Number the states and make room for the flat
+ *		transition table, to be filled in by "bd_move()". A
+ *		small FSA gets a full row of 256 entries per state. A
+ *		larger one gets one entry per class of input
+ *		characters instead: a class for each character used in
+ *		the strings, and one for all the others, which always
+ *		lead back to State 0. The states are numbered with the
+ *		terminal states last.
+ */
 
-void delete_queue(QUEUE **head_ptr)
+void bd_table()
 {
-  *head_ptr = (*head_ptr)->next_el;
-}
+  FSA **st;		/* All the states, in breadth-first order */
+  TRANSITION *current;
+  register unsigned int c;
+  unsigned long size;
+  STATE i, n, num;
 
+  if(!(st = (FSA **)malloc((n_states + 1) * sizeof(FSA *))))
+    return;
 
+  /* List the states, and mark the characters used in them */
 
-/* ADD_QUEUE() - Add an instance to the tail of a queue */
+  memset(fsa_cls,0,sizeof(fsa_cls));
+  n = 1;
+  for(c = 1; c <= 127; c++)
+    if(MZ[c])
+    {
+      st[n++] = MZ[c];
+      fsa_cls[c] = 1;
+    }
+  for(i = 1; i < n; i++)
+    for(current = st[i]->go_ls; current; current = current->next_el)
+    {
+      st[n++] = current->nextst_ptr;
+      if((c = (unsigned char)current->lchar) <= 127)
+	fsa_cls[c] = 1;
+    }
 
-void add_queue(QUEUE **head_ptr,QUEUE **tail_ptr,FSA *st_ptr)
-{
-  QUEUE *pq;
+  /* Number the states, terminal states last */
 
-  /* Allocate the necessary memory and set the variables. */
+  num = 1;
+  for(i = 1; i < n; i++)
+    if(!st[i]->out_str)
+      st[i]->st_num = num++;
+  fsa_term = num;
+  for(i = 1; i < n; i++)
+    if(st[i]->out_str)
+      st[i]->st_num = num++;
 
-  if(!(pq = (QUEUE *)malloc(sizeof(QUEUE))))
-    error(MEM_ERR,NULL);
+  /* Full rows if they fit, else a row entry per class */
 
-  pq->st_ptr = st_ptr;
-  pq->next_el = NULL;
+  if((unsigned long)n * 256 * sizeof(STATE) <= DENSE_MAX)
+  {
+    for(c = 0; c < 256; c++)
+      fsa_cls[c] = c;
+    fsa_ncls = 256;
+  }
+  else
+  {
+    fsa_ncls = 1;
+    for(c = 0; c < 256; c++)
+      fsa_cls[c] = fsa_cls[c] ? fsa_ncls++ : 0;
+  }
 
-  if(!*head_ptr)	/* First instance of the queue? */
-    *tail_ptr = *head_ptr = pq;
-  else			/* No, just another one ... */
-    *tail_ptr = (*tail_ptr)->next_el = pq;
-}
+  size = (unsigned long)n * fsa_ncls;
+  if(size > (size_t)-1 / sizeof(STATE) ||
+      !(fsa_out = (char **)malloc(n * sizeof(char *))))
+  {
+    free(st);
+    return;
+  }
+  if(!(fsa_next = (STATE *)calloc((size_t)size,sizeof(STATE))))
+  {
+    free(fsa_out);
+    free(st);
+    return;
+  }
+
+  /* State 0's row, and the terminal state messages */
 
+  for(c = 1; c <= 127; c++)
+    if(MZ[c])
+      fsa_next[fsa_cls[c]] = MZ[c]->st_num;
+  for(i = 1; i < n; i++)
+    fsa_out[st[i]->st_num] = st[i]->out_str;
+  free(st);
+}
 
 
 /* BD_MOVE() - Build the "failure" and "move" transitions for
- *	       each state from the "go" transitions.
+ *	       each state from the "go" transitions. The "move"
+ *	       transitions go into the transition table if there is
+ *	       one, else into each state's "move" list.
  */
 
 void bd_move()
 {
-  register char litchar;
+  register unsigned int litchar;
   register FSA *r,	/* Temporary FSA state pointers */
 	       *s,
 	       *t;
-  TRANSITION *current;
-  QUEUE *first,		/* Pointer to head of queue */
-	*last;		/* Pointer to tail of queue */
+  TRANSITION *current,
+	     *last;
+  STATE *trow = NULL;	/* Table row of State "r" */
+  FSA **queue,		/* Queue of FSA states */
+      *row[256];	/* "move" list of State "r", as an array */
+  STATE first,		/* Index of head of queue */
+	end;		/* Index past its tail */
+
+  /* Every state but State 0 goes through the queue once */
 
-  last = first = NULL;	/* Initialize the queue of FSA states */
+  if(!(queue = (FSA **)malloc((n_states + 1) * sizeof(FSA *))))
+    error(MEM_ERR,NULL);
+  first = end = 0;
 
   /* For each input character with a "go" transition out of FSA
    * State 0, add a pointer to the "go" state to the queue. Note
@@ -730,17 +908,16 @@ void bd_move()
    */
 
   for(litchar = 1; litchar <= 127; litchar++)
-    if(s = go(NULL,litchar))
-      add_queue(&first,&last,s);
+    if((s = go(NULL,litchar)))
+      queue[end++] = s;
 
   /* While there are still state pointers in the queue, do ... */
 
-  while(first)
+  while(first < end)
   {
     /* Remove State "r" pointer from the head of the queue. */
 
-    r = first->st_ptr;
-    delete_queue(&first);
+    r = queue[first++];
 
     /* Skip (terminal) state with no "go" transitions" */
 
@@ -754,57 +931,72 @@ void bd_move()
     if(r->out_str)
       r->mv_ls = r->go_ls;
 
-    /* For every input to State "r" that has a "go" transition to
-     * State "s", do ...
+    /* Start with the precalculated "move" transitions of State
+     * "r"'s failure state (none for a terminal state) ...
      */
 
-    for(litchar = 1; litchar <= 127; litchar++)
+    if(fsa_next)
     {
-      if((s = go(r,litchar)) != &FAIL_STATE)
-      {
-	/* If a defined "go" transition exists for State "r" on
-	 * on input "litchar", add a pointer to State "s" to the
-	 * end of the queue.
-	 */
-
-	add_queue(&first,&last,s);
+      trow = fsa_next + r->st_num * fsa_ncls;
+      if(!r->out_str)
+	memcpy(trow,fsa_next + (r->fail_state ? r->fail_state->st_num : 0)
+	    * fsa_ncls,fsa_ncls * sizeof(STATE));
+    }
+    else if(!r->fail_state)
+      memcpy(row,MZ,sizeof(MZ));
+    else
+    {
+      memset(row,0,sizeof(row));
+      for(current = r->fail_state->mv_ls; current;
+	  current = current->next_el)
+	row[(unsigned char)current->lchar] = current->nextst_ptr;
+    }
 
-	/* Calculate the "failure" transition of State "s" using
-	 * the following algorithm.
-	 */
+    /* ... and for every input to State "r" that has a "go"
+     * transition to State "s", add a pointer to State "s" to the
+     * end of the queue, calculate its "failure" transition and
+     * make it the "move" transition instead.
+     */
 
-	t = r->fail_state;
-	while(go(t,litchar) == &FAIL_STATE)
-	  t = t->fail_state;
-	s->fail_state = go(t,litchar);
-      }
+    for(current = r->go_ls; current; current = current->next_el)
+    {
+      if((litchar = (unsigned char)current->lchar) > 127)
+	continue;
+      s = current->nextst_ptr;
+      queue[end++] = s;
+      t = r->fail_state;
+      while(go(t,litchar) == &FAIL_STATE)
+	t = t->fail_state;
+      s->fail_state = go(t,litchar);
+      if(fsa_next)
+	trow[fsa_cls[litchar]] = s->st_num;
       else
-      {
-	/* ... otherwise set the pointer to State "s" to a
-	 * pointer to the precalculated "move" transition of
-	 * State "r"'s failure state on input "litchar".
-	 */
-
-	s = move(r->fail_state,litchar);
-      }
+	row[litchar] = s;
+    }
 
-      /* Add State "s" as the "move" transition for State "r" on
-       * input "litchar" only if it is not State 0 and "r" is not
-       * a terminal state.
-       */
+    /* Add the "move" transitions of State "r" that are not to
+     * State 0, unless "r" is a terminal state.
+     */
 
-      if(s && !r->out_str)
-	if(!r->mv_ls)	/* First instance of the list? */
-	  current = r->mv_ls = insert(s,litchar);
-	else		/* No, just another one ... */
-	  current = current->next_el = insert(s,litchar);
-    }
+    if(!fsa_next && !r->out_str)
+      for(last = NULL, litchar = 1; litchar <= 127; litchar++)
+	if(row[litchar])
+	{
+	  current = insert(row[litchar],litchar);
+	  if(!last)	/* First instance of the list? */
+	    r->mv_ls = current;
+	  else		/* No, just another one ... */
+	    last->next_el = current;
+	  last = current;
+	}
   }
+  free(queue);
 }
 
 
 /*** Main Body of Program ***/
 
+#ifndef FGBENCH
 void main(int argc,char **argv)
 {
   char *temp;
@@ -874,8 +1066,11 @@ void main(int argc,char **argv)
   bd_go(*argv++);
   argc--;
 
-  /* Build the "failure" and "move" transitions */
+  /* Make room for the transition table, then build the
+   * "failure" and "move" transitions.
+   */
 
+  bd_table();
   bd_move();
 
   /* Process each of the input files if not "stdin". */
@@ -900,6 +1095,7 @@ void main(int argc,char **argv)
   else
     exit(1);
 }
+#endif
 
 
 /*** End of FGREP.C ***/
@@ -103,12 +103,95 @@ char    *patdoc[] = {
 #define RANGE   14
 #define ENDPAT  15
 
+/*
+ * Hosted builds also run the pattern as a DFA (see dfacompile())
+ */
+#if !defined(Z80) && !defined(NODFA)
+#define DFA
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DFAMEM  (1024L*1024L)   /* Bytes for DFA states         */
+#define NELEM   (PMAX+2)        /* Pattern elements, and accept */
+#define SETW    ((NELEM+31)/32) /* Words in a set of elements   */
+
+#define E_ATOM  0               /* One character                */
+#define E_BOL   1
+#define E_EOL   2
+#define E_STAR  3               /* Any number of one character  */
+#define E_MINUS 4               /* One character if it's there  */
+#define E_END   5               /* Whole pattern matched        */
+
+#define UNKNOWN (-1)            /* Transition not built yet     */
+#define MATCHED (-2)            /* Line matches                 */
+#define GIVEUP  (-3)            /* Out of room, use pmatch()    */
+#define SKIP    1               /* State: no match, wait for \n */
+
+#define CHUNK   (1024L*1024L)   /* Bytes read at a time         */
+#endif
+
+/*
+ * ... and search several files at once
+ */
+#if defined(DFA) && !defined(_WIN32) && !defined(NOTHREADS)
+#define PARALLEL
+#include <pthread.h>
+#define MAXWORKERS 16
+#endif
+
 int cflag=0, fflag=0, nflag=0, vflag=0, nfile=0, debug=0;
 
+#ifdef DFA
+char *pp, pbuf[PMAX];           /* Lines are in a struct search */
+#else
 char *pp, lbuf[LMAX], pbuf[PMAX];
+#endif
 
 extern char *cclass(), *pmatch();
 
+#ifdef DFA
+extern char *element(), *litscan();
+extern void dfacompile();
+extern int litcompile(), dfastate(), dfamake();
+#ifdef PARALLEL
+extern int pgrep();
+#endif
+
+int      dfaok;                 /* DFA is usable                */
+int      nelem;                 /* Elements, etype[nelem]==E_END */
+char     etype[NELEM];
+unsigned char eset[NELEM][32];  /* Characters each one matches  */
+short    *dnext;                /* 256 transitions per state    */
+unsigned *dset;                 /* Elements live in each state  */
+char     *dbol;                 /* State is at start of line    */
+int      *dhash;                /* Open hash of states          */
+int      nstate, maxstate, hmask;
+
+char     lit[PMAX];             /* Required literal, lower case */
+int      litlen;                /* Its length, 0 if none        */
+int      litkey;                /* Index of the byte to memchr(), or -1 */
+int      litskip[256];          /* Horspool shifts otherwise    */
+
+/*
+ * Workers add states under dfalock but read dnext[] and dfaok
+ * without it: a transition is stored with release and loaded with
+ * acquire, so a worker that sees a new state also sees its row.
+ */
+#ifdef PARALLEL
+pthread_mutex_t dfalock = PTHREAD_MUTEX_INITIALIZER;
+#define DGET(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define DPUT(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define DGET(x)     (x)
+#define DPUT(x, v)  ((x) = (v))
+#endif
+
+#define ISIN(k, c)  (eset[k][(c) >> 3] & (1 << ((c) & 7)))
+#define HAS(set, k) ((set)[(k) >> 5] & (1U << ((k) & 31)))
+#define ADD(set, k) ((set)[(k) >> 5] |= (1U << ((k) & 31)))
+#endif
+
 
 /*** Main program - parse arguments & grep *************/
 main(argc, argv)
@@ -238,6 +321,10 @@ char *argv[];
 				x = dir_move_next();
 			}
 #else
+#ifdef PARALLEL
+			if (pgrep(argc, argv) == 0)
+			   break;
+#endif
 
 			if ((f=fopen(p, "r")) == NULL)
 			   cant(p);
@@ -252,10 +339,11 @@ char *argv[];
 }
 
 /*** Display a file name *******************************/
-file(s)
+file(fp, s)
+FILE *fp;
 char *s;
 {
-   printf("File %s:\n", s);
+   fprintf(fp, "File %s:\n", s);
 }
 
 /*** Report unopenable file ****************************/
@@ -393,6 +481,10 @@ char       *source;   /* Pattern to compile */
         }
         printf("\n");
    }
+#ifdef DFA
+   if (debug < 2)           /* -dd wants to see pmatch() */
+      dfacompile();
+#endif
 }
 
 /*** Compile a class (within []) ***********************/
@@ -463,6 +555,7 @@ char  *stop;          /* Pattern end   */
    error("?GREP-E-Bad pattern\n");
 }
 
+#ifndef DFA
 /*** Scan the file for the pattern in pbuf[] ***********/
 grep(fp, fn)
 FILE       *fp;       /* File to process            */
@@ -474,12 +567,12 @@ char       *fn;       /* File name (for -f option)  */
    count = 0;
    while (fgets(lbuf, LMAX, fp)) {
       ++lno;
-      m = match();
+      m = match(lbuf);
       if ((m && !vflag) || (!m && vflag)) {
          ++count;
          if (!cflag) {
             if (fflag && fn) {
-               file(fn);
+               file(stdout, fn);
                fn = 0;
             }
             if (nflag)
@@ -490,25 +583,28 @@ char       *fn;       /* File name (for -f option)  */
    }
    if (cflag) {
       if (fflag && fn)
-         file(fn);
+         file(stdout, fn);
       printf("%d\n", count);
    }
 }
+#endif
 
-/*** Match line (lbuf) with pattern (pbuf) return 1 if match ***/
-match()
+/*** Match line with pattern (pbuf) return 1 if match ***/
+match(line)
+char *line;
 {
    register char   *l;        /* Line pointer       */
 
-   for (l = lbuf; *l; ++l) {
-      if (pmatch(l, pbuf))
+   for (l = line; *l; ++l) {
+      if (pmatch(line, l, pbuf))
          return(1);
    }
    return(0);
 }
 
 /*** Match partial line with pattern *******************/
-char *pmatch(line, pattern)
+char *pmatch(start, line, pattern)
+char               *start;    /* Whole line, for BOL          */
 char               *line;     /* (partial) line to match      */
 char               *pattern;  /* (partial) pattern to match   */
 {
@@ -536,7 +632,7 @@ char               *pattern;  /* (partial) pattern to match   */
          break;
 
       case BOL:
-         if (l != lbuf)
+         if (l != start)
             return(0);
          break;
 
@@ -596,22 +692,22 @@ char               *pattern;  /* (partial) pattern to match   */
          break;
 
       case MINUS:
-         e = pmatch(l, p);       /* Look for a match    */
+         e = pmatch(start, l, p);       /* Look for a match    */
          while (*p++ != ENDPAT); /* Skip over pattern   */
          if (e)                  /* Got a match?        */
             l = e;               /* Yes, update string  */
          break;                  /* Always succeeds     */
 
       case PLUS:                 /* One or more ...     */
-         if ((l = pmatch(l, p)) == 0)
+         if ((l = pmatch(start, l, p)) == 0)
             return(0);           /* Gotta have a match  */
       case STAR:                 /* Zero or more ...    */
          are = l;                /* Remember line start */
-         while (*l && (e = pmatch(l, p)))
+         while (*l && (e = pmatch(start, l, p)))
             l = e;               /* Get longest match   */
          while (*p++ != ENDPAT); /* Skip over pattern   */
          while (l >= are) {      /* Try to match rest   */
-            if (e = pmatch(l, p))
+            if (e = pmatch(start, l, p))
                return(e);
             --l;                 /* Nope, try earlier   */
          }
@@ -625,6 +721,733 @@ char               *pattern;  /* (partial) pattern to match   */
    return(l);
 }
 
+#ifdef DFA
+/*
+ * The DFA is built lazily.  pbuf[] is first turned into a list of
+ * elements, each matching one character (with STAR, MINUS or PLUS
+ * applied) or a line end, with the set of characters each element
+ * matches worked out by pmatch() itself, so the two agree on case,
+ * classes and the like.  A DFA state is the set of elements a match
+ * in progress can be at; the transition for a character is made the
+ * first time that character is seen in that state.  A match may start
+ * at every character, so element 0 joins every set, and as in pmatch()
+ * a MINUS takes its character whenever it is there.
+ *
+ * '\n' ends a line: its transition also checks the end of line and
+ * goes back to state 0, the start of a line.  A NUL ends the line text
+ * as far as pmatch() is concerned, though a [^...] class matches the
+ * NUL itself; a match then stands if only STAR or MINUS elements are
+ * left.  When the states would outgrow DFAMEM the DFA gives up and
+ * pmatch() does the rest of the work.
+ */
+
+/*** Length of a one-character op at p, or 0 ***********/
+atomlen(p)
+register char *p;
+{
+   switch (*p) {
+
+   case CHAR:
+      return(2);
+
+   case ANY:
+   case ALPHA:
+   case DIGIT:
+   case NALPHA:
+   case PUNCT:
+      return(1);
+
+   case CLASS:
+   case NCLASS:
+      return(1 + (p[1] & 0377));
+   }
+   return(0);
+}
+
+/*** Add an element for the op at p; return what follows ***/
+char *element(type, p)
+int  type;
+char *p;
+{
+   register int    c, n;
+   char            pat[PMAX+1], one[2];
+
+   if ((n = atomlen(p)) == 0)
+      return(0);
+   memcpy(pat, p, n);
+   pat[n] = ENDPAT;
+   one[1] = 0;
+   for (c = 0; c < 256; ++c) {
+      one[0] = c;
+      if (pmatch(one, one, pat))
+         eset[nelem][c >> 3] |= 1 << (c & 7);
+   }
+   etype[nelem++] = type;
+   return(p + n);
+}
+
+/*** Turn pbuf[] into elements and start the DFA *******/
+void dfacompile()
+{
+   register char   *p;
+   register int    op;
+   long            size;
+
+   dfaok = 0;
+   nelem = 0;
+   memset(eset, 0, sizeof eset);
+   for (p = pbuf; (op = *p) != ENDPAT;) {
+      switch (op) {
+
+      case BOL:
+      case EOL:
+         etype[nelem++] = (op == BOL) ? E_BOL : E_EOL;
+         ++p;
+         break;
+
+      case PLUS:                 /* One, then STAR      */
+         if (element(E_ATOM, p + 1) == 0)
+            return;
+      case STAR:
+      case MINUS:
+         p = element((op == MINUS) ? E_MINUS : E_STAR, p + 1);
+         if (p == 0 || *p++ != ENDPAT)
+            return;              /* Not one op, so no DFA */
+         break;
+
+      default:
+         if ((p = element(E_ATOM, p)) == 0)
+            return;
+      }
+   }
+   etype[nelem] = E_END;
+   litcompile();
+
+   if (dnext == 0) {
+      size = 256 * sizeof(short) + SETW * sizeof(unsigned) + 1;
+      maxstate = DFAMEM / size;
+      for (hmask = 1; hmask < 2 * maxstate; hmask <<= 1)
+         ;
+      dnext = malloc(maxstate * 256 * sizeof(short));
+      dset = malloc(maxstate * SETW * sizeof(unsigned));
+      dbol = malloc(maxstate);
+      dhash = malloc(hmask * sizeof(int));
+      if (!dnext || !dset || !dbol || !dhash) {
+         dnext = 0;
+         return;
+      }
+      memset(dnext, -1, maxstate * 256 * sizeof(short));
+      --hmask;                   /* All UNKNOWN, even if read early */
+   }
+   nstate = 0;
+   memset(dhash, -1, (hmask + 1) * sizeof(int));
+   memset(dset, 0, 2 * SETW * sizeof(unsigned));
+   dfastate(dset, 1);            /* 0: start of a line  */
+   dfastate(dset + SETW, 0);     /* 1: SKIP to newline  */
+   for (op = 0; op < 256; ++op)
+      dnext[SKIP * 256 + op] = (op == '\n') ? 0 : SKIP;
+   dfaok = 1;
+   if (debug)
+      printf("DFA: %d elements, literal \"%.*s\"\n", nelem, litlen, lit);
+}
+
+/*** Find or make the state for set; GIVEUP if full ****/
+dfastate(set, bol)
+unsigned  *set;
+int       bol;
+{
+   register unsigned h;
+   register int    i, s;
+
+   for (h = bol, i = 0; i < SETW; ++i)
+      h = (h ^ set[i]) * 16777619U;
+   for (h &= hmask; (s = dhash[h]) >= 0; h = (h + 1) & hmask) {
+      if (s != SKIP && dbol[s] == bol
+       && memcmp(&dset[s * SETW], set, SETW * sizeof(unsigned)) == 0)
+         return(s);
+   }
+   if (nstate == maxstate) {
+      DPUT(dfaok, 0);
+      if (debug)
+         printf("DFA: %d states, using pmatch()\n", nstate);
+      return(GIVEUP);
+   }
+   s = nstate++;
+   dhash[h] = s;
+   memcpy(&dset[s * SETW], set, SETW * sizeof(unsigned));
+   dbol[s] = bol;
+   for (i = 0; i < 256; ++i)
+      dnext[s * 256 + i] = UNKNOWN;
+   return(s);
+}
+
+/*** Elements reachable from in without reading c; 1 if E_END is ***/
+closure(in, out, c, bol)
+unsigned  *in, *out;
+int       c, bol;
+{
+   int             stack[NELEM];
+   register int    k, sp;
+
+   memset(out, 0, SETW * sizeof(unsigned));
+   for (sp = 0, k = 0; k <= nelem; ++k)
+      if (HAS(in, k)) {
+         ADD(out, k);
+         stack[sp++] = k;
+      }
+   while (sp) {
+      k = stack[--sp];
+      switch (etype[k]) {
+
+      case E_END:
+         return(1);
+
+      case E_BOL:
+         if (!bol)
+            continue;
+         break;
+
+      case E_EOL:
+         if (c != 0)
+            continue;
+         break;
+
+      case E_MINUS:
+         if (ISIN(k, c))
+            continue;            /* Must take it        */
+      case E_STAR:
+         break;
+
+      default:
+         continue;
+      }
+      if (!HAS(out, k + 1)) {
+         ADD(out, k + 1);
+         stack[sp++] = k + 1;
+      }
+   }
+   return(0);
+}
+
+/*** Does the line match if it ends with live elements in set? ***/
+endmatch(set, bol)
+unsigned  *set;
+int       bol;
+{
+   unsigned        live[SETW];
+   register int    k, j;
+
+   if (closure(set, live, 0, bol))
+      return(1);
+   for (k = 0; k < nelem; ++k) {
+      if (HAS(live, k) && ISIN(k, 0) && etype[k] != E_STAR) {
+         for (j = k + 1; etype[j] == E_STAR || etype[j] == E_MINUS; ++j)
+            ;
+         if (etype[j] == E_END)
+            return(1);           /* [^...] took the NUL */
+      }
+   }
+   return(0);
+}
+
+/*** The transition from state s on character c, made if need be ***/
+dfastep(s, c)
+int s, c;
+{
+#ifdef PARALLEL
+   register int    t;
+
+   pthread_mutex_lock(&dfalock);
+   if ((t = dnext[s * 256 + c]) == UNKNOWN)
+      t = dfamake(s, c);         /* Not made by another worker */
+   pthread_mutex_unlock(&dfalock);
+   return(t);
+#else
+   return(dfamake(s, c));
+#endif
+}
+
+/*** Make the transition from state s on character c ***/
+dfamake(s, c)
+int s, c;
+{
+   unsigned        in[SETW], live[SETW], next[SETW];
+   register int    k, t;
+
+   memcpy(in, &dset[s * SETW], sizeof in);
+   if (c == 0)
+      t = endmatch(in, dbol[s]) ? MATCHED : SKIP;
+   else if (ADD(in, 0), closure(in, live, c, dbol[s]))
+      t = MATCHED;               /* A match may start here */
+   else {
+      memset(next, 0, sizeof next);
+      for (k = 0; k < nelem; ++k) {
+         if (HAS(live, k) && ISIN(k, c)) {
+            if (etype[k] == E_STAR)
+               ADD(next, k);
+            else if (etype[k] != E_BOL && etype[k] != E_EOL)
+               ADD(next, k + 1);
+         }
+      }
+      if (c == '\n')             /* End of line follows */
+         t = endmatch(next, 0) ? MATCHED : 0;
+      else if ((t = dfastate(next, 0)) == GIVEUP)
+         return(t);
+   }
+   DPUT(dnext[s * 256 + c], t);
+   return(t);
+}
+
+/*
+ * Every match contains the longest run of elements that each match
+ * one character (both cases of a letter count as one), so a line
+ * without that literal is passed over without running a matcher.
+ * If the literal has a byte other than a letter, memchr() looks for
+ * it (the C library does that a word or a vector at a time) and the
+ * rest is checked around it; otherwise a Horspool search ignoring
+ * case is used.
+ */
+
+/*** The one character element k matches, or -1 ********/
+litchar(k)
+int k;
+{
+   register int    c, n, x;
+
+   if (etype[k] != E_ATOM)
+      return(-1);
+   for (n = 0, x = -1, c = 0; c < 256; ++c)
+      if (ISIN(k, c)) {
+         ++n;
+         if (x < 0)
+            x = c;
+      }
+   if (n == 1 && tolower(x) == x && toupper(x) == x && x != '\n')
+      return(x);
+   if (n == 2 && isupper(x) && (c = tolower(x)) < 256 && ISIN(k, c))
+      return(c);
+   return(-1);
+}
+
+/*** Find the longest required literal *****************/
+litcompile()
+{
+   register int    k, n, c;
+   int             best, bestlen;
+
+   best = bestlen = 0;
+   for (k = n = 0; k < nelem; ++k) {
+      if (litchar(k) < 0)
+         n = 0;
+      else if (++n > bestlen) {
+         bestlen = n;
+         best = k + 1 - n;
+      }
+   }
+   for (k = 0; k < bestlen; ++k)
+      lit[k] = litchar(best + k);
+   litlen = bestlen;
+   litkey = -1;
+   for (k = 0; k < litlen; ++k) {
+      c = lit[k] & 0377;
+      if (!islower(c)
+       && (litkey < 0 || isalnum(lit[litkey] & 0377) || lit[litkey] == ' '))
+         litkey = k;             /* Rather punctuation */
+   }
+   if (litkey < 0 && litlen < 2)
+      litlen = 0;                /* One letter: no gain */
+   for (c = 0; c < 256; ++c)
+      litskip[c] = litlen;
+   for (k = 0; k < litlen - 1; ++k) {
+      c = lit[k] & 0377;
+      litskip[c] = litskip[toupper(c)] = litlen - 1 - k;
+   }
+}
+
+/*** Find the literal in b..e, return 0 if it isn't there ***/
+char *litscan(b, e)
+char *b, *e;
+{
+   register unsigned char  *p, *q;
+   register int            i, n;
+
+   n = litlen;
+   if (e - b < n)
+      return(0);
+   if (litkey >= 0) {
+      q = (unsigned char *)b + litkey;
+      while ((p = memchr(q, lit[litkey], (e - (char *)q) - (n - 1 - litkey))) != 0) {
+         p -= litkey;
+         for (i = 0; i < n && tolower(p[i]) == (lit[i] & 0377); ++i)
+            ;
+         if (i == n)
+            return((char *)p);
+         q = p + litkey + 1;
+         if ((char *)q + (n - 1 - litkey) >= e)
+            break;
+      }
+      return(0);
+   }
+   for (p = (unsigned char *)b; (char *)p + n <= e; p += litskip[p[n - 1]]) {
+      for (i = n - 1; i >= 0 && tolower(p[i]) == (lit[i] & 0377); --i)
+         ;
+      if (i < 0)
+         return((char *)p);
+   }
+   return(0);
+}
+
+/*** Match line l..e (with its '\n') by the DFA: 1, 0, or -1 if given up ***/
+dfaline(l, e)
+char *l, *e;
+{
+   register unsigned char  *q;
+   register short          *next;
+   register int            s, t;
+
+   next = dnext;
+   s = 0;
+   for (q = (unsigned char *)l;; ++q) {
+      if (q == (unsigned char *)e) {
+         if ((t = DGET(next[s * 256])) == UNKNOWN)
+            t = dfastep(s, 0);   /* Line end, or after its '\n' */
+         return((t == MATCHED) ? 1 : (t == GIVEUP) ? -1 : 0);
+      }
+      if ((t = DGET(next[s * 256 + *q])) == UNKNOWN)
+         t = dfastep(s, *q);
+      if (t < 0)
+         return((t == MATCHED) ? 1 : -1);
+      s = t;
+   }
+}
+#endif
+
+/*
+ * Hosted builds search the file a buffer at a time.  Without -v the
+ * DFA runs straight through the buffer, from one required literal to
+ * the next when there is one; a line is only found, and its number
+ * counted, when it matches.  Lines are as long as they need be.  All
+ * that one search needs is kept in a struct search, so that several
+ * files can be searched at once.
+ */
+#ifdef DFA
+struct search {
+   char    *buf;                /* The buffer, CHUNK or more    */
+   long    bsize;
+   char    *lbuf;               /* Line copy for pmatch()       */
+   long    lsize;
+   char    *curfn;              /* File name until printed      */
+   int     count;               /* Lines shown (or counted)     */
+   long    lines;               /* Newlines before lnpos        */
+   char    *lnpos;
+   FILE    *out;                /* Where the lines go           */
+};
+
+/*** Count newlines in b..e, a word at a time **********/
+long countnl(b, e)
+char *b, *e;
+{
+   register unsigned long  t;
+   register long           n;
+   unsigned long           x, ones, lows;
+
+   ones = ~0UL / 255;           /* 0x0101...01 */
+   lows = ones * 0x7f;
+   n = 0;
+   while (e - b >= (long)sizeof x) {
+      memcpy(&x, b, sizeof x);
+      x ^= ones * '\n';         /* Newlines are now zero bytes */
+      t = ~(((x & lows) + lows) | x | lows);
+      n += ((t >> 7) * ones) >> (8 * (sizeof x - 1));
+      b += sizeof x;
+   }
+   while (b < e)
+      n += (*b++ == '\n');
+   return(n);
+}
+
+/*** Start of the line holding q, no earlier than b ****/
+char *linestart(b, q)
+register char *b, *q;
+{
+   while (q > b && q[-1] != '\n')
+      --q;
+   return(q);
+}
+
+/*** End of the line holding q (past its '\n'), no later than e ***/
+char *lineend(q, e)
+char *q, *e;
+{
+   register char *n;
+
+   return((n = memchr(q, '\n', e - q)) ? n + 1 : e);
+}
+
+/*** A selected line l..e ******************************/
+void show(g, l, e)
+register struct search *g;
+char *l, *e;
+{
+   register char   *z;
+
+   ++g->count;
+   if (cflag)
+      return;
+   if (fflag && g->curfn) {
+      file(g->out, g->curfn);
+      g->curfn = 0;
+   }
+   if (nflag) {
+      g->lines += countnl(g->lnpos, l);
+      g->lnpos = l;
+      fprintf(g->out, "%ld\t", g->lines + 1);
+   }
+   if ((z = memchr(l, 0, e - l)) != 0)
+      e = z;                    /* As printed by %s */
+   fwrite(l, 1, e - l, g->out);
+   putc('\n', g->out);
+}
+
+/*** Does line l..e match? *****************************/
+linematch(g, l, e)
+register struct search *g;
+char *l, *e;
+{
+   if (litlen && litscan(l, e) == 0)
+      return(0);
+   if (DGET(dfaok)) {
+      switch (dfaline(l, e)) {
+      case 1:
+         return(1);
+      case 0:
+         return(0);
+      }                         /* Gave up, so pmatch() */
+   }
+   if (e - l >= g->lsize) {
+      g->lsize = e - l + 1;
+      if ((g->lbuf = realloc(g->lbuf, g->lsize)) == 0)
+         error("Line too long\n");
+   }
+   memcpy(g->lbuf, l, e - l);
+   g->lbuf[e - l] = 0;
+   return(match(g->lbuf));
+}
+
+/*** Select lines in b..e, which ends at a line end ***/
+void scan(g, b, e)
+register struct search *g;
+char *b, *e;
+{
+   register unsigned char  *q;
+   register short          *next;
+   register int            s, t = 0;
+   char                    *p, *end;
+
+   if (vflag || !DGET(dfaok)) {
+      for (p = b; p < e; p = end) {
+         end = lineend(p, e);
+         if (linematch(g, p, end) ? !vflag : vflag)
+            show(g, p, end);
+      }
+      return;
+   }
+   for (p = b; p < e; p = end) {
+      end = e;
+      if (litlen) {             /* Only lines with the literal */
+         if ((q = (unsigned char *)litscan(p, e)) == 0)
+            return;
+         p = linestart(p, (char *)q);
+         end = lineend((char *)q, e);
+      }
+      next = dnext;
+      for (s = 0, q = (unsigned char *)p; q < (unsigned char *)end; ++q) {
+         if ((t = DGET(next[s * 256 + *q])) == UNKNOWN)
+            t = dfastep(s, *q);
+         if (t < 0)
+            break;
+         s = t;
+      }
+      if (q == (unsigned char *)end) {
+         if (end[-1] == '\n')
+            continue;           /* No match up to end */
+         if ((t = DGET(next[s * 256])) == UNKNOWN)
+            t = dfastep(s, 0);   /* Last line, no '\n' */
+         if (t != MATCHED)
+            continue;
+         q = (unsigned char *)end - 1;
+      }
+      p = linestart(p, (char *)q);
+      end = lineend((char *)q, e);
+      if (t == GIVEUP) {        /* pmatch() for the rest */
+         scan(g, p, e);
+         return;
+      }
+      show(g, p, end);
+   }
+}
+
+/*** Scan the file for the pattern, lines to g->out ****/
+search(g, fp, fn)
+register struct search *g;
+FILE       *fp;       /* File to process            */
+char       *fn;       /* File name (for -f option)  */
+{
+   register char   *e;
+   long            have, got;
+
+   if (g->buf == 0 && (g->buf = malloc(g->bsize = CHUNK)) == 0)
+      error("No memory\n");
+   g->curfn = fn;
+   g->count = 0;
+   g->lines = 0;
+   have = 0;
+   do {
+      got = fread(g->buf + have, 1, g->bsize - have, fp);
+      have += got;
+      e = g->buf + have;
+      if (got != 0) {           /* Keep the last part line */
+         while (e > g->buf && e[-1] != '\n')
+            --e;
+         if (e == g->buf) {
+            if (have == g->bsize
+             && (g->buf = realloc(g->buf, g->bsize *= 2)) == 0)
+               error("No memory\n");
+            continue;           /* Line needs more    */
+         }
+      }
+      g->lnpos = g->buf;
+      scan(g, g->buf, e);
+      if (nflag)
+         g->lines += countnl(g->lnpos, e);
+      have -= e - g->buf;
+      memmove(g->buf, e, have);
+   } while (got != 0);
+   if (cflag) {
+      if (fflag && g->curfn)
+         file(g->out, g->curfn);
+      fprintf(g->out, "%d\n", g->count);
+   }
+}
+
+/*** Scan the file for the pattern in pbuf[] ***********/
+grep(fp, fn)
+FILE       *fp;       /* File to process            */
+char       *fn;       /* File name (for -f option)  */
+{
+   static struct search    one;
+
+   one.out = stdout;
+   search(&one, fp, fn);
+}
+#endif
+
+#ifdef PARALLEL
+/*
+ * With several files and several processors, workers take the files
+ * in command line order and search each into its own memory stream;
+ * main() writes out each file's lines (or reports that it can't be
+ * opened) once it and all before it are done, so the output is that
+ * of a serial run.  The workers share the DFA: a missing transition
+ * is made under dfalock, the rest of it is only read.
+ */
+struct job {
+   char    *name;
+   char    *text;               /* What the search printed      */
+   size_t  size;
+   char    bad;                 /* Could not be opened          */
+   char    done;
+};
+
+struct job      *jobs;
+int             njob, nextjob;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  ready = PTHREAD_COND_INITIALIZER;
+
+/*** Search files until there are none left ************/
+void *worker(arg)
+void *arg;
+{
+   struct search   g;
+   register struct job *j;
+   FILE            *f;
+   int             i;
+
+   memset(&g, 0, sizeof g);
+   for (;;) {
+      pthread_mutex_lock(&lock);
+      i = nextjob++;
+      pthread_mutex_unlock(&lock);
+      if (i >= njob)
+         break;
+      j = &jobs[i];
+      if ((f = fopen(j->name, "r")) == NULL)
+         j->bad = 1;
+      else {
+         if ((g.out = open_memstream(&j->text, &j->size)) == NULL)
+            error("No memory\n");
+         search(&g, f, j->name);
+         fclose(g.out);
+         fclose(f);
+      }
+      pthread_mutex_lock(&lock);
+      j->done = 1;
+      pthread_cond_broadcast(&ready);
+      pthread_mutex_unlock(&lock);
+   }
+   free(g.buf);
+   free(g.lbuf);
+   return(arg);
+}
+
+/*** Search the files named in argv[1..argc-1]; -1 if not in parallel ***/
+pgrep(argc, argv)
+int argc;
+char *argv[];
+{
+   pthread_t       tid[MAXWORKERS];
+   long            ncpu;
+   register int    i;
+   int             nw;
+
+   if (debug)
+      return(-1);               /* Keep the trace in order */
+   if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) > MAXWORKERS)
+      ncpu = MAXWORKERS;
+   if (ncpu > nfile)
+      ncpu = nfile;
+   if (ncpu < 2 || (jobs = calloc(nfile, sizeof(struct job))) == NULL)
+      return(-1);
+   for (njob = 0, i = 1; i < argc; ++i)
+      if (argv[i])
+         jobs[njob++].name = argv[i];
+   nextjob = 0;
+   for (nw = 0; nw < ncpu; ++nw)
+      if (pthread_create(&tid[nw], NULL, worker, NULL) != 0)
+         break;
+   if (nw == 0) {
+      free(jobs);
+      return(-1);
+   }
+   for (i = 0; i < njob; ++i) {
+      pthread_mutex_lock(&lock);
+      while (!jobs[i].done)
+         pthread_cond_wait(&ready, &lock);
+      pthread_mutex_unlock(&lock);
+      if (jobs[i].bad)
+         cant(jobs[i].name);
+      else {
+         fwrite(jobs[i].text, 1, jobs[i].size, stdout);
+         free(jobs[i].text);
+      }
+   }
+   while (nw-- > 0)
+      pthread_join(tid[nw], NULL);
+   free(jobs);
+   return(0);
+}
+#endif
+
 /*** Report an error ***********************************/
 error(s)
 char *s;
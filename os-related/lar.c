@@ -4,25 +4,29 @@
 
 /* With z88dk, library editing may not work on some target      */
 /* '-DNOEDIT' will limit the tool (and its size) in those cases */
-/* MAXFILES is set to 64 to reduce the program size
+/* MAXFILES is set to 64 to reduce the program size on the Z80 */
 
 /* FULL program */
-/* zcc +cpm -create-app -O3 --opt-code-size -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER lar.c */
-/* (work in progress) zcc +cpm -create-app -SO3 --max-allocs-per-node400000 -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER -compiler=sdcc lar.c */
+/* zcc +cpm -create-app -O3 --opt-code-size -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER lar.c unpack.c */
+/* (work in progress) zcc +cpm -create-app -SO3 --max-allocs-per-node400000 -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER -compiler=sdcc lar.c unpack.c */
 
 /* MINIMAL program */
 /* zcc +cpm -create-app -O3 --opt-code-size -DTOUPPER -DNOEDIT lar.c */
 
 /* --Unix/Windows/MAC version--
-   gcc -DUNCRUNCH -DUSQ -DTOUPPER lar.c */
+   gcc -DUNCRUNCH -DUSQ -DUNLZH -DTOUPPER -pthread lar.c unpack.c */
+/* hosted builds extract several members at once, one per thread; */
+/* '-DNOTHREADS' extracts them one after the other (always on Windows) */
 
 
 
 /* Auto-expansion of compressed files, Stefano Bodrato, Oct - 2019 */
 /* '-DUSQ' will add the automatic UNSQUEEZing of the file when appropriate */
 /* '-DUNCRUNCH' will add the automatic UNCRUNCHing of the file when appropriate */
-/* '-DAMALLOC -DHAVE_CALLOC': NOT YET WORKING, TO BE FIXED ! */
-/* zcc +cpm -create-app -O3 --opt-code-size -DTOUPPER -DUSQ -DUNCRUNCH lar.c */
+/* '-DUNLZH' will add the automatic expansion of crLZH files */
+/* Members are expanded as they are read from the library, without */
+/* a temporary copy, by the decoders in unpack.c */
+/* zcc +cpm -create-app -O3 --opt-code-size -DTOUPPER -DUSQ -DUNCRUNCH lar.c unpack.c */
 
 
 /*% /bin/env - /bin/ncc -O lar.c -o lar
@@ -58,6 +62,7 @@ Stephen Hemminger,  Mitre Corp. Bedford MA
  *	p - Print files in library
  *	d - Delete files in library
  *	r - Reorganize library
+ *	c - Compact library in place
  *  Other keys:
  *	v - Verbose
  *
@@ -99,1355 +104,26 @@ Stephen Hemminger,  Mitre Corp. Bedford MA
 #include <string.h>
 #include <ctype.h>
 #include <fcntl.h>
-
-#ifdef HAVE_CALLOC
-#include <malloc.h>
+#ifndef Z80
+#include <unistd.h>
 #endif
 
 
-unsigned char *ptr;
-unsigned char outfile[80];	/*space to build output file name*/
-FILE 	*infd;			/*currently open input file*/
-FILE 	*outfd;			/*currently open output file*/
-
 
 #if (defined(UNCRUNCH)||defined(UNLZH)||defined(USQ))
-/*
- cisubstr(string, token) searches for lower case token in string s
- returns pointer to token within string if found, NULL otherwise
-*/
-#define cisubstr(s,t) strstr(s,t)
-
-/*extract, build and print output file name*/
-void getfilename() {
-#ifdef TOUPPER
-	for(ptr=outfile; (*ptr=getc(infd))!='\0'; ptr++) *ptr=toupper(*ptr);
-#else
-	for(ptr=outfile; (*ptr=getc(infd))!='\0'; ptr++) *ptr=tolower(*ptr);
-#endif
-	*(cisubstr(outfile,".")+4)='\0'; /*truncate non-name portion*/
-	printf(" -> %s",outfile);
-}
-
+/* members are expanded as they are read from the library, see unpack.c */
+#define UNPACK
+#include "unpack.h"
 #endif
 
-
-#if (defined(USQ)||defined(UNLZH))
-#define MAGIC_UNCR	0xfe76
-
-/* for bit/byte reader */
-unsigned int getbuf;
-
-/* get 16-bit word from file */
-int getw16()
-{
-int temp;
-
-temp = getc(infd);		/* get low order byte */
-temp |= getc(infd) << 8;
-if (temp & 0x8000) temp |= (~0) << 15;	/* propogate sign for big ints */
-return temp;
-
-}
-
-/* get 16-bit (unsigned) word from file */
-int getx16()
-{
-int temp;
-
-temp = getc(infd);		/* get low order byte */
-return temp | (getc(infd) << 8);
-
-}
+#if !defined(Z80) && !defined(_WIN32) && !defined(NOTHREADS)
+#define PARALLEL
+#include <pthread.h>
 #endif
 
 
 
 
-// ------------------------------------------------------------------------------------------
-
-#ifdef UNLZH
-
-/*
- * THIS PROGRAM SECTION IS UNDER THE GPL LICENSE
- *
- * lbrate 1.0 - fully extract CP/M `.lbr' archives.
- * Copyright (C) 2001 Russell Marks. See main.c for license details.
- *
- * readlzh.c - read LZH-compressed files.
- *
- * This is based on the well-known lzhuf.c. Since the original
- * licence was at best ambiguous, I asked all three authors if
- * I could use a modified version of lzhuf.c in a GPL'd program,
- * and the two who responded agreed.
- *
- * (The third, Yoshizaki, is thought by Okumura not likely to object,
- * perhaps since his code was based on Okumura's lzari.c - which has
- * always been under the licence mentioned below. :-))
- *
- * The following reflects what they consider to be the real licence
- * on lzhuf.c:
- *
- * lzhuf.c
- * Copyright (C) 1989 Haruhiko Okumura, Haruyasu Yoshizaki, and Kenji Rikitake.
- * Use, distribute, and modify this program freely.
- */
-
-
-/********** LZSS compression **********/
-
-#define MAGIC_LZH	0xfd76
-
-/* these are the values required for the "Y" format */
-#define LZ_N		2048
-#define LZ_F		60
-#define THRESHOLD	2
-
-static unsigned int checksum;
-static int oldver,lastchar;
-
-unsigned char text_buf[LZ_N + LZ_F - 1];
-
-
-/* Huffman coding */
-
-#define N_CHAR		(256 + 1 - THRESHOLD + LZ_F)
-/* kinds of characters (character code = 0..N_CHAR-1) */
-#define LZ_T		(N_CHAR * 2 - 1)	/* size of table */
-#define LZ_R		(LZ_T - 1)		/* position of root */
-#define MAX_FREQ	0x8000		/* updates tree when the */
-				   /* root frequency comes to this value. */
-
-
-/* table for decoding the upper 6 bits of position */
-
-/* for decoding */
-//unsigned char d_code[256] =
-unsigned char d_code[224] =
-  {
-//  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-//  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-//  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-//  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
-  0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
-  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-  
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
-  0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09,
-  0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A,
-  0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B,
-
-  0x0C, 0x0C, 0x0C, 0x0C, 0x0D, 0x0D, 0x0D, 0x0D,
-  0x0E, 0x0E, 0x0E, 0x0E, 0x0F, 0x0F, 0x0F, 0x0F,
-  0x10, 0x10, 0x10, 0x10, 0x11, 0x11, 0x11, 0x11,
-  0x12, 0x12, 0x12, 0x12, 0x13, 0x13, 0x13, 0x13,
-  0x14, 0x14, 0x14, 0x14, 0x15, 0x15, 0x15, 0x15,
-  0x16, 0x16, 0x16, 0x16, 0x17, 0x17, 0x17, 0x17,
-
-  0x18, 0x18, 0x19, 0x19, 0x1A, 0x1A, 0x1B, 0x1B,
-  0x1C, 0x1C, 0x1D, 0x1D, 0x1E, 0x1E, 0x1F, 0x1F,
-  0x20, 0x20, 0x21, 0x21, 0x22, 0x22, 0x23, 0x23,
-  0x24, 0x24, 0x25, 0x25, 0x26, 0x26, 0x27, 0x27,
-  0x28, 0x28, 0x29, 0x29, 0x2A, 0x2A, 0x2B, 0x2B,
-  0x2C, 0x2C, 0x2D, 0x2D, 0x2E, 0x2E, 0x2F, 0x2F,
-  
-  0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
-  0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
-  };
-/*
-unsigned char d_len[176] =
-  {
-//  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-//  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-//  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-//  0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
-
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-  0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
-
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
-  
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
-  
-  0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
-  0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
-  };
-*/
-
-static unsigned freq[LZ_T + 1];     /* frequency table */
-
-/* pointers to parent nodes, except for the elements [LZ_T..LZ_T + N_CHAR - 1]
- * which are used to get the positions of leaves corresponding to the codes.
- */
-static int prnt[LZ_T + N_CHAR];
-
-/* pointers to child nodes (son[], son[] + 1) */
-static int son[LZ_T];
-
-/* for bit/byte reader */
-//unsigned int getbuf=0;
-unsigned char getlen=0;
-
-#define ALLOC_BLOCK_SIZE	32768
-
-static unsigned char *data_in_point,*data_in_max;
-static unsigned char *data_out,*data_out_point;
-static int data_out_len,data_out_allocated;
-
-
-#define rawinput() getc(infd)
-/*
-static int rawinput(void)
-{
-if(data_in_point<data_in_max)
-  return(*data_in_point++);
-return(-1);
-}*/
-
-
-#ifdef Z80
-void rawoutput(int byte) __z88dk_fastcall
-#else
-void rawoutput(int byte)
-#endif
-{
-	putc(byte,outfd);
-	checksum+=byte;
-}
-
-/*
-static void rawoutput(int byte)
-{
-if(data_out_len>=data_out_allocated)
-  {
-  data_out_allocated+=ALLOC_BLOCK_SIZE;
-  if((data_out=realloc(data_out,data_out_allocated))==NULL)
-    fprintf(stderr,"lbrate: out of memory!\n"),exit(1);
-  data_out_point=data_out+data_out_len;
-  }
-
-*data_out_point++=byte;
-data_out_len++;
-checksum+=byte;
-}*/
-
-static int lz_getbit(void)
-{
-int i;
-
-while (getlen <= 8)
-  {
-  if ((lastchar = i = rawinput()) < 0) i = 0;
-  getbuf |= i << (8 - getlen);
-  getlen += 8;
-  }
-i = getbuf;
-getbuf <<= 1;
-getlen--;
-return ((i&0x8000)?1:0);
-}
-
-static int getbyte(void)
-{
-int i;
-
-while (getlen <= 8)
-  {
-  if ((lastchar = i = rawinput()) < 0) i = 0;
-  getbuf |= i << (8 - getlen);
-  getlen += 8;
-  }
-i = getbuf;
-getbuf <<= 8;
-getlen -= 8;
-return ((i >> 8)&255);
-}
-
-
-
-/* initialization of tree */
-
-void start_huff(void)
-{
-int i, j;
-
-for (i = 0; i < N_CHAR; i++)
-  {
-  freq[i] = 1;
-  son[i] = i + LZ_T;
-  prnt[i + LZ_T] = i;
-  }
-i = 0; j = N_CHAR;
-while (j <= LZ_R)
-  {
-  freq[j] = freq[i] + freq[i + 1];
-  son[j] = i;
-  prnt[i] = prnt[i + 1] = j;
-  i += 2; j++;
-  }
-freq[LZ_T] = 0xffff;
-prnt[LZ_R] = 0;
-}
-
-
-/* reconstruction of tree */
-
-void reconst(void)
-{
-int i, j, k;
-unsigned f;
-
-/* collect leaf nodes in the first half of the table */
-/* and replace the freq by (freq + 1) / 2. */
-j = 0;
-for (i = 0; i < LZ_T; i++)
-  {
-  if (son[i] >= LZ_T)
-    {
-    freq[j] = (freq[i] + 1) / 2;
-    son[j] = son[i];
-    j++;
-    }
-  }
-
-/* begin constructing tree by connecting sons */
-for (i = 0, j = N_CHAR; j < LZ_T; i += 2, j++)
-  {
-  k = i + 1;
-  f = freq[j] = freq[i] + freq[k];
-  for (k = j - 1; f < freq[k]; k--);
-  k++;
-  memmove(freq+k+1,freq+k,(j-k)*sizeof(freq[0]));
-  freq[k]=f;
-  memmove(son+k+1,son+k,(j-k)*sizeof(son[0]));
-  son[k]=i;
-  }
-
-/* connect prnt */
-for (i = 0; i < LZ_T; i++)
-  {
-  if ((k = son[i]) >= LZ_T)
-    prnt[k] = i;
-  else
-    prnt[k] = prnt[k + 1] = i;
-  }
-}
-
-
-/* increment frequency of given code by one, and update tree */
-
-void lzupdate(int c)
-{
-int i, j, k, l;
-
-if (freq[LZ_R] == MAX_FREQ)
-  reconst();
-
-c = prnt[c + LZ_T];
-do
-  {
-  k = ++freq[c];
-
-  /* if the order is disturbed, exchange nodes */
-  if (k > freq[l = c + 1])
-    {
-    while (k > freq[++l]);
-    l--;
-    freq[c] = freq[l];
-    freq[l] = k;
-
-    i = son[c];
-    prnt[i] = l;
-    if (i < LZ_T) prnt[i + 1] = l;
-
-    j = son[l];
-    son[l] = i;
-
-    prnt[j] = c;
-    if (j < LZ_T) prnt[j + 1] = c;
-    son[c] = j;
-
-    c = l;
-    }
-  }
-while ((c = prnt[c]) != 0);   /* repeat up to root */
-}
-
-
-int decode_char(void)
-{
-unsigned c;
-
-c = son[LZ_R];
-
-/* travel from root to leaf,
- * choosing the smaller child node (son[]) if the read bit is 0,
- * the bigger (son[]+1) if 1.
- */
-while (c < LZ_T)
-  {
-  c += lz_getbit();
-  c = son[c];
-  }
-c -= LZ_T;
-lzupdate(c);
-return c;
-}
-
-int decode_position(void)
-{
-int i, j, c;
-
-/* recover upper bits from table */
-i = getbyte()-32;
-c=0; j=3;
-if (i>=0) {
-	j++;
-	c = (int)d_code[i];
-	if (c>0x03) j++;
-	if (c>0x0B) j++;
-	if (c>0x17) j++;
-	if (c>0x2F) j++;
-	//else j = d_len[i-48];
-	c = c << (5+oldver);	/* 5, or 6 for 1.x */
-}
-
-/* read lower bits verbatim */
-j -= 3-oldver;				/* 3, or 2 for 1.x */
-while (j--)
-  {
-  i = (i << 1) + lz_getbit();
-  }
-return c | (i & (oldver?0x3f:0x1f));	/* 0x1f, or 0x3f for 1.x */
-}
-
-
-
-// #define READ_WORD(x) (x)=rawinput(),(x)|=(rawinput()<<8)
-
-
-
-
-#ifdef Z80
-void unlzh(char *infile) __z88dk_fastcall
-#else
-void unlzh(char *infile)
-#endif
-{
-int c,v,checktype;
-unsigned int orig_checksum;
-int i,j,k,r;
-
-	if(!(infd=fopen(infile, "rb"))) {
-		//printf("Can't open %s\n", infile);
-		return;
-	}
-	
-	//READ_WORD(magic);
-	/* Process header */
-	if(getx16() != MAGIC_LZH) {
-		//printf(" not a compressed file\n");
-		fclose(infd);
-		return;
-	}
-
-	//filecrc = getw16();
-
-	getfilename();
-	printf(": lzh,");
-	
-	if(!(outfd=fopen(outfile, "wb"))) {
-		printf("Can't create %s\n", outfile);
-		fclose(infd);
-		fclose(outfd);
-		return;
-	}
-
-	
-	/* four info bytes */
-	rawinput();
-	oldver=((v=rawinput())<0x20?1:0);
-	checktype=rawinput();
-	rawinput();
-
-	getbuf=0;
-	getlen=0;
-	checksum=0;
-
-	start_huff();
-
-	r=LZ_N-LZ_F;
-	memset(text_buf,32,r);
-
-	while((c=decode_char())!=256)	/* 256 = EOF */
-	  {
-	  if(c<256)
-		{
-		rawoutput(c);
-		text_buf[r++] = c;
-		r&=(LZ_N-1);
-		}
-	  else
-		{
-		i=(r-decode_position()-1)&(LZ_N-1);
-		j=c-256+THRESHOLD;
-		for (k = 0; k < j; k++)
-		  {
-		  c=text_buf[(i+k)&(LZ_N-1)];
-		  rawoutput(c);
-		  text_buf[r++]=c;
-		  r&=(LZ_N-1);
-		  }
-		}
-	  }
-
-	/* lastchar junk is needed because bit(/byte) reader reads a byte
-	 * in advance.
-	 */
-	orig_checksum=lastchar;
-	orig_checksum+=256*rawinput();
-
-	/* see how the checksum turned out */
-	#ifndef Z80
-	checksum&=0xffff;
-	#endif
-	if(checktype==0 && checksum!=orig_checksum)
-	  {
-			printf("***** checksum error\n");
-	  } else {
-			fclose(infd);
-			remove(infile);
-			printf(" done.");
-	  }
-
-	fclose(outfd);
-	fclose(infd);
-}
-
-#endif // UNLZH
-
-
-
-// ------------------------------------------------------------------------------------------
-
-/*  USQ function extracted from source version 3.2, 23/03/2012
-	..in turn derived from the historical version 3.1 (12/19/84)  */
-
-#ifdef USQ
-
-
-#define SPEOF 256	/* special endfile token */
-#define NUMVALS 257	/* 256 data values plus SPEOF*/
-
-#define ERROR -1
-#define DLE 0x90
-#define RECOGNIZE 0xFF76	/* unlikely pattern */
-
-#define LARGE 30000
-
-unsigned int crc;	/* error check code */
-
-#ifdef	HAVE_CALLOC
-struct {
-	int children[2];	/* left, right */
-} *dnode;
-#else
-/* Decoding tree */
-struct {
-	int children[2];	/* left, right */
-} dnode[NUMVALS - 1];
-#endif
-
-int bpos;	/* last bit position read */
-int curin;	/* last byte value read */
-
-/* Variables associated with repetition decoding */
-int repct;	/*Number of times to retirn value*/
-int value;	/*current byte value or EOF */
-
-/* This must follow all include files */
-unsigned int dispcnt;	/* How much of each file to preview */
-char	ffflag;		/* should formfeed separate preview from different files */
-
-
-
-
-/* Decode file stream into a byte level code with only
- * repetition encoding remaining.
- */ 
-int getuhuff()
-{
-	int i;
-
-	/* Follow bit stream in tree to a leaf*/
-	i = 0;	/* Start at root of tree */
-	do {
-		if(++bpos > 7) {
-			if((curin = getc(infd)) == ERROR)
-				return ERROR;
-			bpos = 0;
-			/* move a level deeper in tree */
-			i = dnode[i].children[1 & curin];
-		} else
-			i = dnode[i].children[1 & (curin >>= 1)];
-	} while(i >= 0);
-
-	/* Decode fake node index to original data value */
-	i = -(i + 1);
-	/* Decode special endfile token to normal EOF */
-	i = (i == SPEOF) ? EOF : i;
-	return i;
-}
-
-/* Get bytes with decoding - this decodes repetition,
- * calls getuhuff to decode file stream into byte
- * level code with only repetition encoding.
- *
- * The code is simple passing through of bytes except
- * that DLE is encoded as DLE-zero and other values
- * repeated more than twice are encoded as value-DLE-count.
- */
-int getcr()
-{
-	int c;
-
-	if(repct > 0) {
-		/* Expanding a repeated char */
-		--repct;
-		return value;
-	} else {
-		/* Nothing unusual */
-		if((c = getuhuff()) != DLE) {
-			/* It's not the special delimiter */
-			value = c;
-			if(value == EOF)
-				repct = LARGE;
-			return value;
-		} else {
-			/* Special token */
-			if((repct = getuhuff()) == 0)
-				/* DLE, zero represents DLE */
-				return DLE;
-			else {
-				/* Begin expanding repetition */
-				repct -= 2;	/* 2nd time */
-				return value;
-			}
-		}
-	}
-}
-
-
-#ifdef Z80
-void unsqueeze(char *infile) __z88dk_fastcall
-#else
-void unsqueeze(char *infile)
-#endif
-{
-	int i, c;
-	char cc;
-
-	unsigned int filecrc;	/* checksum */
-	int numnodes;		/* size of decoding tree */
-	unsigned int linect;	/* count of number of lines previewed */
-	char obuf[128];		/* output buffer */
-	int oblen;		/* length of output buffer */
-	static char errmsg[] = "ERROR - write failure in %s\n";
-
-#ifdef	HAVE_CALLOC
-	dnode=calloc((size_t) NUMVALS, sizeof(dnode));
-	if (!dnode) { 
-		printf(" -->  out of memory");
-		return;
-		}
-#endif
-
-	if(!(infd=fopen(infile, "rb"))) {
-		//printf("Can't open %s\n", infile);
-		return;
-	}
-	/* Initialization */
-	linect = 0;
-	crc = 0;
-	repct = 0;		/* initialize decoding functions */
-	bpos = 99;		/* force initial read */
-
-	/* Process header */
-	if(getx16() != RECOGNIZE) {
-		//printf(" is not a squeezed file\n");
-		goto closein;
-	}
-
-	filecrc = getw16();
-
-	/* Get original file name */
-	
-	//ptr = outfile;			/* send it to array */
-	/*do {
-		*ptr = getc(infd);
-	} while(*ptr++ != '\0');
-	
-	printf(" -> %s: ", outfile);*/
-	
-	getfilename();
-
-	numnodes = getw16();
-
-	if(numnodes < 0 || numnodes >= NUMVALS) {
-		printf("%s has invalid decode tree size\n", infile);
-		goto closein;
-	}
-
-	/* Initialize for possible empty tree (SPEOF only) */
-	dnode[0].children[0] = -(SPEOF + 1);
-	dnode[0].children[1] = -(SPEOF + 1);
-
-	/* Get decoding tree from file */
-	for(i = 0; i < numnodes; ++i) {
-		dnode[i].children[0] = getw16();
-		dnode[i].children[1] = getw16();
-	}
-
-	if(dispcnt) {
-		/* Use standard output for previewing */
-		putchar('\n');
-		while(((c = getcr(infd)) != EOF) && (linect < dispcnt)) {
-			cc = 0x7f & c;	/* strip parity */
-			if((cc < ' ') || (cc > '~'))
-				/* Unprintable */
-				switch(cc) {
-				case '\r':	/* return */
-					/* newline will generate CR-LF */
-					goto next;
-				case '\n':	/* newline */
-					++linect;
-				case '\f':	/* formfeed */
-				case '\t':	/* tab */
-					break;
-				default:
-					cc = '.';
-				}
-			putchar(cc);
-		next: ;
-		}
-		if(ffflag)
-			putchar('\f');	/* formfeed */
-	} else {
-		/* Create output file */
-		if(!(outfd=fopen(outfile, "wb"))) {
-			printf("Can't create %s\n", outfile);
-			goto closeall;
-		}
-		printf(": sq,");
-		/* Get translated output bytes and write file */
-		oblen = 0;
-		while((c = getcr(infd)) != EOF) {
-			crc += c;
-			obuf[oblen++] = c;
-			if (oblen >= sizeof(obuf)) {
-				if(!fwrite(obuf, sizeof(obuf), 1, outfd)) {
-					printf(errmsg, outfile);
-					goto closeall;
-				}
-				oblen = 0;
-			}
-		}
-		if (oblen && !fwrite(obuf, oblen, 1, outfd)) {
-			printf(errmsg, outfile);
-			goto closeall;
-		}
-
-#ifdef Z80
-		if(filecrc != crc )
-#else
-		if((filecrc && 0xFFFF) != (crc && 0xFFFF))
-#endif
-			printf("***** checksum error\n");
-		else {
-			fclose(infd);
-			remove(infile);
-			printf(" done.");
-		}
-
-	closeall:
-		fclose(outfd);
-	}
-
-closein:
-	fclose(infd);
-#ifdef HAVE_CALLOC
-	free(dnode);
-#endif
-}
-
-
-#endif  // USQ
-
-
-
-
-// ------------------------------------------------------------------------------------------
-
-
-#ifdef UNCRUNCH
-
-/*Macro definition - ensure letter is lower case*/
-//#define tolower(c) (((c)>='A' && (c)<='Z')?(c)-('A'-'a'):(c))
-
-#define TABLE_SIZE  4096	/*size of main lzw table for 12 bit codes*/
-#define XLATBL_SIZE 5003	/*size of physical translation table*/
-
-/*special values for predecessor in table*/
-#define NOPRED 0x6fff		/*no predecessor in table*/
-#define EMPTY  0x8000		/*empty table entry (xlatbl only)*/
-#define REFERENCED 0x2000	/*table entry referenced if this bit set*/
-#define IMPRED 0x7fff		/*impossible predecessor*/
-
-#define EOFCOD 0x100		/*special code for end-of-file*/
-#define RSTCOD 0x101		/*special code for adaptive reset*/
-#define NULCOD 0x102		/*special filler code*/
-#define SPRCOD 0x103		/*spare special code*/
-
-#define REPEAT_CHARACTER 0x90	/*following byte is repeat count*/
-
-#ifdef	HAVE_CALLOC
-
-  /*main lzw table and it's structure*/
-  struct entry {
-	int predecessor;	/*index to previous entry, if any*/
-	unsigned char suffix;		/*character suffixed to previous entries*/
-  } *lzw_table;
-  
-  /*auxilliary physical translation table*/
-  /*translates hash to main table index*/
-  unsigned int *xlatbl;
-
-  /*byte string stack used by decode*/
-  unsigned char *stack;
-
-#else
-
-  struct entry {
-	int predecessor;	/*index to previous entry, if any*/
-	unsigned char suffix;	/*character suffixed to previous entries*/
-  } lzw_table[TABLE_SIZE];
-
-  /*auxilliary physical translation table*/
-  /*translates hash to main table index*/
-  unsigned int xlatbl[XLATBL_SIZE];
-
-  /*byte string stack used by decode*/
-  unsigned char stack[TABLE_SIZE];
-
-#endif
-
-/*other global variables*/
-unsigned char	codlen;		/*variable code length in bits (9-12)*/
-int	trgmsk;			/*mask for codes of current length*/
-unsigned char	fulflg;		/*full flag - set once main table is full*/
-int	entry;			/*next available main table entry*/
-long	cr_getbuf;			/*buffer used by getcode*/
-int	getbit;			/*residual bit counter used by getcode*/
-unsigned char	entflg; 	/*inhibit main loop from entering this code*/
-unsigned char	repeat_flag;	/*so send can remember if repeat required*/
-int	finchar;		/*first character of last substring output*/
-int	lastpr;			/*last predecessor (in main loop)*/
-int	cksum;			/*checksum of all bytes written to output file*/
-
-
-
-/*hash pred/suff into xlatbl pointer*/
-/*duplicates the hash algorithm used by CRUNCH 2.3*/
-unsigned int *hash(int pred,int suff,int *disploc)
-	{
-	unsigned int hashval;
-	
-	hashval=((((pred>>4) & 0xff) ^suff) | ((pred&0xf)<<8)) + 1;
-	*disploc=hashval-XLATBL_SIZE;
-	return (xlatbl + hashval);
-	}
-
-
-/*find an empty entry in xlatbl which hashes from this predecessor/suffix*/
-/*combo, and store the index of the next available lzw table entry in it*/
-void figure(int pred, int suff)
-	{
-	//unsigned int *hash(int pred,int suff,int *disploc);
-	auto int disp;
-	unsigned int *p;
-	p=hash(pred,suff,&disp);
-
-	/*follow secondary hash chain as necessary to find an empty slot*/
-#ifdef Z80
-	while((*p) != EMPTY)
-#else
-	while(((*p)&0xffff) != EMPTY)
-#endif
-		{
-		p+=disp;
-		if(p<xlatbl || p > xlatbl+XLATBL_SIZE)
-			p+=XLATBL_SIZE;
-		}
-
-	/*stuff next available index into this slot*/
-	*p=entry;
-	}
-
-
-
-/*enter the next code into the lzw table*/
-void enterx(int pred, int suff)
-/* int pred;		table index of predecessor*/
-/* int suff;		suffix byte represented by this entry*/
-	{
-	register struct entry *ep;
-	ep = &lzw_table[entry];
-
-
-	/*update xlatbl to point to this entry*/
-	figure(pred,suff);
-
-	/*make the new entry*/
-	ep->predecessor = (int)pred;
-	ep->suffix = (unsigned char)suff;
-	entry++;
-
-	/*if only one entry of the current code length remains, update to*/
-	/*next code length because main loop is reading one code ahead*/
-	if(entry >= trgmsk)
-		{
-		if(codlen<12)
-			{
-			/*table not full, just make length one more bit*/
-			codlen++;
-			trgmsk=(trgmsk<<1)|1;
-			}
-		else
-			{
-			/*table almost full (fulflg==0) or full (fulflg==1)*/
-			/*just increment fulflg - when it gets to 2 we will*/
-			/*never be called again*/
-			fulflg++;
-			}
-		}
-	}
-
-
-
-/*initialize the lzw and physical translation tables*/
-void initb2()
-	{
-	register int i;
-	register struct entry *p;
-	p=lzw_table;
-
-	/*first mark all entries of xlatbl as empty*/
-	for(i=0;i<XLATBL_SIZE;i++) xlatbl[i]=EMPTY;
-
-	/*enter atomic and reserved codes into lzw table*/
-	for(i=0;i<0x100;i++) enterx(NOPRED,i);	/*first 256 atomic codes*/
-	for(i=0;i<4;i++) enterx(IMPRED,0);	/*reserved codes*/
-	}
-	
-
-
-
-
-/*initialize variables for each file to be uncrunched*/
-void intram()
-	{
-	trgmsk=0x1ff;	/*nine bits*/
-	codlen=9;	/*    "    */
-	fulflg=0;	/*table empty*/
-	entry=0;	/*    "      */
-	getbit=0;	/*buffer emtpy*/
-	entflg=1;	/*first code always atomic*/
-	repeat_flag=0;	/*repeat not active*/
-	cksum=0;	/*zero checsum*/
-	cr_getbuf=0;
-	}
-
-
-/*return a code of length "codlen" bits from the input file bit-stream*/
-unsigned int getcode()
-	{
-	register int hole;
-	int code;
-
-	/*always get at least a byte*/
-	cr_getbuf=(cr_getbuf<<codlen)|(((long)getc(infd))<<(hole=codlen-getbit));
-	getbit=8-hole;
-
-	/*if is not enough to supply codlen bits, get another byte*/
-	if(getbit<0)
-		{
-		cr_getbuf |= ((long)getc(infd))<<(hole-8);
-		getbit+=8;
-		}
-
-	if(feof(infd))
-		{
-		printf("***** Unexpected EOF !\n");
-		return EOFCOD;
-		}
-
-	/*skip spare or null codes*/
-	if((code=((cr_getbuf>>8) & trgmsk)) == NULCOD || code == SPRCOD)
-		{
-		return getcode();	/*skip this code, get next*/
-		}
-
-	return code;
-	}
-
-
-/*write a byte to output file*/
-/*repeat byte (0x90) expanded here*/
-/*checksumming of output stream done here*/
-#ifdef Z80
-void send(unsigned char c) __z88dk_fastcall
-#else
-void send(unsigned char c)
-#endif
-	{
-	static unsigned char savec;	/*previous byte put to output*/
-
-	/*repeat flag may have been set by previous call*/
-	if(repeat_flag)
-		{
-
-		/*repeat flag was set - emit (c-1) copies of savec*/
-		/*or (if c is zero), emit the repeat byte itself*/
-		repeat_flag=0;
-		if(c)
-			{
-			cksum+=(savec&0xff)*(c-1);
-			while(--c){
-				putc(savec,outfd);
-			}
-			}
-		else
-			{
-			putc(REPEAT_CHARACTER,outfd);
-			cksum+=REPEAT_CHARACTER;
-			}
-		}
-	else
-		{
-		/*normal case - emit c or set repeat flag*/
-		if(c==REPEAT_CHARACTER)
-			{
-			repeat_flag++;
-			}
-		else
-			{
-			putc(savec=c,outfd);
-			cksum+=(c&0xff);
-			}
-		}
-	}
-	
-
-/*decode this code*/
-#ifdef Z80
-int decode(int code) __z88dk_fastcall
-#else
-int decode(int code)
-#endif
-	{
-	register unsigned char *stackp;		/*byte string stack pointer*/
-	register struct entry *ep;
-	ep = &lzw_table[code];
-
-	if(code>=entry)
-		{
-		/*the ugly exception, "WsWsW"*/
-		entflg=1;
-		enterx(lastpr,finchar);
-		}
-
-	/*mark corresponding table entry as referenced*/
-	ep->predecessor |= REFERENCED;
-
-	/*walk back the lzw table starting with this code*/
-	stackp=stack;
-	while(ep > &lzw_table[255]) /*i.e. code not atomic*/
-		{
-		*stackp++ = ep->suffix;
-		ep = &lzw_table[(ep->predecessor)&0xfff];
-		}
-
-	/*then emit all bytes corresponding to this code in forward order*/
-	send(finchar=(ep->suffix)&0xff); /*first byte*/
-
-	while(stackp > stack)		 /*the rest*/
-		{
-		send(*--stackp);
-		}
-
-	return(entflg);
-	}
-
-
-
-
-/*attempt to reassign an existing code which has*/
-/*been defined, but never referenced*/
-void entfil(int pred, int suff)
-/* int pred;		table index of predecessor*/
-/* int suff;		suffix byte represented by this entry*/
-	{
-	auto int disp;
-	register struct entry *ep;
-	//unsigned int *hash(int pred,int suff,int *disploc);
-	unsigned int *p;
-	p=hash(pred,suff,&disp);
-
-	/*search the candidate codes (all those which hash from this new*/
-	/*predecessor and suffix) for an unreferenced one*/
-	while(*p!=(int)EMPTY){
-
-		/*candidate code*/
-		ep = &lzw_table[*p];
-		if(((ep->predecessor)&REFERENCED)==0){
-			/*entry reassignable, so do it!*/
-			ep->predecessor=pred;
-			ep->suffix=suff;
-			/*discontinue search*/
-			break;
-		}
-
-		/*candidate unsuitable - follow secondary hash chain*/
-		/*and keep searching*/
-		p+=disp;
-		if(p<xlatbl || p > xlatbl+XLATBL_SIZE)
-			p+=XLATBL_SIZE;
-	}
-}
-
-
-
-
-/*uncrunch a single file*/
-#ifdef Z80
-void uncrunch(char *filename) __z88dk_fastcall
-#else
-void uncrunch(char *filename)
-#endif
-	{
-	//int c;			
-	unsigned char *p;
-	//char *cisubstr();
-	int pred;			/*current predecessor (in main loop)*/
-	unsigned char reflevel;		/*ref rev level from input file*/
-	unsigned char siglevel;		/*sig rev level from input file*/
-	unsigned char errdetect;	/*error detection flag from input file*/
-	int file_cksum;		/*checksum read from input file*/
-
-	/*initialize variables for uncrunching a file*/
-	intram();
-	
-#ifdef	HAVE_CALLOC
-	lzw_table=calloc((size_t) TABLE_SIZE, sizeof(lzw_table));
-	if (!lzw_table) {
-		printf(" -->  out of memory");
-		return;
-		}
-	xlatbl=calloc((size_t)XLATBL_SIZE, (size_t)sizeof(int));
-	if (!xlatbl) {
-		printf(" -->  out of memory");
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-#endif
-		return;
-		}
-	stack = calloc((size_t)TABLE_SIZE, (size_t)sizeof(char));
-	if (!stack) {
-		printf(" -->  out of memory");
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-		free(xlatbl);
-#endif
-		return;
-		}
-#endif
-
-	/*open input file*/
-	if ( 0 == (infd = fopen(filename,"rb")) )
-		{
-		printf("***** can't open %s\n", filename);
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-		free(xlatbl);
-		free(stack);
-#endif
-		return;
-		}
-
-	/*verify this is a crunched file*/
-	
-	if(getx16() != MAGIC_UNCR) {
-		//printf(" not a compressed file\n");
-		fclose(infd);
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-		free(xlatbl);
-		free(stack);
-#endif
-		return;
-	}
-
-
-	/*extract, build and print output file name*/
-	getfilename();
-	printf(": lzw,");
-
-	/*open output file*/
-	if ( 0 == (outfd =fopen( outfile,"wb")) )
-		{
-		printf("***** can't create %s\n",outfile);
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-		free(xlatbl);
-		free(stack);
-#endif
-		return;
-		}
-
-	/*read the four info bytes*/
-	reflevel=getc(infd);
-	siglevel=getc(infd);
-	errdetect=getc(infd);
-	getc(infd); /*skip spare*/
-
-	/*make sure we can uncrunch this format file*/
-	/*note: this program does not support CRUNCH 1.x format*/
-	if(siglevel < 0x20 || siglevel > 0x2f)
-		{
-		printf("***** this version of UNCR cannot process %s!\n",
-			filename);
-#ifdef HAVE_CALLOC
-		free(lzw_table);
-		free(xlatbl);
-		free(stack);
-#endif
-		return;
-		}
-
-	/*set up atomic code definitions*/
-	initb2();
-
-	/*main decoding loop*/
-	pred=NOPRED;
-	for(;;)
-		{
-		/*remember last predecessor*/
-		lastpr=pred;
-
-		/*read and process one code*/
-		if((pred=getcode())==EOFCOD) /*end-of-file code*/
-			{
-			break; /*all lzw codes read*/
-			}
-
-		else if(pred==RSTCOD) /*reset code*/
-			{
-			entry=0;
-			fulflg=0;
-			codlen=9;
-			trgmsk=0x1ff;
-			pred=NOPRED;
-			entflg=1;
-			initb2();
-			}
-
-		else /*a normal code (nulls already deleted)*/
-			{
-			/*check for table full*/
-			if(fulflg!=2)
-				{
-				/*strategy if table not full*/
-				if(decode(pred)==0)enterx(lastpr,finchar);
-				else entflg=0;
-				}
-			else
-				{
-				/*strategy if table is full*/
-				decode(pred);
-				entfil(lastpr,finchar); /*attempt to reassign*/
-				}
-			}
-		}
-
-	/*verify checksum if required*/
-	if(errdetect==0)
-		{
-		file_cksum=getc(infd);
-		file_cksum|=getc(infd)<<8;
-#ifdef Z80
-		if(file_cksum!=cksum)
-#else
-		if(file_cksum!=(cksum & (0xffff)))
-#endif
-			{
-			printf("***** checksum error\n");
-			} else {
-				fclose(infd);
-				remove(filename);
-				printf(" done.");
-			}
-		}
-
-	/*close files*/
-	fclose(infd);
-	fclose(outfd);
-
-	/*all done this file*/
-#ifdef HAVE_CALLOC
-	free(lzw_table);
-	free(xlatbl);
-	free(stack);
-#endif
-	return;
-	}
-	
-#endif  // UNCRUNCH
-
-
-
-
 // ------------------------------------------------------------------------------------------
 
 
@@ -1456,7 +132,13 @@ void uncrunch(char *filename)
 #define DELETED 0xfe
 #define CTRLZ	0x1a
 
+#ifdef Z80
 #define MAXFILES 64
+#define DHASH	 64
+#else
+#define MAXFILES 1024
+#define DHASH	 1024	/* hash chains in the directory index, a power of 2 */
+#endif
 #define SECTOR	 128
 #define DSIZE	( sizeof(struct ludir) )
 
@@ -1476,7 +158,7 @@ bool ftouched[MAXFILES];
 #ifdef Z80
 #define word unsigned int
 #define wtoi (unsigned int)
-#define itow (unsigned int)
+#define itow(dst,src)	dst = (src)
 #else
 typedef struct {
     unsigned char   lobyte;
@@ -1517,6 +199,21 @@ struct ludir {			/* Internal library ldir structure */
     char    l_fill[16];		/*  pad to 32 bytes */
 } ldir[MAXFILES];
 
+/* Directory index: the active members hashed by name, so that the names */
+/* on the command line are found without a pass over ldir for each one */
+int	dhead[DHASH];		/* first slot of each chain, 0 ends a chain */
+int	dnext[MAXFILES];	/* next slot on the same chain */
+bool	lsel[MAXFILES];		/* slot picked by the command line */
+int	freeslot;		/* no unused slot below this one */
+unsigned int oldoff[MAXFILES], oldlen[MAXFILES];	/* members as read */
+
+/* sectors in use, sorted by offset to find the holes between the members */
+struct extent {
+    unsigned int off, end;
+    int	    slot;
+} ext[2 * MAXFILES];
+int	numext;
+
 
 int     errcnt, nfiles, nslots;
 bool	verbose = false;
@@ -1528,7 +225,7 @@ char	*cmdname;
 
 /* print error message and exit */
 void help () {
-    fprintf (stderr, "Usage: %s {utepdr}[v] library [files] ...\n", cmdname);
+    fprintf (stderr, "Usage: %s {utepdrc}[v] library [files] ...\n", cmdname);
     fprintf (stderr, "Functions are:\n");
 #ifndef NOEDIT
 	fprintf (stderr, "\tu - Update, add files to library\n");
@@ -1539,6 +236,7 @@ void help () {
 #ifndef NOEDIT
     fprintf (stderr, "\td - Delete files in library\n");
     fprintf (stderr, "\tr - Reorganize library\n");
+    fprintf (stderr, "\tc - Compact library in place\n");
 #endif
     fprintf (stderr, "Flags are:\n\tv - Verbose\n");
     exit (1);
@@ -1571,31 +269,135 @@ void cant (char *name)
     //extern int  errno;
     //extern char *sys_errlist[];
 
-    fprintf (stderr, "Cannot open file :%s\n", name);
-    exit (1);
+    fprintf (stderr, "Cannot open file :%s\n", name);
+    exit (1);
+}
+
+
+/* Get file names, check for dups, and initialize */
+void filenames (int ac, char **av)
+{
+    register int    i, j;
+
+    errcnt = 0;
+    for (i = 0; i < ac - 3; i++) {
+	if (i == MAXFILES - 1)
+	    error ("Too many file names.");
+	fname[i] = av[i + 3];
+	ftouched[i] = false;
+    }
+    fname[i] = NULL;
+    nfiles = i;
+    for (i = 0; i < nfiles; i++)
+	for (j = i + 1; j < nfiles; j++)
+	    if (equal (fname[i], fname[j])) {
+		fprintf (stderr, "%s", fname[i]);
+		error (": duplicate file name");
+	    }
+}
+
+
+/* convert nm.ex to a Unix style string in namebuf */
+char *namecpy (char *namebuf, char *nm, char *ex)
+{
+    register char  *cp, *dp;
+
+    for (cp = namebuf, dp = nm; *dp != ' ' && dp != &nm[8];) {
+#ifdef TOUPPER
+	*cp++ = islower (*dp) ? toupper (*dp) : *dp;
+#else
+	*cp++ = isupper (*dp) ? tolower (*dp) : *dp;
+#endif
+	++dp;
+    }
+    *cp++ = '.';
+
+    for (dp = ex; *dp != ' ' && dp != &ex[3];) {
+#ifdef TOUPPER
+	*cp++ = islower (*dp) ? toupper (*dp) : *dp;
+#else
+	*cp++ = isupper (*dp) ? tolower (*dp) : *dp;
+#endif
+	++dp;
+    }
+
+    *cp = '\0';
+    return namebuf;
+}
+
+
+char *getfname (char *nm, char *ex)
+{
+    static char namebuf[14];
+
+    return namecpy (namebuf, nm, ex);
+}
+
+
+/* hash chain of a name, in the form getfname() gives it */
+#ifdef Z80
+int namehash (char *name) __z88dk_fastcall
+#else
+int namehash (char *name)
+#endif
+{
+    register unsigned int h;
+
+    for (h = 0; *name; name++)
+	h = h * 31 + (unsigned char) *name;
+    return h & (DHASH - 1);
+}
+
+
+/* put slot i on the chain of its name */
+#ifdef Z80
+void dlink (int i) __z88dk_fastcall
+#else
+void dlink (int i)
+#endif
+{
+    register int    h;
+
+    h = namehash (getfname (ldir[i].l_name, ldir[i].l_ext));
+    dnext[i] = dhead[h];
+    dhead[h] = i;
+}
+
+
+/* slot of the active member called name, 0 if there is none */
+#ifdef Z80
+int lookup (char *name) __z88dk_fastcall
+#else
+int lookup (char *name)
+#endif
+{
+    register int    i;
+
+    for (i = dhead[namehash (name)]; i != 0; i = dnext[i])
+	if (ldir[i].l_stat == ACTIVE
+	    && equal (getfname (ldir[i].l_name, ldir[i].l_ext), name))
+	    return i;
+    return 0;
 }
 
 
-/* Get file names, check for dups, and initialize */
-void filenames (int ac, char **av)
+/* index the active members, last first so that each chain is in */
+/* directory order, and note where they are while nothing has moved */
+void indexdir ()
 {
-    register int    i, j;
+    register int    i;
 
-    errcnt = 0;
-    for (i = 0; i < ac - 3; i++) {
-	fname[i] = av[i + 3];
-	ftouched[i] = false;
-	if (i == MAXFILES)
-	    error ("Too many file names.");
+    for (i = 0; i < DHASH; i++)
+	dhead[i] = 0;
+    for (i = nslots - 1; i > 0; i--) {
+	oldlen[i] = 0;
+	if (ldir[i].l_stat == ACTIVE) {
+	    dlink (i);
+	    oldoff[i] = wtoi (ldir[i].l_off);
+	    oldlen[i] = wtoi (ldir[i].l_len);
+	}
     }
-    fname[i] = NULL;
-    nfiles = i;
-    for (i = 0; i < nfiles; i++)
-	for (j = i + 1; j < nfiles; j++)
-	    if (equal (fname[i], fname[j])) {
-		fprintf (stderr, "%s", fname[i]);
-		error (": duplicate file name");
-	    }
+    freeslot = 1;
 }
 
 
@@ -1613,7 +415,8 @@ int entry;
 	error ("No directory\n");
 
     nslots = wtoi (ldir[0].l_len) * SLOTS_SEC;
-	//nslots--;
+    if (nslots > MAXFILES)
+	error ("Too many slots in the library directory");
 	
 /*
     if (fread ((char *) & ldir[1], DSIZE, nslots-1, f) != nslots-1)
@@ -1621,32 +424,90 @@ int entry;
 */
 
 	// workaround for z88dk
-	for (entry=1; entry<=nslots; entry++) {
+	for (entry=1; entry<nslots; entry++) {
 		fread ((char *) & ldir[entry], DSIZE, 1, f);
 	}
-	
+
+    indexdir ();
 }
 
 
-/* filarg - check if name matches argument list */
 #ifdef Z80
-int filarg (char *name) __z88dk_fastcall
+int iswild (char *name) __z88dk_fastcall
 #else
-int filarg (char *name)
+int iswild (char *name)
 #endif
 {
-    register int    i;
+    return strchr (name, '*') != NULL || strchr (name, '?') != NULL;
+}
+
+
+/*
+ * Wildcard comparison, as in usq.c
+ * Found in the BDS C sources, (wildexp..),written by Leor Zolman.
+ */
+int match (char *wildnam, char *filnam)
+{
+   char c;
+   while (c = *wildnam++)
+	if (c == '?')
+		if ((c = *filnam++) && c != '.')
+			continue;
+		else
+			return false;
+	else if (c == '*')
+	{
+		while (c = *wildnam)
+		{ 	wildnam++;
+			if (c == '.') break;
+		}
+		while (c = *filnam)
+		{	filnam++;
+			if (c == '.') break;
+		}
+	}
+	else if (c == *filnam++)
+	 	continue;
+	else return false;
+
+   return *filnam == '\0';
+}
+
 
+/* filarg - pick the members the argument list asks for into lsel[]: */
+/* plain names through the index, wildcards in one pass over ldir */
+void filarg ()
+{
+    register int    i, j;
+    bool    wild = false;
+    char   *uname;
+
+    for (i = 0; i < nslots; i++)
+	lsel[i] = nfiles <= 0 && i > 0 && ldir[i].l_stat == ACTIVE;
     if (nfiles <= 0)
-	return 1;
+	return;
 
-    for (i = 0; i < nfiles; i++)
-	if (equal (name, fname[i])) {
-	    ftouched[i] = true;
-	    return 1;
+    for (j = 0; j < nfiles; j++) {
+	if (iswild (fname[j])) {
+	    wild = true;
+	    continue;
 	}
+	/* all of them, should a damaged library hold a name twice */
+	for (i = dhead[namehash (fname[j])]; i != 0; i = dnext[i])
+	    if (ldir[i].l_stat == ACTIVE
+		&& equal (getfname (ldir[i].l_name, ldir[i].l_ext), fname[j]))
+		lsel[i] = ftouched[j] = true;
+    }
 
-    return 0;
+    if (wild)
+	for (i = 1; i < nslots; i++) {
+	    if (ldir[i].l_stat != ACTIVE)
+		continue;
+	    uname = getfname (ldir[i].l_name, ldir[i].l_ext);
+	    for (j = 0; j < nfiles; j++)
+		if (iswild (fname[j]) && match (fname[j], uname))
+		    lsel[i] = ftouched[j] = true;
+	}
 }
 
 
@@ -1661,36 +522,6 @@ void not_found () {
 }
 
 
-/* convert nm.ex to a Unix style string */
-char *getfname (char *nm, char *ex)
-{
-    static char namebuf[14];
-    register char  *cp, *dp;
-
-    for (cp = namebuf, dp = nm; *dp != ' ' && dp != &nm[8];) {
-#ifdef TOUPPER
-	*cp++ = islower (*dp) ? toupper (*dp) : *dp;
-#else
-	*cp++ = isupper (*dp) ? tolower (*dp) : *dp;
-#endif
-	++dp;
-    }
-    *cp++ = '.';
-
-    for (dp = ex; *dp != ' ' && dp != &ex[3];) {
-#ifdef TOUPPER
-	*cp++ = islower (*dp) ? toupper (*dp) : *dp;
-#else
-	*cp++ = isupper (*dp) ? tolower (*dp) : *dp;
-#endif
-	++dp;
-    }
-
-    *cp = '\0';
-    return namebuf;
-}
-
-
 // used by setfunc(
 int table(char *lib)
 {
@@ -1703,6 +534,7 @@ int table(char *lib)
 	cant (lib);
 
     getdir (lfd);
+    filarg ();
     total = wtoi(ldir[0].l_len);
     if(verbose) {
  	printf("Name          Index Length\n");
@@ -1714,7 +546,7 @@ int table(char *lib)
 	case ACTIVE:
 		active++;
 		uname = getfname(ldir[i].l_name, ldir[i].l_ext);
-		if (filarg (uname))
+		if (lsel[i])
 		    if(verbose)
 			printf ("%-12s   %4d %4d\n", uname,
 			    wtoi (ldir[i].l_off), wtoi (ldir[i].l_len));
@@ -1795,6 +627,7 @@ void initdir (FILE *f)
 	ldir[i] = blankentry;
     ldir[0].l_stat = ACTIVE;
     itow (ldir[0].l_len, numsecs);
+    indexdir ();
 
     putdir (f);
 }
@@ -1822,74 +655,399 @@ void putname (char *cpmname, char *unixname)
 }
 
 
-void acopy (FILE *fdi, FILE *fdo, unsigned int nsecs)
+/* a member being read out of the library */
+struct member {
+    FILE   *lfd;
+    long    pos;		/* where the next read starts */
+    long    left;		/* bytes still to read */
+};
+
+
+void seekmember (struct member *m, FILE *lfd, int i)
+{
+    m->lfd = lfd;
+    m->pos = (long) wtoi (ldir[i].l_off) * SECTOR;
+    m->left = (long) wtoi (ldir[i].l_len) * SECTOR;
+#ifndef PARALLEL
+    VOID fseek (lfd, m->pos, SEEK_SET);
+#endif
+}
+
+
+int mread (struct member *m, unsigned char *buf, int n)
+{
+    if (n > m->left)
+	n = m->left;
+#ifdef PARALLEL
+    /* pread() leaves the file position alone, the workers share the file */
+    if ((n = pread (fileno (m->lfd), buf, n, m->pos)) < 0)
+	n = 0;
+#else
+    n = fread (buf, 1, n, m->lfd);
+#endif
+    m->pos += n;
+    m->left -= n;
+    return n;
+}
+
+
+#ifdef PARALLEL
+#define MSGLEN	192
+#ifdef UNPACK
+#define OUTLEN	UP_NAMELEN
+#else
+#define OUTLEN	14
+#endif
+
+/* what became of a member: the files written for it under a temporary */
+/* name, renamed by the main thread in directory order (see finish()), */
+/* and an error that ends the extraction, left for the main thread too */
+struct report {
+    char    msg[MSGLEN];
+    int     errs;
+    int     nout;
+    char    tmp[2][OUTLEN + 8];
+    char    dst[2][OUTLEN];
+    char    *fatal;
+    bool    done;
+};
+#define fatal(x, str)	((x)->r->fatal = (str))
+#else
+#define MSGLEN	160
+#define fatal(x, str)	error (str)
+#endif
+
+/* what a member is extracted with, one of these per worker */
+struct xstate {
+    char    name[14];
+    unsigned char sector[SECTOR];
+#ifdef UNPACK
+    struct unpack unp;
+    unsigned char upbuf[UP_INSIZE];
+#endif
+#ifdef PARALLEL
+    struct report *r;		/* the member's report */
+    int	    slot;
+#endif
+};
+
+
+/* create an output file for the member */
+FILE *create (struct xstate *x, char *name)
+{
+#ifdef PARALLEL
+    register struct report *r;
+    FILE   *f;
+
+    r = x->r;
+    sprintf (r->tmp[r->nout], "%s.$%d", name, 2 * x->slot + r->nout);
+    if ((f = fopen (r->tmp[r->nout], "wb")) != NULL)
+	strcpy (r->dst[r->nout++], name);
+    return f;
+#else
+    return fopen (name, "wb");
+#endif
+}
+
+
+/* NULL, or what went wrong */
+char *acopy (struct member *m, FILE *fdo, unsigned char *buf)
 {
     register int    i, c;
     int	    textfile = 1;
-
-    while( nsecs-- != 0) 
-	for(i=0; i<SECTOR; i++) {
-		c = getc(fdi);
-		if( feof(fdi) ) 
-			error("Premature EOF\n");
-		if( ferror(fdi) )
-		    error ("Can't read");
-		if( !isascii(c) )
+    unsigned int nsecs;
+
+    nsecs = m->left / SECTOR;
+    while( nsecs-- != 0) {
+	if( mread(m, buf, SECTOR) != SECTOR )
+		return "Premature EOF\n";
+	for(i=0; i<SECTOR; i++)
+		if( !isascii(buf[i]) )
 		    textfile = 0;
-		if( nsecs != 0 || !textfile || c != CTRLZ) {
+	if( nsecs != 0 || !textfile ) {
+		if( fwrite(buf, 1, SECTOR, fdo) != SECTOR )
+		    return "write error";
+		continue;
+	}
+	for(i=0; i<SECTOR; i++)
+		if( (c = buf[i]) != CTRLZ ) {
 			putc(c, fdo);
 			if ( ferror(fdo) )
-			    error ("write error");
+			    return "write error";
 		}
-	 }
+    }
+    return NULL;
+}
+
+
+#ifdef UNPACK
+/* expand a squeezed, crunched or LZH member straight out of the library; */
+/* false if it is not one, or it went wrong, so that it is copied as is */
+bool unpack (struct member *m, struct xstate *x, char *msg, int *errs)
+{
+    FILE *ofd;
+    register char *p;
+    int n;
+
+    ofd = NULL;
+    up_init (&x->unp, UP_AUTO);
+    for (;;) {
+	if ((n = up_drain (&x->unp, x->upbuf, sizeof(x->upbuf))) > 0) {
+	    if (fwrite (x->upbuf, 1, n, ofd) != n) {
+		fatal (x, "write error");
+		VOID fclose (ofd);
+		return true;
+	    }
+	} else if (n == UP_MORE) {
+	    if ((n = mread (m, x->upbuf, up_room (&x->unp))) == 0)
+		up_finish (&x->unp);
+	    up_feed (&x->unp, x->upbuf, n);
+	} else if (n == UP_NAME) {
+	    /* output file name, without what follows the type */
+	    for (p = x->unp.name; *p; p++)
+#ifdef TOUPPER
+		*p = toupper (*p);
+#else
+		*p = tolower (*p);
+#endif
+	    if ((p = strchr (x->unp.name, '.')) != NULL && strlen (p) > 4)
+		p[4] = '\0';
+	    sprintf (msg + strlen (msg), " -> %s: %s,", x->unp.name,
+		x->unp.method == UP_SQ ? "sq" : x->unp.method == UP_CR ? "lzw" : "lzh");
+	    if ((ofd = create (x, x->unp.name)) == NULL) {
+		strcat (msg, "  - can't create");
+		(*errs)++;
+		return true;
+	    }
+	} else
+	    break;
+    }
+
+    if (ofd == NULL)
+	return n != UP_BADFMT;
+    VOID fclose (ofd);
+    if (n == UP_DONE) {
+	strcat (msg, " done.");
+	return true;
+    }
+    strcat (msg, n == UP_BADSUM ? " ***** checksum error, " : " ***** damaged, ");
+    (*errs)++;
+    return false;
+}
+#endif
+
+
+/* extract slot i to a file of its own, expanded if it is compressed; */
+/* the report on it goes to msg, its errors are counted in *errs */
+void getmember (FILE *lfd, int i, struct xstate *x, char *msg, int *errs)
+{
+    FILE *ofd;
+    struct member m;
+    char *err;
+
+    strcpy (msg, namecpy (x->name, ldir[i].l_name, ldir[i].l_ext));
+#ifdef UNPACK
+    seekmember (&m, lfd, i);
+    if (unpack (&m, x, msg, errs))
+	return;
+#endif
+    if ((ofd = create (x, x->name)) == NULL) {
+	strcat (msg, "  - can't create");
+	(*errs)++;
+    } else {
+	seekmember (&m, lfd, i);
+	err = acopy (&m, ofd, x->sector);
+	VOID fclose (ofd);
+#ifdef Z80
+	// extra close() call, to fix z88dk compiled programs behavior
+	VOID fclose (ofd);
+#endif
+	if (err != NULL)
+	    fatal (x, err);
+    }
+}
+
+
+#ifdef PARALLEL
+/* main thread: put a member's files in place, in directory order, so */
+/* that when two members give the same file the later one wins */
+void finish (struct report *r)
+{
+    register int    k;
+
+    for (k = 0; k < r->nout; k++)
+	if (rename (r->tmp[k], r->dst[k]) != 0) {
+	    VOID remove (r->tmp[k]);
+	    sprintf (r->msg + strlen (r->msg), "  - can't create %s", r->dst[k]);
+	    r->errs++;
+	}
+}
+
+
+/* ... or throw them away */
+void discard (struct report *r)
+{
+    register int    k;
+
+    for (k = 0; k < r->nout; k++)
+	VOID remove (r->tmp[k]);
+}
+#endif
+
+
+#ifdef PARALLEL
+/* Parallel extraction: the workers take the chosen slots in directory */
+/* order and read them with pread(), while the main thread renames the */
+/* files and prints the reports in that same order as they become ready. */
+#define MAXWORKERS 16
+
+struct report *reports;
+FILE	*plfd;
+int	nextslot;
+pthread_mutex_t plock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t	pdone = PTHREAD_COND_INITIALIZER;
+
+
+void *worker (void *arg)
+{
+    register struct xstate *x;
+    register int    i;
+
+    x = (struct xstate *) arg;
+    for (;;) {
+	pthread_mutex_lock (&plock);
+	while (nextslot < nslots && !lsel[nextslot])
+	    nextslot++;
+	i = nextslot++;
+	pthread_mutex_unlock (&plock);
+	if (i >= nslots)
+	    return NULL;
+
+	x->r = &reports[i];
+	x->slot = i;
+	getmember (plfd, i, x, reports[i].msg, &reports[i].errs);
+
+	pthread_mutex_lock (&plock);
+	reports[i].done = true;
+	pthread_cond_signal (&pdone);
+	pthread_mutex_unlock (&plock);
+    }
+}
+
+
+/* false when it is not worth it, or no thread could be started */
+bool pgetfiles (FILE *lfd)
+{
+    pthread_t tid[MAXWORKERS];
+    struct xstate *xs[MAXWORKERS];
+    register int    i;
+    int	    nsel, nw, k;
+    long    ncpu;
+
+    for (nsel = 0, i = 1; i < nslots; i++)
+	nsel += lsel[i];
+    if ((ncpu = sysconf (_SC_NPROCESSORS_ONLN)) > MAXWORKERS)
+	ncpu = MAXWORKERS;
+    if (ncpu > nsel)
+	ncpu = nsel;
+    if (ncpu < 2 || (reports = calloc (nslots, sizeof(struct report))) == NULL)
+	return false;
+
+    plfd = lfd;
+    nextslot = 1;
+    for (nw = 0; nw < ncpu; nw++) {
+	if ((xs[nw] = malloc (sizeof(struct xstate))) == NULL)
+	    break;
+	if (pthread_create (&tid[nw], NULL, worker, xs[nw]) != 0) {
+	    free (xs[nw]);
+	    break;
+	}
+    }
+    if (nw == 0) {
+	free (reports);
+	return false;
+    }
+
+    for (i = 1; i < nslots; i++) {
+	if (!lsel[i])
+	    continue;
+	pthread_mutex_lock (&plock);
+	while (!reports[i].done)
+	    pthread_cond_wait (&pdone, &plock);
+	pthread_mutex_unlock (&plock);
+	finish (&reports[i]);
+	if (reports[i].fatal != NULL)
+	    break;
+	fprintf (stderr, "%s\n", reports[i].msg);
+	errcnt += reports[i].errs;
+    }
+
+    /* an error ends it here, as it would a serial run */
+    pthread_mutex_lock (&plock);
+    nextslot = nslots;
+    pthread_mutex_unlock (&plock);
+    while (nw-- > 0) {
+	pthread_join (tid[nw], NULL);
+	free (xs[nw]);
+    }
+    if (i < nslots) {
+	for (k = i + 1; k < nslots; k++)
+	    if (lsel[k] && reports[k].done)
+		discard (&reports[k]);
+	error (reports[i].fatal);
+    }
+    free (reports);
+    return true;
 }
+#endif
 
 
 void getfiles (char *name, bool pflag)
 {
-    FILE *lfd, *ofd;
+    FILE *lfd;
     register int    i;
-    char   *unixname;
+    struct member m;
+    static struct xstate xs;
+#ifdef PARALLEL
+    static struct report r;
+#else
+    static char msg[MSGLEN];
+#endif
+    char *err;
 
     if ((lfd = fopen (name, "rb"))  == NULL)
 	cant (name);
 
-    ofd = pflag ? stdout : NULL;
     getdir (lfd);
+    filarg ();
 
+#ifdef PARALLEL
+    if (pflag || !pgetfiles (lfd))
+#endif
     for (i = 1; i < nslots; i++) {
-	if(ldir[i].l_stat != ACTIVE)
-		continue;
-	unixname = getfname (ldir[i].l_name, ldir[i].l_ext);
-	if (!filarg (unixname))
+	if (!lsel[i])
 	    continue;
-	fprintf(stderr,"%s", unixname);
-	if (ofd != stdout)
-	    ofd = fopen (unixname, "wb");
-	if (ofd == NULL) {
-	    fprintf (stderr, "  - can't create");
-	    errcnt++;
+	if (pflag) {
+	    fprintf(stderr,"%s", getfname (ldir[i].l_name, ldir[i].l_ext));
+	    seekmember (&m, lfd, i);
+	    if ((err = acopy (&m, stdout, xs.sector)) != NULL)
+		error (err);
 	} else {
-	    VOID fseek (lfd, (long) wtoi (ldir[i].l_off) * SECTOR, SEEK_SET);
-	    acopy (lfd, ofd, wtoi (ldir[i].l_len));
-	    if (ofd != stdout) {
-			VOID fclose (ofd);
-#ifdef UNCRUNCH
-			uncrunch(unixname);
-#endif
-#ifdef USQ
-			unsqueeze(unixname);
-#endif
-#ifdef UNLZH
-			unlzh(unixname);
+#ifdef PARALLEL
+	    memset (&r, 0, sizeof(r));
+	    xs.r = &r;
+	    xs.slot = i;
+	    getmember (lfd, i, &xs, r.msg, &r.errs);
+	    finish (&r);
+	    if (r.fatal != NULL)
+		error (r.fatal);
+	    errcnt += r.errs;
+	    fputs (r.msg, stderr);
+#else
+	    getmember (lfd, i, &xs, msg, &errcnt);
+	    fputs (msg, stderr);
 #endif
-
-		}
-		
 	}
-	// extra close() call, to fix z88dk compiled programs behavior
-	if (ofd != stdout)
-		VOID fclose (ofd);
 	putc('\n', stderr);
     }
     VOID fclose (lfd);
@@ -1912,14 +1070,14 @@ int print(char *name)
 
 
 #ifndef NOEDIT
-int fcopy(FILE *ifd, FILE *ofd)
+int fcopy(FILE *ifd, FILE *ofd, int maxsecs)
 {
     int total = 0;
     int i, n;
     char sectorbuf[SECTOR];
 
 
-    while ( (n = fread( sectorbuf, 1, SECTOR, ifd)) != 0) {
+    while ( total < maxsecs && (n = fread( sectorbuf, 1, SECTOR, ifd)) != 0) {
 	if (n != SECTOR)
 	    for (i = n; i < SECTOR; i++)
 		sectorbuf[i] = CTRLZ;
@@ -1931,11 +1089,55 @@ int fcopy(FILE *ifd, FILE *ofd)
 }
 
 
+void addext (unsigned int off, unsigned int len, int slot)
+{
+    if (len != 0) {
+	ext[numext].off = off;
+	ext[numext].end = off + len;
+	ext[numext++].slot = slot;
+    }
+}
+
+
+int extcmp (const void *a, const void *b)
+{
+    unsigned int x = ((struct extent *) a)->off, y = ((struct extent *) b)->off;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/* findhole - first gap between the members where nsecs sectors fit, */
+/* else the end of the last one.  The sectors of the members as they */
+/* were read stay taken: the old directory must still be good should */
+/* the new one not get written. */
+long findhole (unsigned int nsecs)
+{
+    register int    i;
+    long    pos;
+
+    numext = 0;
+    for (i = 1; i < nslots; i++) {
+	if (ldir[i].l_stat == ACTIVE)
+	    addext (wtoi (ldir[i].l_off), wtoi (ldir[i].l_len), i);
+	addext (oldoff[i], oldlen[i], i);
+    }
+    qsort (ext, numext, sizeof(struct extent), extcmp);
+
+    pos = wtoi (ldir[0].l_len);
+    for (i = 0; i < numext && ext[i].off < pos + nsecs; i++)
+	if (ext[i].end > pos)
+	    pos = ext[i].end;
+    return pos;
+}
+
+
 void addfil (char *name, FILE *lfd)
 {
     FILE	*ifd;
     register int secoffs, numsecs;
     register int i;
+    long    pos;
 	
     if ((ifd = fopen (name, "rb")) == NULL) {
 	fprintf (stderr, "%s: can't find to add\n",name);
@@ -1944,25 +1146,37 @@ void addfil (char *name, FILE *lfd)
     }
     if(verbose)
         fprintf(stderr, "%s\n", name);
-    for (i = 0; i < nslots; i++) {
-	if (equal( getfname (ldir[i].l_name, ldir[i].l_ext), name) ) /* update */
-	    break;
-	if (ldir[i].l_stat != ACTIVE)
+    if ((i = lookup (name)) == 0) {		/* new member */
+	for (i = freeslot; i < nslots; i++)
+	    if (ldir[i].l_stat != ACTIVE)
 		break;
+	freeslot = i;
+	if (i >= nslots) {
+	    fprintf (stderr, "%s: can't add library is full\n",name);
+	    errcnt++;
+	    return;
+	}
+	ldir[i].l_stat = ACTIVE;
+	putname (ldir[i].l_name, name);
+	dlink (i);
     }
-    if (i >= nslots) {
+
+    /* into the first hole it fits, else after the last member */
+    VOID fseek(ifd, 0L, SEEK_END);
+    numsecs = (ftell(ifd) + SECTOR - 1) / SECTOR;
+    rewind(ifd);
+    itow (ldir[i].l_len, 0);
+    if ((pos = findhole (numsecs)) + numsecs > 0xffffL) {
 	fprintf (stderr, "%s: can't add library is full\n",name);
 	errcnt++;
+	VOID fclose (ifd);
 	return;
     }
+    secoffs = pos;
 
-    ldir[i].l_stat = ACTIVE;
-    putname (ldir[i].l_name, name);
-    VOID fseek(lfd, 0L, SEEK_END);		/* append to end */
-    secoffs = ftell(lfd) / 128L;
-
+    VOID fseek(lfd, (long) secoffs * SECTOR, SEEK_SET);
     itow (ldir[i].l_off, secoffs);
-    numsecs = fcopy (ifd, lfd);
+    numsecs = fcopy (ifd, lfd, numsecs);
     itow (ldir[i].l_len, numsecs);
     VOID fclose (ifd);
 }
@@ -1974,6 +1188,7 @@ int update(char *name)
     register int    i;
 
     if ((lfd = fopen (name, "r+b")) == NULL) {
+	if ((lfd = fopen (name, "w+b")) == NULL)
 	    cant (name);
 	initdir (lfd);
     }
@@ -2005,11 +1220,12 @@ int del_entry(char *lname)
 	error("Filename to delete from Library was not specified");
 
     getdir (f);
+    filarg ();
 	
-    for (i = 0; i < nslots; i++) {
-        unixnm = getfname (ldir[i].l_name, ldir[i].l_ext);
-	if (!filarg (unixnm))
+    for (i = 1; i < nslots; i++) {
+	if (!lsel[i])
 	    continue;
+        unixnm = getfname (ldir[i].l_name, ldir[i].l_ext);
 	ldir[i].l_stat = DELETED;
 	if (verbose)
 	    printf("Deleted File %s\n",unixnm);
@@ -2121,6 +1337,87 @@ int reorg(char *name)
 	}
 
 }
+
+
+#ifdef Z80
+#define MOVESECS 1
+#else
+#define MOVESECS 64
+#endif
+
+/* move n sectors down the library, from may overlap to */
+void movesecs (FILE *f, unsigned int from, unsigned int to, unsigned int n)
+{
+    static char buf[MOVESECS * SECTOR];
+    register unsigned int k;
+
+    while (n != 0) {
+	k = n < MOVESECS ? n : MOVESECS;
+	VOID fseek (f, (long) from * SECTOR, SEEK_SET);
+	if (fread (buf, SECTOR, k, f) != k)
+	    error ("read error");
+	VOID fseek (f, (long) to * SECTOR, SEEK_SET);
+	if (fwrite (buf, SECTOR, k, f) != k)
+	    error ("write error");
+	from += k;
+	to += k;
+	n -= k;
+    }
+}
+
+
+/* compact - close the holes left by deleted and replaced members within */
+/* the library file: the members below the first hole stay where they */
+/* are, the ones above it slide down.  The directory keeps its size, */
+/* use reorg to change it. */
+// used by setfunc(
+int compact(char *name)
+{
+    FILE *f;
+    register int i;
+    unsigned int pos, len;
+    int moved = 0;
+
+    if ((f = fopen (name, "r+b")) == NULL)
+	cant (name);
+    getdir (f);
+
+    numext = 0;
+    for (i = 1; i < nslots; i++)
+	if (ldir[i].l_stat == ACTIVE)
+	    addext (wtoi (ldir[i].l_off), wtoi (ldir[i].l_len), i);
+	else
+	    ldir[i].l_stat = UNUSED;
+    qsort (ext, numext, sizeof(struct extent), extcmp);
+
+    pos = wtoi (ldir[0].l_len);
+    for (i = 0; i < numext; i++) {
+	if (ext[i].off < pos)
+	    error ("Members overlap - library is damaged");
+	len = ext[i].end - ext[i].off;
+	if (ext[i].off > pos) {
+	    if (verbose)
+		fprintf (stderr, "Moving: %s\n",
+		    getfname (ldir[ext[i].slot].l_name, ldir[ext[i].slot].l_ext));
+	    movesecs (f, ext[i].off, pos, len);
+	    itow (ldir[ext[i].slot].l_off, pos);
+	    putdir (f);		/* a break now spoils this member only */
+	    moved++;
+	}
+	pos += len;
+    }
+    putdir (f);
+
+#ifndef Z80
+    VOID fflush (f);
+    if (ftruncate (fileno (f), (long) pos * SECTOR) != 0)
+	fprintf (stderr, "%s: can't shorten the file\n", name);
+#endif
+    if (fclose (f) == EOF)
+	error ("Can't close the library");
+    if (verbose)
+	printf ("%d members moved, library now %u sectors\n", moved, pos);
+}
 #endif
 
 
@@ -2169,6 +1466,10 @@ int main (int argc, char **argv)
 	case 'R': 
 	    setfunc(reorg);
 	    break;
+	case 'c': 
+	case 'C': 
+	    setfunc(compact);
+	    break;
 #endif
 	case 'v':
 	case 'V':
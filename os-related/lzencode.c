@@ -2,6 +2,10 @@
 /*
 	To build with z88dk:
 	zcc +cpm -create-app -lm -O3 lzencode.c
+
+	'lzencode -s file1 file2' writes the framed streaming format, which
+	is also chosen automatically when file1 is "-" (stdin) or cannot be
+	seeked.  A name of "-" for file2 writes to stdout.
 */
 
 /* +++Date last modified: 05-Jul-1997 */
@@ -37,17 +41,54 @@
 #include <string.h>
 #include <ctype.h>
 
-FILE  *infile, *outfile;
+FILE  *infile, *outfile, *msgfile;
 static unsigned long int  textsize = 0, codesize = 0, printcount = 0;
 
 char wterr[] = "Can't write.";
 
 static void Error(char *message)
 {
-    printf("\n%s\n", message);
+    fprintf(msgfile, "\n%s\n", message);
     exit(EXIT_FAILURE);
 }
 
+/********** framed streaming format **********/
+
+/*
+    A size word of STREAMED means the text length was unknown when
+    encoding began.  The coded text then follows as a series of chunks,
+    each introduced by a 4-byte header: the number of text bytes in the
+    chunk and the number of code bytes after the header, both 16-bit
+    little endian.  The code of every chunk is padded to a byte boundary
+    while the Huffman and LZSS state carries on across chunks.  A header
+    with a text length of zero ends the stream.
+*/
+
+#define STREAMED    0xffffffffL
+#define CHUNK       4096    /* max text bytes in one chunk */
+#define CHUNKBUF    4096    /* max code bytes in one chunk */
+#define CHUNKSLACK  64      /* room for the longest code of one symbol */
+
+static int  framed = 0;
+static unsigned chunkin = 0, chunklen = 0;
+static unsigned char  chunkbuf[CHUNKBUF];
+
+static void PutByte(unsigned c)
+{
+    if (framed) {
+        chunkbuf[chunklen++] = (unsigned char)c;
+    } else if (putc(c & 0xff, outfile) == EOF) {
+        Error(wterr);
+    }
+}
+
+static void PutWord(unsigned w)
+{
+    putc(w & 0xff, outfile);
+    if (putc((w >> 8) & 0xff, outfile) == EOF)
+        Error(wterr);
+}
+
 /********** LZSS compression **********/
 
 #define N       4096    /* buffer size */
@@ -220,13 +261,9 @@ static void Putcode(int l, unsigned c)     /* output c bits of code */
 {
     putbuf |= c >> putlen;
     if ((putlen += l) >= 8) {
-        if (putc(putbuf >> 8, outfile) == EOF) {
-            Error(wterr);
-        }
+        PutByte(putbuf >> 8);
         if ((putlen -= 8) >= 8) {
-            if (putc(putbuf, outfile) == EOF) {
-                Error(wterr);
-            }
+            PutByte(putbuf);
             codesize += 2;
             putlen -= 8;
             putbuf = c << (l - putlen);
@@ -284,7 +321,7 @@ static void reconst(void)
         f = freq[j] = freq[i] + freq[k];
         for (k = j - 1; f < freq[k]; k--);
         k++;
-        l = (j - k) * 2;
+        l = (j - k) * sizeof(freq[0]);   /* freq[] and son[] alike */
         memmove(&freq[k + 1], &freq[k], l);
         freq[k] = f;
         memmove(&son[k + 1], &son[k], l);
@@ -378,13 +415,29 @@ static void EncodePosition(unsigned c)
 static void EncodeEnd(void)
 {
     if (putlen) {
-        if (putc(putbuf >> 8, outfile) == EOF) {
-            Error(wterr);
-        }
+        PutByte(putbuf >> 8);
         codesize++;
     }
 }
 
+/* write out the pending chunk, code padded to a byte boundary */
+
+static void FlushChunk(void)
+{
+    EncodeEnd();
+    putbuf = 0;
+    putlen = 0;
+    if (chunkin == 0)
+        return;
+    PutWord(chunkin);
+    PutWord(chunklen);
+    if (fwrite(chunkbuf, 1, chunklen, outfile) != chunklen)
+        Error(wterr);
+    codesize += 4;
+    chunkin = 0;
+    chunklen = 0;
+}
+
 
 
 /* compression */
@@ -393,8 +446,12 @@ static void Encode(void)  /* compression */
 {
     int  i, c, len, r, s, last_match_length;
 
-    fseek(infile, 0L, 2);
-    textsize = ftell(infile);
+    if (framed || fseek(infile, 0L, 2) != 0) {
+        framed = 1;
+        textsize = STREAMED;
+    } else {
+        textsize = ftell(infile);
+    }
     fputc((int)((textsize & 0xff)),outfile);
     fputc((int)((textsize & 0xff00) >> 8),outfile);
     fputc((int)((textsize & 0xff0000L) >> 16),outfile);
@@ -403,7 +460,8 @@ static void Encode(void)  /* compression */
         Error(wterr);   /* output size of text */
     if (textsize == 0)
         return;
-    rewind(infile);
+    if (!framed)
+        rewind(infile);
     textsize = 0;           /* rewind and re-read */
     StartHuff();
     InitTree();
@@ -417,7 +475,7 @@ static void Encode(void)  /* compression */
     for (i = 1; i <= F; i++)
         InsertNode(r - i);
     InsertNode(r);
-    do {
+    while (len > 0) {
         if (match_length > len)
             match_length = len;
         if (match_length <= THRESHOLD) {
@@ -428,6 +486,9 @@ static void Encode(void)  /* compression */
             EncodePosition(match_position);
         }
         last_match_length = match_length;
+        if (framed && ((chunkin += last_match_length) > CHUNK - F
+                       || chunklen > CHUNKBUF - CHUNKSLACK))
+            FlushChunk();
         for (i = 0; i < last_match_length &&
                 (c = getc(infile)) != EOF; i++) {
             DeleteNode(s);
@@ -439,7 +500,7 @@ static void Encode(void)  /* compression */
             InsertNode(r);
         }
         if ((textsize += i) > printcount) {
-            printf("%12ld\r", textsize);
+            fprintf(msgfile, "%12ld\r", textsize);
             printcount += 1024;
         }
         while (i++ < last_match_length) {
@@ -448,11 +509,19 @@ static void Encode(void)  /* compression */
             r = (r + 1) & (N - 1);
             if (--len) InsertNode(r);
         }
-    } while (len > 0);
-    EncodeEnd();
-    printf("In : %ld bytes\n", textsize);
-    printf("Out: %ld bytes\n", codesize);
-    printf("Out/In: %.3f\n", 1.0 * codesize / textsize);
+    }
+    if (framed) {
+        FlushChunk();
+        PutWord(0);         /* end of stream */
+        PutWord(0);
+        codesize += 4;
+    } else {
+        EncodeEnd();
+    }
+    fprintf(msgfile, "In : %ld bytes\n", textsize);
+    fprintf(msgfile, "Out: %ld bytes\n", codesize);
+    if (textsize)
+        fprintf(msgfile, "Out/In: %.3f\n", 1.0 * codesize / textsize);
 }
 
 
@@ -461,19 +530,38 @@ int main(int argc, char *argv[])
 {
     char  *s;
 
+    msgfile = stdout;
+    if (argc == 4 && strcmp(argv[1], "-s") == 0) {
+        framed = 1;
+        argc--; argv++;
+    }
     if (argc != 3) {
-        printf("'lzencode file1 file2' encodes file1 into file2.\n");
+        printf("'lzencode [-s] file1 file2' encodes file1 into file2.\n");
+        printf("'-' stands for stdin/stdout, -s forces the streaming format.\n");
+        return EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "-") == 0) {
+        infile = stdin;
+        framed = 1;
+    } else if ((infile = fopen(argv[1], "rb")) == NULL) {
+        printf("??? %s\n", argv[1]);
         return EXIT_FAILURE;
     }
-    if ((s = argv[1], (infile = fopen(s, "rb")) == NULL)
-     || (s = argv[2], (outfile = fopen(s, "wb")) == NULL)) {
+    if (strcmp(argv[2], "-") == 0) {
+        outfile = stdout;
+        msgfile = stderr;
+    } else if ((s = argv[2], (outfile = fopen(s, "wb")) == NULL)) {
         printf("??? %s\n", s);
         return EXIT_FAILURE;
     }
 
 	Encode();
 
-    fclose(infile);
-    fclose(outfile);
+    if (infile != stdin)
+        fclose(infile);
+    if (outfile != stdout)
+        fclose(outfile);
+    else
+        fflush(stdout);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,1150 @@
+/*
+ *	unpack.c - streaming decoders for squeezed, crunched and LZH files
+ *
+ *	NOTE: the UNLZH part is under the GPL license, see lar.c
+ *
+ *	zcc +cpm -c -O3 --opt-code-size -DUSQ -DUNCRUNCH -DUNLZH unpack.c
+ *	gcc -c unpack.c
+ *
+ *	The decoders are the ones of usq.c (R. Greenlaw), uncrunch.c (Frank
+ *	Prindle, after CRUNCH 2.3 by Steven Greenberg), lzdecode.c (lzhuf.c
+ *	by Haruyasu Yoshizaki) and the crLZH reader of lbrate by Russell Marks,
+ *	all turned inside out so that the caller does the I/O, see unpack.h.
+ *
+ *	Decoding runs in two stages.  The first turns input into bytes in
+ *	the output ring one symbol (Huffman code, LZW code or LZ match) at a
+ *	time; a step is only taken when the ring has room for the most it
+ *	can write and enough input is buffered to finish it, so no decoder
+ *	ever has to stop half way through a symbol.  The second stage, run
+ *	by up_drain(), undoes the 0x90 repeat coding of SQ and CRUNCH (one
+ *	byte can stand for 255) and keeps the checksum.
+ */
+
+#include <string.h>
+#include "unpack.h"
+
+#define RMASK		(UP_RING - 1)
+
+/* decoder states, the header ones first */
+#define ST_MAGIC	0
+#define ST_SQSUM	1
+#define ST_NAME		2
+#define ST_SQNODES	3
+#define ST_SQTREE	4
+#define ST_INFO		5
+#define ST_SIZE		6
+#define ST_BODY		7	/* decoding */
+#define ST_TRAIL	8	/* reading the checksum */
+#define ST_END		9	/* all decoded, ring draining */
+#define ST_SHORT	10	/* input ended early */
+#define ST_BAD		11	/* corrupt data */
+#define ST_FMT		12	/* not a file we can read */
+
+#define DLE		0x90	/* repeat byte, count follows */
+#define PASTMAX		16	/* made up zero bytes before giving up */
+
+#define SQ	(u->x.sq)
+#define CR	(u->x.cr)
+#define LZ	(u->x.lz)
+
+#define putring(u, c)	((u)->ring[(unsigned int)(u)->wpos++ & RMASK] = (c))
+
+
+/* next input byte, -1 once it has all been used */
+static int inbyte(struct unpack *u)
+{
+	if (u->inpos < u->inlen) {
+		u->rawcount++;
+		return u->in[u->inpos++];
+	}
+	u->pastend++;
+	return -1;
+}
+
+
+// ------------------------------------------------------------------------------------------
+
+#ifdef USQ
+
+#define SPEOF		256	/* special endfile token */
+
+/* follow the bit stream in the tree to a leaf, one symbol per call */
+static void sqstep(struct unpack *u)
+{
+	int i;
+
+	i = SQ.node;
+	do {
+		if (++SQ.bpos > 7) {
+			if (u->inpos == u->inlen) {
+				/* wait for the rest of the code, or stop at EOF as usq did */
+				SQ.bpos--;
+				SQ.node = i;
+				if (u->ineof)
+					u->state = ST_END;
+				return;
+			}
+			SQ.curin = inbyte(u);
+			SQ.bpos = 0;
+			i = SQ.dnode[i][1 & SQ.curin];
+		} else
+			i = SQ.dnode[i][1 & (SQ.curin >>= 1)];
+		if (i >= SQ_NUMVALS - 1 || i < -(SPEOF + 1)) {
+			u->state = ST_BAD;
+			return;
+		}
+	} while (i >= 0);
+	SQ.node = 0;
+
+	/* decode fake node index to original data value */
+	if ((i = -(i + 1)) == SPEOF)
+		u->state = ST_END;
+	else
+		putring(u, i);
+}
+
+#endif // USQ
+
+
+// ------------------------------------------------------------------------------------------
+
+#ifdef UNCRUNCH
+
+/*special values for predecessor in table*/
+#define NOPRED 0x6fff		/*no predecessor in table*/
+#define EMPTY  0x8000		/*empty table entry (xlatbl only)*/
+#define REFERENCED 0x2000	/*table entry referenced if this bit set*/
+#define IMPRED 0x7fff		/*impossible predecessor*/
+
+#define EOFCOD 0x100		/*special code for end-of-file*/
+#define RSTCOD 0x101		/*special code for adaptive reset*/
+#define NULCOD 0x102		/*special filler code*/
+#define SPRCOD 0x103		/*spare special code*/
+
+/*hash pred/suff into xlatbl pointer*/
+/*duplicates the hash algorithm used by CRUNCH 2.3*/
+static unsigned short *hash(struct unpack *u, int pred, int suff, int *disploc)
+{
+	int hashval;
+
+	hashval = ((((pred >> 4) & 0xff) ^ suff) | ((pred & 0xf) << 8)) + 1;
+	*disploc = hashval - CR_XLATBL;
+	return CR.xlatbl + hashval;
+}
+
+
+/*find an empty entry in xlatbl which hashes from this predecessor/suffix*/
+/*combo, and store the index of the next available lzw table entry in it*/
+static void figure(struct unpack *u, int pred, int suff)
+{
+	int disp;
+	unsigned short *p;
+
+	p = hash(u, pred, suff, &disp);
+
+	/*follow secondary hash chain as necessary to find an empty slot*/
+	while (*p != EMPTY) {
+		p += disp;
+		if (p < CR.xlatbl || p > CR.xlatbl + CR_XLATBL)
+			p += CR_XLATBL;
+	}
+
+	/*stuff next available index into this slot*/
+	*p = CR.entry;
+}
+
+
+#ifdef FASTLZW
+/*build xlatbl for the full lzw table, leaving it exactly as the*/
+/*figure() calls for each entry in turn would have done*/
+/*(the REFERENCED bit does not take part in the hash)*/
+static void fillxl(struct unpack *u)
+{
+	int i;
+
+	for (i = 0; i < CR_XLATBL; i++)
+		CR.xlatbl[i] = EMPTY;
+	for (CR.entry = 0; CR.entry < CR_TABLE; CR.entry++)
+		figure(u, CR.table[CR.entry].predecessor, CR.table[CR.entry].suffix);
+}
+#endif
+
+
+/*enter the next code into the lzw table*/
+static void enterx(struct unpack *u, int pred, int suff)
+{
+#ifdef FASTLZW
+	/*the new string is the last one plus the first byte of the current*/
+	/*one, which follows it in the ring; xlatbl waits for fillxl()*/
+	CR.stroff[CR.entry] = CR.lstoff;
+	CR.strsiz[CR.entry] = CR.lstsiz + 1;
+#else
+	/*update xlatbl to point to this entry*/
+	figure(u, pred, suff);
+#endif
+
+	/*make the new entry*/
+	CR.table[CR.entry].predecessor = pred;
+	CR.table[CR.entry].suffix = suff;
+	CR.entry++;
+
+	/*if only one entry of the current code length remains, update to*/
+	/*next code length because main loop is reading one code ahead*/
+	if (CR.entry >= CR.trgmsk) {
+		if (CR.codlen < 12) {
+			/*table not full, just make length one more bit*/
+			CR.codlen++;
+			CR.trgmsk = (CR.trgmsk << 1) | 1;
+		} else {
+			/*table almost full (fulflg==0) or full (fulflg==1)*/
+			/*just increment fulflg - when it gets to 2 we will*/
+			/*never be called again*/
+			CR.fulflg++;
+#ifdef FASTLZW
+			if (CR.fulflg == 2)
+				fillxl(u);
+#endif
+		}
+	}
+}
+
+
+/*initialize the lzw and physical translation tables*/
+static void initb2(struct unpack *u)
+{
+	int i;
+
+	CR.entry = 0;
+	CR.fulflg = 0;
+	CR.codlen = 9;
+	CR.trgmsk = 0x1ff;
+	CR.entflg = 1;		/*first code always atomic*/
+#ifndef FASTLZW
+	/*first mark all entries of xlatbl as empty*/
+	for (i = 0; i < CR_XLATBL; i++)
+		CR.xlatbl[i] = EMPTY;
+#endif
+
+	/*enter atomic and reserved codes into lzw table*/
+	for (i = 0; i < 0x100; i++)
+		enterx(u, NOPRED, i);	/*first 256 atomic codes*/
+	for (i = 0; i < 4; i++)
+		enterx(u, IMPRED, 0);	/*reserved codes*/
+}
+
+
+/*attempt to reassign an existing code which has*/
+/*been defined, but never referenced*/
+static void entfil(struct unpack *u, int pred, int suff)
+{
+	int disp;
+	unsigned short *p;
+
+	p = hash(u, pred, suff, &disp);
+
+	/*search the candidate codes (all those which hash from this new*/
+	/*predecessor and suffix) for an unreferenced one*/
+	while (*p != EMPTY) {
+		if ((CR.table[*p].predecessor & REFERENCED) == 0) {
+			/*entry reassignable, so do it!*/
+			CR.table[*p].predecessor = pred;
+			CR.table[*p].suffix = suff;
+#ifdef FASTLZW
+			CR.stroff[*p] = CR.lstoff;
+			CR.strsiz[*p] = CR.lstsiz + 1;
+#endif
+			break;
+		}
+
+		/*candidate unsuitable - follow secondary hash chain*/
+		p += disp;
+		if (p < CR.xlatbl || p > CR.xlatbl + CR_XLATBL)
+			p += CR_XLATBL;
+	}
+}
+
+
+#ifdef FASTLZW
+
+/*return a code of length "codlen" bits, or -1 when the input is out;*/
+/*the bit buffer is refilled 32 bits at a time*/
+static int crcode(struct unpack *u)
+{
+	unsigned char *p;
+
+	if (CR.bitcnt < CR.codlen) {
+		if (u->inlen - u->inpos >= 4) {
+			p = u->in + u->inpos;
+			CR.bitbuf = (CR.bitbuf << 32) | ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+				| ((unsigned long)p[2] << 8) | p[3];
+			u->inpos += 4;
+			u->rawcount += 4;
+			CR.bitcnt += 32;
+		} else
+			while (u->inpos < u->inlen) {
+				CR.bitbuf = (CR.bitbuf << 8) | inbyte(u);
+				CR.bitcnt += 8;
+			}
+		if (CR.bitcnt < CR.codlen)
+			return -1;
+	}
+	CR.bitcnt -= CR.codlen;
+	return (int)(CR.bitbuf >> CR.bitcnt) & CR.trgmsk;
+}
+
+
+/*the checksum bytes follow the code stream*/
+static int crbyte(struct unpack *u)
+{
+	if (CR.bitcnt) {
+		CR.bitcnt -= 8;
+		return (int)(CR.bitbuf >> CR.bitcnt) & 0xff;
+	}
+	return inbyte(u);
+}
+
+
+/*decode this code: each code remembers where its string last went in*/
+/*the ring, so it is copied from there rather than walked out of the table*/
+static int decode(struct unpack *u, int code)
+{
+	unsigned int n, i, k;
+	unsigned long from, to;
+
+	/*the string before this one becomes the last one*/
+	CR.lstoff = CR.curoff;
+	CR.lstsiz = CR.cursiz;
+
+	if (code >= CR.entry) {
+		/*the ugly exception, "WsWsW"*/
+		CR.entflg = 1;
+		enterx(u, CR.lastpr, CR.finchar);
+	}
+
+	/*mark corresponding table entry as referenced*/
+	CR.table[code].predecessor |= REFERENCED;
+
+	to = u->wpos;
+	if (code < 0x100) {
+		/*atomic code*/
+		u->ring[to & RMASK] = code;
+		n = 1;
+	} else if ((n = CR.strsiz[code]) != 0 && to - CR.stroff[code] <= UP_RING) {
+		/*string still in the ring - copy it forward, the ugly*/
+		/*exception overlaps its own first byte*/
+		from = CR.stroff[code];
+		for (i = 0; i < n; i++)
+			u->ring[(to + i) & RMASK] = u->ring[(from + i) & RMASK];
+	} else {
+		/*fell out of the ring - walk back the lzw table, last byte first*/
+		n = 0;
+		for (k = code; k > 0xff; k = CR.table[k].predecessor & 0xfff)
+			if (++n >= CR_TABLE) {
+				u->state = ST_BAD;
+				return 1;
+			}
+		i = n;
+		for (k = code; k > 0xff; k = CR.table[k].predecessor & 0xfff)
+			u->ring[(to + i--) & RMASK] = CR.table[k].suffix;
+		u->ring[to & RMASK] = k;
+		n++;
+	}
+
+	/*remember where this string went*/
+	CR.stroff[code] = CR.curoff = to;
+	CR.strsiz[code] = CR.cursiz = n;
+	u->wpos += n;
+	CR.finchar = u->ring[to & RMASK];
+
+	return CR.entflg;
+}
+
+#else
+
+/*return a code of length "codlen" bits, or -1 when the input is out*/
+static int crcode(struct unpack *u)
+{
+	int hole, c;
+
+	/*always get at least a byte*/
+	if ((c = inbyte(u)) < 0)
+		return -1;
+	CR.getbuf = (CR.getbuf << CR.codlen) | ((long)c << (hole = CR.codlen - CR.getbit));
+	CR.getbit = 8 - hole;
+
+	/*if is not enough to supply codlen bits, get another byte*/
+	if (CR.getbit < 0) {
+		if ((c = inbyte(u)) < 0)
+			return -1;
+		CR.getbuf |= (long)c << (hole - 8);
+		CR.getbit += 8;
+	}
+	return (int)(CR.getbuf >> 8) & CR.trgmsk;
+}
+
+#define crbyte(u)	inbyte(u)
+
+
+/*decode this code*/
+static int decode(struct unpack *u, int code)
+{
+	unsigned char *stackp;
+	unsigned int k;
+
+	if (code >= CR.entry) {
+		/*the ugly exception, "WsWsW"*/
+		CR.entflg = 1;
+		enterx(u, CR.lastpr, CR.finchar);
+	}
+
+	/*mark corresponding table entry as referenced*/
+	CR.table[code].predecessor |= REFERENCED;
+
+	/*walk back the lzw table starting with this code*/
+	stackp = CR.stack;
+	for (k = code; k > 0xff; k = CR.table[k].predecessor & 0xfff) {
+		if (stackp == CR.stack + CR_TABLE - 1) {
+			u->state = ST_BAD;
+			return 1;
+		}
+		*stackp++ = CR.table[k].suffix;
+	}
+
+	/*then put all bytes corresponding to this code in forward order*/
+	putring(u, CR.finchar = CR.table[k].suffix);
+	while (stackp > CR.stack)
+		putring(u, *--stackp);
+
+	return CR.entflg;
+}
+
+#endif
+
+
+/*read and process one code*/
+static void crstep(struct unpack *u)
+{
+	int code;
+
+	if ((code = crcode(u)) < 0) {
+		u->state = ST_SHORT;
+		return;
+	}
+
+	/*skip spare or null codes*/
+	if (code == NULCOD || code == SPRCOD)
+		return;
+
+	/*remember last predecessor*/
+	CR.lastpr = CR.pred;
+	CR.pred = code;
+
+	if (code == EOFCOD) {
+		/*all lzw codes read, drop the bits padding out the last one*/
+#ifdef FASTLZW
+		CR.bitcnt &= ~7;
+#endif
+		u->state = u->checked ? ST_TRAIL : ST_END;
+	} else if (code == RSTCOD) {
+		initb2(u);
+		CR.pred = NOPRED;
+	} else if (code > CR.entry) {
+		u->state = ST_BAD;
+	} else if (CR.fulflg != 2) {
+		/*strategy if table not full*/
+		if (decode(u, code) == 0)
+			enterx(u, CR.lastpr, CR.finchar);
+		else
+			CR.entflg = 0;
+	} else {
+		/*strategy if table is full: attempt to reassign*/
+		decode(u, code);
+		entfil(u, CR.lastpr, CR.finchar);
+	}
+}
+
+
+static void crstart(struct unpack *u)
+{
+#ifdef FASTLZW
+	CR.bitcnt = 0;
+	CR.curoff = CR.cursiz = 0;
+	u->needin = 4;
+#else
+	CR.getbit = 0;
+	u->needin = 2;
+#endif
+	u->stepout = CR_TABLE;
+	u->rle = 1;
+	initb2(u);
+	CR.pred = NOPRED;
+}
+
+#endif // UNCRUNCH
+
+
+// ------------------------------------------------------------------------------------------
+
+#if defined(UNLZH) || defined(UNLZHUF)
+
+#define THRESHOLD	2
+#define MAX_FREQ	0x8000	/* updates tree when the root frequency comes to this value */
+/* a size word of STREAMED introduces the framed format written by
+   'lzencode -s': chunks with a 4-byte header (text bytes, code bytes,
+   both 16-bit little endian), the code of each padded to a byte
+   boundary, ended by a header with a text length of zero */
+#define STREAMED	0xffffffffL
+
+/* table for decoding the upper 6 bits of position, bytes 0-31 give 0 */
+static unsigned char d_code[224] = {
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+	0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+	0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+	0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+	0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+	0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+	0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
+	0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
+	0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09,
+	0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A,
+	0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B, 0x0B,
+	0x0C, 0x0C, 0x0C, 0x0C, 0x0D, 0x0D, 0x0D, 0x0D,
+	0x0E, 0x0E, 0x0E, 0x0E, 0x0F, 0x0F, 0x0F, 0x0F,
+	0x10, 0x10, 0x10, 0x10, 0x11, 0x11, 0x11, 0x11,
+	0x12, 0x12, 0x12, 0x12, 0x13, 0x13, 0x13, 0x13,
+	0x14, 0x14, 0x14, 0x14, 0x15, 0x15, 0x15, 0x15,
+	0x16, 0x16, 0x16, 0x16, 0x17, 0x17, 0x17, 0x17,
+	0x18, 0x18, 0x19, 0x19, 0x1A, 0x1A, 0x1B, 0x1B,
+	0x1C, 0x1C, 0x1D, 0x1D, 0x1E, 0x1E, 0x1F, 0x1F,
+	0x20, 0x20, 0x21, 0x21, 0x22, 0x22, 0x23, 0x23,
+	0x24, 0x24, 0x25, 0x25, 0x26, 0x26, 0x27, 0x27,
+	0x28, 0x28, 0x29, 0x29, 0x2A, 0x2A, 0x2B, 0x2B,
+	0x2C, 0x2C, 0x2D, 0x2D, 0x2E, 0x2E, 0x2F, 0x2F,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+	0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+};
+
+
+/* keep at least 9 bits in the buffer, zeros past the end of the input */
+static void lzfill(struct unpack *u)
+{
+	int i;
+
+	while (LZ.getlen <= 8) {
+		if ((i = inbyte(u)) < 0)
+			i = 0;
+		LZ.getbuf |= (unsigned)i << (8 - LZ.getlen);
+		LZ.getlen += 8;
+	}
+}
+
+static int lzgetbit(struct unpack *u)
+{
+	unsigned i;
+
+	lzfill(u);
+	i = LZ.getbuf;
+	LZ.getbuf <<= 1;
+	LZ.getlen--;
+	return (int)((i & 0x8000) >> 15);
+}
+
+static int lzgetbyte(struct unpack *u)
+{
+	unsigned i;
+
+	lzfill(u);
+	i = LZ.getbuf;
+	LZ.getbuf <<= 8;
+	LZ.getlen -= 8;
+	return (int)((i & 0xff00) >> 8);
+}
+
+static unsigned lzgetword(struct unpack *u)
+{
+	unsigned w;
+
+	w = lzgetbyte(u);
+	return w | (lzgetbyte(u) << 8);
+}
+
+/* the bytes after the code, once aligned: from the buffer, then the input */
+static int lztrail(struct unpack *u)
+{
+	int i;
+
+	if (LZ.getlen < 8)
+		return inbyte(u);
+	i = (LZ.getbuf >> 8) & 0xff;
+	LZ.getbuf <<= 8;
+	LZ.getlen -= 8;
+	return i;
+}
+
+/* drop the bits padding out the last code byte */
+static void lzalign(struct unpack *u)
+{
+	LZ.getbuf <<= (LZ.getlen & 7);
+	LZ.getlen -= (LZ.getlen & 7);
+}
+
+
+/* initialization of tree */
+static void starthuff(struct unpack *u)
+{
+	int i, j;
+
+	for (i = 0; i < LZ.nchar; i++) {
+		LZ.freq[i] = 1;
+		LZ.son[i] = i + LZ.t;
+		LZ.prnt[i + LZ.t] = i;
+	}
+	i = 0; j = LZ.nchar;
+	while (j <= LZ.root) {
+		LZ.freq[j] = LZ.freq[i] + LZ.freq[i + 1];
+		LZ.son[j] = i;
+		LZ.prnt[i] = LZ.prnt[i + 1] = j;
+		i += 2; j++;
+	}
+	LZ.freq[LZ.t] = 0xffff;
+	LZ.prnt[LZ.root] = 0;
+}
+
+
+/* reconstruction of tree */
+static void reconst(struct unpack *u)
+{
+	int i, j, k;
+	unsigned f;
+
+	/* collect leaf nodes in the first half of the table */
+	/* and replace the freq by (freq + 1) / 2. */
+	j = 0;
+	for (i = 0; i < LZ.t; i++) {
+		if (LZ.son[i] >= LZ.t) {
+			LZ.freq[j] = (LZ.freq[i] + 1) / 2;
+			LZ.son[j] = LZ.son[i];
+			j++;
+		}
+	}
+
+	/* begin constructing tree by connecting sons */
+	for (i = 0, j = LZ.nchar; j < LZ.t; i += 2, j++) {
+		k = i + 1;
+		f = LZ.freq[j] = LZ.freq[i] + LZ.freq[k];
+		for (k = j - 1; f < LZ.freq[k]; k--);
+		k++;
+		memmove(LZ.freq + k + 1, LZ.freq + k, (j - k) * sizeof(LZ.freq[0]));
+		LZ.freq[k] = f;
+		memmove(LZ.son + k + 1, LZ.son + k, (j - k) * sizeof(LZ.son[0]));
+		LZ.son[k] = i;
+	}
+
+	/* connect prnt */
+	for (i = 0; i < LZ.t; i++) {
+		if ((k = LZ.son[i]) >= LZ.t)
+			LZ.prnt[k] = i;
+		else
+			LZ.prnt[k] = LZ.prnt[k + 1] = i;
+	}
+}
+
+
+/* increment frequency of given code by one, and update tree */
+static void update(struct unpack *u, int c)
+{
+	int i, j, l;
+	unsigned k;
+
+	if (LZ.freq[LZ.root] == MAX_FREQ)
+		reconst(u);
+
+	c = LZ.prnt[c + LZ.t];
+	do {
+		k = ++LZ.freq[c];
+
+		/* if the order is disturbed, exchange nodes */
+		if (k > LZ.freq[l = c + 1]) {
+			while (k > LZ.freq[++l]);
+			l--;
+			LZ.freq[c] = LZ.freq[l];
+			LZ.freq[l] = k;
+
+			i = LZ.son[c];
+			LZ.prnt[i] = l;
+			if (i < LZ.t) LZ.prnt[i + 1] = l;
+
+			j = LZ.son[l];
+			LZ.son[l] = i;
+
+			LZ.prnt[j] = c;
+			if (j < LZ.t) LZ.prnt[j + 1] = c;
+			LZ.son[c] = j;
+
+			c = l;
+		}
+	} while ((c = LZ.prnt[c]) != 0);	/* repeat up to root */
+}
+
+
+static int decodechar(struct unpack *u)
+{
+	unsigned c;
+
+	/* travel from root to leaf, */
+	/* choosing the smaller child node (son[]) if the read bit is 0, */
+	/* the bigger (son[]+1} if 1 */
+	c = LZ.son[LZ.root];
+	while (c < LZ.t)
+		c = LZ.son[c + lzgetbit(u)];
+	c -= LZ.t;
+	update(u, c);
+	return (int)c;
+}
+
+
+/* the upper 6 bits of the position come from the table, the lower 6 */
+/* (5 for crLZH 2.x) follow verbatim */
+static unsigned decodeposition(struct unpack *u)
+{
+	unsigned i, j, c;
+
+	i = lzgetbyte(u);
+	c = 0; j = 3;
+	if (i >= 32) {
+		c = d_code[i - 32];
+		j = 4 + (c > 0x03) + (c > 0x0b) + (c > 0x17) + (c > 0x2f);
+	}
+	j -= 8 - LZ.pshift;
+	while (j--)
+		i = (i << 1) + lzgetbit(u);
+	return (c << LZ.pshift) | (i & ((1 << LZ.pshift) - 1));
+}
+
+
+/* read the header of the next lzencode -s chunk, or the end marker */
+static void lzchunk(struct unpack *u)
+{
+	if ((LZ.left = lzgetword(u)) == 0) {
+		/* a short read fills in zeros, which would pass for the end marker */
+		if (lzgetword(u) != 0 || u->pastend > (LZ.getlen >> 3))
+			u->state = ST_BAD;
+		else
+			u->state = ST_END;
+		return;
+	}
+	LZ.clen = lzgetword(u);
+	LZ.mark = u->rawcount - (LZ.getlen >> 3);
+}
+
+
+/* one literal or match */
+static void lzstep(struct unpack *u)
+{
+	unsigned int c, j;
+	unsigned long from;
+
+	if (LZ.framed && LZ.left == 0) {
+		lzchunk(u);
+		return;
+	}
+
+	if ((c = decodechar(u)) < 256) {
+		putring(u, c);
+		j = 1;
+	} else if (c == LZ.base) {
+		/* 256 = EOF in crLZH */
+		lzalign(u);
+		u->state = u->checked ? ST_TRAIL : ST_END;
+		return;
+	} else {
+		from = u->wpos - decodeposition(u) - 1;
+		j = c - LZ.base + THRESHOLD;
+		for (c = 0; c < j; c++)
+			putring(u, u->ring[(unsigned int)(from + c) & RMASK]);
+	}
+
+	if (u->pastend > PASTMAX)
+		u->state = ST_SHORT;
+	else if (LZ.framed) {
+		if (j > LZ.left)
+			u->state = ST_BAD;
+		else if ((LZ.left -= j) == 0) {
+			lzalign(u);
+			if (u->rawcount - (LZ.getlen >> 3) - LZ.mark != LZ.clen)
+				u->state = ST_BAD;
+		}
+	} else if (u->method == UP_LZHUF) {
+		if (j >= LZ.textsize)
+			u->state = ST_END;
+		else
+			LZ.textsize -= j;
+	}
+}
+
+
+/* crLZH: N 2048, EOF code; lzencode: N 4096, size up front */
+static void lzstart(struct unpack *u, int oldver)
+{
+	if (u->method == UP_LZH) {
+		LZ.nchar = 256 + 1 - THRESHOLD + LZ_F;
+		LZ.base = 256;
+		LZ.pshift = oldver ? 6 : 5;
+	} else {
+		LZ.nchar = 256 - THRESHOLD + LZ_F;
+		LZ.base = 255;
+		LZ.pshift = 6;
+	}
+	LZ.t = LZ.nchar * 2 - 1;
+	LZ.root = LZ.t - 1;
+	LZ.getbuf = 0;
+	LZ.getlen = 0;
+	LZ.left = 0;
+	u->needin = 16;
+	u->stepout = LZ_F + THRESHOLD;
+	starthuff(u);
+
+	/* what comes before the start reads as spaces */
+	memset(u->ring, 0x20, UP_RING);
+}
+
+#endif // UNLZH || UNLZHUF
+
+
+// ------------------------------------------------------------------------------------------
+
+/* the header is over, set up the decoder */
+static void start(struct unpack *u)
+{
+	u->state = ST_BODY;
+	switch (u->method) {
+#ifdef USQ
+	case UP_SQ:
+		SQ.node = 0;
+		SQ.bpos = 99;	/* force initial read */
+		u->needin = 1;
+		u->stepout = 1;
+		u->rle = 1;
+		u->checked = 1;
+		break;
+#endif
+#ifdef UNCRUNCH
+	case UP_CR:
+		crstart(u);
+		break;
+#endif
+#ifdef UNLZH
+	case UP_LZH:
+		lzstart(u, u->hdr[1] < 0x20);
+		break;
+#endif
+#ifdef UNLZHUF
+	case UP_LZHUF:
+		lzstart(u, 0);
+		if (LZ.textsize == STREAMED)
+			LZ.framed = 1;
+		else if (LZ.textsize == 0)
+			u->state = ST_END;
+		break;
+#endif
+	}
+}
+
+
+/* take header bytes while there are any, UP_NAME once it is all read */
+static int header(struct unpack *u)
+{
+	int c, m;
+
+	while (u->inpos < u->inlen || u->ineof) {
+		if ((c = inbyte(u)) < 0)
+			break;
+		switch (u->state) {
+		case ST_MAGIC:
+			if (u->cnt++ == 0) {
+				if (c != 0x76)
+					goto badfmt;
+				break;
+			}
+			switch (c) {
+#ifdef USQ
+			case 0xff: m = UP_SQ; break;
+#endif
+#ifdef UNCRUNCH
+			case 0xfe: m = UP_CR; break;
+#endif
+#ifdef UNLZH
+			case 0xfd: m = UP_LZH; break;
+#endif
+			default: goto badfmt;
+			}
+			if (u->method == UP_AUTO)
+				u->method = m;
+			else if (u->method != m)
+				goto badfmt;
+			u->cnt = 0;
+			u->state = (m == UP_SQ) ? ST_SQSUM : ST_NAME;
+			break;
+#ifdef USQ
+		case ST_SQSUM:
+			u->hdr[u->cnt++] = c;
+			if (u->cnt == 2) {
+				u->filesum = u->hdr[0] | (u->hdr[1] << 8);
+				u->cnt = 0;
+				u->state = ST_NAME;
+			}
+			break;
+		case ST_SQNODES:
+			u->hdr[u->cnt++] = c;
+			if (u->cnt == 2) {
+				SQ.numnodes = (short)(u->hdr[0] | (u->hdr[1] << 8));
+				if (SQ.numnodes < 0 || SQ.numnodes >= SQ_NUMVALS)
+					goto badfmt;
+				/* initialize for possible empty tree (SPEOF only) */
+				SQ.dnode[0][0] = SQ.dnode[0][1] = -(SPEOF + 1);
+				u->cnt = 0;
+				if (SQ.numnodes == 0) {
+					start(u);
+					return UP_NAME;
+				}
+				u->state = ST_SQTREE;
+			}
+			break;
+		case ST_SQTREE:
+			u->hdr[u->cnt++ & 3] = c;
+			if ((u->cnt & 3) == 0) {
+				m = u->cnt / 4 - 1;
+				SQ.dnode[m][0] = (short)(u->hdr[0] | (u->hdr[1] << 8));
+				SQ.dnode[m][1] = (short)(u->hdr[2] | (u->hdr[3] << 8));
+				if (m == SQ.numnodes - 1) {
+					start(u);
+					return UP_NAME;
+				}
+			}
+			break;
+#endif
+		case ST_NAME:
+			if (c == '\0') {
+				u->name[u->cnt] = '\0';
+				u->cnt = 0;
+				u->state = (u->method == UP_SQ) ? ST_SQNODES : ST_INFO;
+			} else if (u->cnt < UP_NAMELEN - 1)
+				u->name[u->cnt++] = c;
+			break;
+		case ST_INFO:
+			/* reflevel, siglevel, errdetect, spare */
+			u->hdr[u->cnt++] = c;
+			if (u->cnt == 4) {
+				/* this does not support CRUNCH 1.x format */
+				if (u->method == UP_CR && (u->hdr[1] < 0x20 || u->hdr[1] > 0x2f))
+					goto badfmt;
+				u->checked = (u->hdr[2] == 0);
+				start(u);
+				return UP_NAME;
+			}
+			break;
+#ifdef UNLZHUF
+		case ST_SIZE:
+			u->hdr[u->cnt++] = c;
+			if (u->cnt == 4) {
+				LZ.textsize = u->hdr[0] | ((unsigned long)u->hdr[1] << 8)
+					| ((unsigned long)u->hdr[2] << 16) | ((unsigned long)u->hdr[3] << 24);
+				LZ.framed = 0;
+				start(u);
+				return UP_NAME;
+			}
+			break;
+#endif
+		}
+	}
+	if (!u->ineof)
+		return UP_MORE;
+badfmt:
+	u->state = ST_FMT;
+	return UP_BADFMT;
+}
+
+
+/* hand out decoded bytes, expanding the repeats */
+static unsigned int unrepeat(struct unpack *u, unsigned char *buf, unsigned int n)
+{
+	unsigned int got, k, i;
+	unsigned char c, *p;
+
+	got = 0;
+	while (got < n) {
+		if (u->repct) {
+			u->repct--;
+			u->sum += (buf[got++] = u->savec);
+			continue;
+		}
+		if (u->rpos == u->wpos)
+			break;
+		if (!u->rle) {
+			/* straight copy, up to the end of the ring */
+			p = u->ring + ((unsigned int)u->rpos & RMASK);
+			k = UP_RING - ((unsigned int)u->rpos & RMASK);
+			if (k > n - got)
+				k = n - got;
+			if (k > u->wpos - u->rpos)
+				k = u->wpos - u->rpos;
+			for (i = 0; i < k; i++)
+				u->sum += (buf[got++] = p[i]);
+			u->rpos += k;
+			continue;
+		}
+		c = u->ring[(unsigned int)u->rpos++ & RMASK];
+		if (u->dle) {
+			/* emit (c-1) copies of savec, or the repeat byte itself */
+			u->dle = 0;
+			if (c == 0)
+				u->sum += (buf[got++] = DLE);
+			else
+				u->repct = (c == 1 && u->method == UP_SQ) ? 1 : c - 1;
+		} else if (c == DLE)
+			u->dle = 1;
+		else
+			u->sum += (buf[got++] = u->savec = c);
+	}
+	return got;
+}
+
+
+/* one byte of the trailing checksum */
+static int trailbyte(struct unpack *u)
+{
+	switch (u->method) {
+#ifdef UNCRUNCH
+	case UP_CR:
+		return crbyte(u);
+#endif
+#if defined(UNLZH) || defined(UNLZHUF)
+	default:
+		return lztrail(u);
+#endif
+	}
+	return -1;
+}
+
+static unsigned int trailavail(struct unpack *u)
+{
+	unsigned int n;
+
+	n = u->inlen - u->inpos;
+#ifdef FASTLZW
+	if (u->method == UP_CR)
+		n += CR.bitcnt >> 3;
+#endif
+#if defined(UNLZH) || defined(UNLZHUF)
+	if (u->method == UP_LZH)
+		n += LZ.getlen >> 3;
+#endif
+	return n;
+}
+
+
+// ------------------------------------------------------------------------------------------
+
+void up_init(struct unpack *u, int method)
+{
+	u->method = method;
+	u->state = (method == UP_LZHUF) ? ST_SIZE : ST_MAGIC;
+	u->ineof = u->rle = u->dle = u->savec = u->checked = 0;
+	u->repct = u->sum = u->filesum = u->cnt = 0;
+	u->inpos = u->inlen = u->pastend = 0;
+	u->rawcount = u->wpos = u->rpos = 0;
+	u->name[0] = '\0';
+}
+
+
+/* free space in the input buffer */
+unsigned int up_room(struct unpack *u)
+{
+	return UP_INSIZE - (u->inlen - u->inpos);
+}
+
+
+/* take as much of buf as fits, returns the count taken */
+unsigned int up_feed(struct unpack *u, unsigned char *buf, unsigned int n)
+{
+	if (u->inpos) {
+		u->inlen -= u->inpos;
+		memmove(u->in, u->in + u->inpos, u->inlen);
+		u->inpos = 0;
+	}
+	if (n > UP_INSIZE - u->inlen)
+		n = UP_INSIZE - u->inlen;
+	memcpy(u->in + u->inlen, buf, n);
+	u->inlen += n;
+	return n;
+}
+
+
+/* there is no more input */
+void up_finish(struct unpack *u)
+{
+	u->ineof = 1;
+}
+
+
+/* up to n bytes of output, or an UP_ status */
+int up_drain(struct unpack *u, unsigned char *buf, unsigned int n)
+{
+	unsigned int got;
+
+	if (u->state < ST_BODY)
+		return header(u);
+
+	for (;;) {
+		while (u->state == ST_BODY && UP_RING - (unsigned int)(u->wpos - u->rpos) >= u->stepout
+		    && (u->inlen - u->inpos >= u->needin || u->ineof)) {
+			switch (u->method) {
+#ifdef USQ
+			case UP_SQ:
+				sqstep(u);
+				break;
+#endif
+#ifdef UNCRUNCH
+			case UP_CR:
+				crstep(u);
+				break;
+#endif
+#if defined(UNLZH) || defined(UNLZHUF)
+			default:
+				lzstep(u);
+				break;
+#endif
+			}
+		}
+
+		if (u->state == ST_TRAIL && (trailavail(u) >= 2 || u->ineof)) {
+			got = u->pastend;
+			u->filesum = trailbyte(u);
+			u->filesum |= trailbyte(u) << 8;
+			u->state = (u->pastend != got) ? ST_SHORT : ST_END;
+		}
+
+		if ((got = unrepeat(u, buf, n)) != 0)
+			return got;
+
+		switch (u->state) {
+		case ST_BODY:
+		case ST_TRAIL:
+			if (!u->ineof)
+				return UP_MORE;
+			continue;
+		case ST_END:
+			if (u->rpos != u->wpos || u->repct)
+				return 0;	/* n was 0 */
+			return (!u->checked || ((u->sum ^ u->filesum) & 0xffff) == 0) ? UP_DONE : UP_BADSUM;
+		case ST_SHORT:
+		case ST_BAD:
+			return UP_ERROR;
+		default:
+			return UP_BADFMT;
+		}
+	}
+}
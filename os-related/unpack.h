@@ -0,0 +1,183 @@
+/*
+ *	unpack.h - streaming decoders for the CP/M compressed file formats
+ *
+ *	UP_SQ		squeezed files (.?Q?), written by sq.c
+ *	UP_CR		crunched files (.?Z?), CRUNCH 2.x, written by crunch.c
+ *	UP_LZH		crLZH files (.?Y?), 1.x and 2.x
+ *	UP_LZHUF	lzencode.c output, plain or framed streaming
+ *
+ *	Used by usq.c, uncrunch.c, lzdecode.c and lar.c, build it along:
+ *	zcc +cpm -create-app -O3 -DUSQ usq.c unpack.c
+ *	gcc -DUSQ -o usq usq.c unpack.c
+ *
+ *	The decoders to include are chosen with -DUSQ, -DUNCRUNCH, -DUNLZH
+ *	and -DUNLZHUF (all of them when none is given), which keeps the
+ *	state of a single-format tool small on the Z80.
+ *
+ *	The caller pushes compressed bytes in and pulls plain bytes out;
+ *	memory use is the size of struct unpack, whatever the file size:
+ *
+ *	up_init(&u, UP_AUTO);
+ *	for (;;) {
+ *		if ((n = up_drain(&u, buf, sizeof(buf))) > 0)
+ *			... write n bytes of buf
+ *		else if (n == UP_MORE) {
+ *			if ((n = fread(in, 1, up_room(&u), f)) == 0)
+ *				up_finish(&u);
+ *			up_feed(&u, in, n);
+ *		} else if (n == UP_NAME)
+ *			... create the output file from u.name
+ *		else
+ *			break;		UP_DONE, or an error
+ *	}
+ */
+
+#ifndef UNPACK_H
+#define UNPACK_H
+
+#if !defined(USQ) && !defined(UNCRUNCH) && !defined(UNLZH) && !defined(UNLZHUF)
+#define USQ
+#define UNCRUNCH
+#define UNLZH
+#define UNLZHUF
+#endif
+
+/* hosted builds decode LZW strings by copying them out of the output
+   ring (see unpack.c), define NOFASTLZW to walk the table as on the Z80 */
+#if defined(UNCRUNCH) && !defined(Z80) && !defined(NOFASTLZW)
+#define FASTLZW
+#endif
+
+/* methods for up_init() */
+#define UP_AUTO		0	/* from the magic number: SQ, CR or LZH */
+#define UP_SQ		1
+#define UP_CR		2
+#define UP_LZH		3
+#define UP_LZHUF	4	/* no magic number, must be asked for */
+
+/* up_drain() returns a byte count, or one of these */
+#define UP_MORE		0	/* feed more input, or call up_finish() */
+#define UP_NAME		(-1)	/* header read, original name in name[] */
+#define UP_DONE		(-2)	/* all data out, checksum (if any) good */
+#define UP_BADSUM	(-3)	/* all data out, checksum mismatch */
+#define UP_BADFMT	(-4)	/* not this kind of file, or unsupported */
+#define UP_ERROR	(-5)	/* input ended early or is corrupt */
+
+#define UP_INSIZE	256	/* input buffer */
+#define UP_NAMELEN	80
+
+/* output ring: also the LZ history and, with FASTLZW, the LZW window */
+#ifdef FASTLZW
+#define UP_RING		0x10000
+#else
+#if defined(UNCRUNCH) || defined(UNLZHUF)
+#define UP_RING		0x2000
+#else
+#ifdef UNLZH
+#define UP_RING		0x1000
+#else
+#define UP_RING		0x100
+#endif
+#endif
+#endif
+
+/* squeeze */
+#define SQ_NUMVALS	257	/* 256 data values plus SPEOF */
+
+/* crunch */
+#define CR_TABLE	4096	/* size of main lzw table for 12 bit codes */
+#define CR_XLATBL	5003	/* size of physical translation table */
+
+/* lzhuf */
+#define LZ_F		60	/* lookahead buffer size */
+#define LZ_NCHAR	(256 + 1 - 2 + LZ_F)	/* largest alphabet (crLZH) */
+#define LZ_T		(LZ_NCHAR * 2 - 1)
+
+struct unpack {
+	unsigned char	method;
+	unsigned char	state;
+	unsigned char	ineof;		/* up_finish() called */
+	unsigned char	rle;		/* 0x90 repeat coding to undo */
+	unsigned char	dle;		/* a 0x90 is waiting for its count */
+	unsigned char	savec;		/* byte to repeat */
+	unsigned char	checked;	/* file carries a checksum */
+	unsigned char	needin;		/* input bytes a decoding step may take */
+	unsigned int	stepout;	/* ring space a decoding step may fill */
+	unsigned int	repct;		/* repeats still to hand out */
+	unsigned int	sum;		/* checksum of the bytes handed out */
+	unsigned int	filesum;	/* checksum from the file */
+	unsigned int	cnt;		/* header byte counter */
+	unsigned char	hdr[4];
+	unsigned int	inpos, inlen;
+	unsigned int	pastend;	/* zero bytes made up after the input */
+	unsigned long	rawcount;	/* input bytes used */
+	unsigned long	wpos, rpos;	/* ring: decoded, handed out */
+	char	name[UP_NAMELEN];	/* original file name */
+	unsigned char	in[UP_INSIZE];
+	unsigned char	ring[UP_RING];
+	union {
+#ifdef USQ
+		struct {
+			int	node;		/* position in the tree */
+			int	bpos;		/* last bit position read */
+			int	curin;		/* last byte value read */
+			int	numnodes;	/* size of decoding tree */
+			int	dnode[SQ_NUMVALS - 1][2];
+		} sq;
+#endif
+#ifdef UNCRUNCH
+		struct {
+			struct {
+				int	predecessor;
+				unsigned char	suffix;
+			} table[CR_TABLE];
+			unsigned short	xlatbl[CR_XLATBL];
+			unsigned char	codlen;		/* code length in bits (9-12) */
+			unsigned char	fulflg;		/* set once table is full */
+			unsigned char	entflg;		/* don't enter this code */
+			int	trgmsk;			/* mask for codes of current length */
+			int	entry;			/* next available table entry */
+			int	finchar;		/* first byte of last string */
+			int	lastpr;			/* last predecessor */
+			int	pred;			/* current predecessor */
+#ifdef FASTLZW
+			unsigned long	stroff[CR_TABLE];	/* ring position of each string */
+			unsigned short	strsiz[CR_TABLE];	/* and its length */
+			unsigned long	curoff, lstoff;
+			unsigned short	cursiz, lstsiz;
+			unsigned long long	bitbuf;
+			int	bitcnt;
+#else
+			long	getbuf;
+			int	getbit;
+			unsigned char	stack[CR_TABLE];
+#endif
+		} cr;
+#endif
+#if defined(UNLZH) || defined(UNLZHUF)
+		struct {
+			unsigned	freq[LZ_T + 1];
+			int	prnt[LZ_T + LZ_NCHAR];
+			int	son[LZ_T];
+			int	nchar, t, root;		/* alphabet, table size, root */
+			int	base;			/* code of the shortest match - 3 */
+			unsigned char	pshift;		/* position: bits below the table */
+			unsigned char	framed;		/* lzencode -s chunks */
+			unsigned	getbuf;
+			unsigned char	getlen;
+			unsigned long	textsize;	/* bytes left, plain lzencode */
+			unsigned int	left;		/* bytes left in this chunk */
+			unsigned int	clen;		/* code bytes in this chunk */
+			unsigned long	mark;		/* rawcount at chunk start */
+		} lz;
+#endif
+	} x;
+};
+
+extern void up_init(struct unpack *u, int method);
+extern unsigned int up_room(struct unpack *u);
+extern unsigned int up_feed(struct unpack *u, unsigned char *buf, unsigned int n);
+extern void up_finish(struct unpack *u);
+extern int up_drain(struct unpack *u, unsigned char *buf, unsigned int n);
+
+#endif
@@ -1,6 +1,7 @@
 /* This version is a simplified port for z88dk, subfolders are not supported */
 
 /* zcc +cpm  -O3 -create-app -ountar untar.c */
+/* -DNOGZIP leaves out the .tar.gz support (and its 32K window) */
 
 /* TODO: subfolder support for the OSCA target, 
          options to limit files to be extracted (wildcards?)
@@ -17,7 +18,7 @@
  *    and run on any system with a C compiler.
  *  * Extremely portable standard C.  The only non-ANSI function
  *    used is mkdir().
- *  * Reads basic ustar tar archives.
+ *  * Reads basic ustar tar archives, plain or gzip compressed.
  *  * Does not require libarchive or any other special library.
  *
  * To compile: cc -o untar untar.c
@@ -29,8 +30,10 @@
  * libarchive on systems that do not already have a tar program.
  *
  * To unpack libarchive-x.y.z.tar.gz:
- *    * gunzip libarchive-x.y.z.tar.gz
- *    * untar libarchive-x.y.z.tar
+ *    * untar libarchive-x.y.z.tar.gz
+ *
+ * The archive is inflated as it is read, a block at a time: there is
+ * no need to gunzip it to disk first.
  *
  * Written by Tim Kientzle, March 2009.
  *
@@ -92,6 +95,414 @@ verify_checksum(const char *p)
 	return (u == parseoct(p + 148, 8));
 }
 
+#ifndef NOGZIP
+/*
+ * Inflate (RFC 1951) for .tar.gz archives, after Mark Adler's puff.c.
+ * Codes are decoded a bit at a time from counts of code lengths, so
+ * the tables stay small; the 32K window is the only large buffer.
+ * Output is produced only as far as the tar reader asks for it: the
+ * window holds the history for back references and, past wpos - avail,
+ * the bytes not handed out yet.
+ */
+#define WSIZE		32768U		/* deflate window, a power of two */
+#define WMASK		(WSIZE - 1)
+#define MAXBITS		15		/* longest code */
+#define MAXLCODES	286		/* literal/length codes */
+#define MAXDCODES	30		/* distance codes */
+#define FIXLCODES	288		/* literal/length codes, fixed block */
+
+struct huffman {
+	short *count;			/* codes of each length */
+	short *symbol;			/* symbols in canonical order */
+};
+
+enum { GZ_BLOCK, GZ_STORED, GZ_CODES, GZ_END, GZ_ERROR };
+
+static FILE *gzin;			/* non NULL: reading a .gz */
+static unsigned char window[WSIZE];
+static unsigned int wpos;		/* next byte to write, mod WSIZE */
+static unsigned int avail;		/* bytes not handed out yet */
+static unsigned long outcnt;		/* bytes inflated */
+static unsigned long bitbuf;
+static int bitcnt;
+static int gzstate, gzlast;
+static unsigned int stored_left;	/* bytes left in a stored block */
+static unsigned long crc;		/* of the bytes handed out */
+static unsigned long file_crc, file_size;	/* from the trailer */
+
+static short lencnt[MAXBITS + 1], lensym[FIXLCODES];
+static short distcnt[MAXBITS + 1], distsym[MAXDCODES];
+static struct huffman lencode = { lencnt, lensym };
+static struct huffman distcode = { distcnt, distsym };
+
+static const short lbase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lext[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short dbase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const unsigned char dext[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/* CRC-32 four bits at a time, to keep the table small. */
+static const unsigned long crc_nibble[16] = {
+	0x00000000L, 0x1db71064L, 0x3b6e20c8L, 0x26d930acL,
+	0x76dc4190L, 0x6b6b51f4L, 0x4db26158L, 0x5005713cL,
+	0xedb88320L, 0xf00f9344L, 0xd6d6a3e8L, 0xcb61b38cL,
+	0x9b64c2b0L, 0x86d3d2d4L, 0xa00ae278L, 0xbdbdf21cL };
+
+/* Take need bits from the input, low bit first. */
+static int
+bits(int need)
+{
+	unsigned long val = bitbuf;
+	int c;
+
+	while (bitcnt < need) {
+		if ((c = getc(gzin)) == EOF) {
+			gzstate = GZ_ERROR;
+			c = 0;
+		}
+		val |= (unsigned long)c << bitcnt;
+		bitcnt += 8;
+	}
+	bitbuf = val >> need;
+	bitcnt -= need;
+	return ((int)(val & ((1L << need) - 1)));
+}
+
+/* Decode a symbol, or return a negative number for a bad code. */
+static int
+decode(const struct huffman *h)
+{
+	int len, code, first, count, index;
+
+	code = first = index = 0;
+	for (len = 1; len <= MAXBITS; len++) {
+		code |= bits(1);
+		count = h->count[len];
+		if (code - count < first)
+			return (h->symbol[index + (code - first)]);
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return (-1);
+}
+
+/*
+ * Build the tables for n code lengths.  Returns 0 for a complete code,
+ * more for an incomplete one and less than 0 if over-subscribed.
+ */
+static int
+construct(struct huffman *h, const short *length, int n)
+{
+	int symbol, len, left;
+	short offs[MAXBITS + 1];
+
+	for (len = 0; len <= MAXBITS; len++)
+		h->count[len] = 0;
+	for (symbol = 0; symbol < n; symbol++)
+		h->count[length[symbol]]++;
+	if (h->count[0] == n)
+		return (0);
+	left = 1;
+	for (len = 1; len <= MAXBITS; len++) {
+		left <<= 1;
+		left -= h->count[len];
+		if (left < 0)
+			return (left);
+	}
+	offs[1] = 0;
+	for (len = 1; len < MAXBITS; len++)
+		offs[len + 1] = offs[len] + h->count[len];
+	for (symbol = 0; symbol < n; symbol++)
+		if (length[symbol] != 0)
+			h->symbol[offs[length[symbol]]++] = symbol;
+	return (left);
+}
+
+/* Tables for a block with fixed codes. */
+static void
+fixed(void)
+{
+	short lengths[FIXLCODES];
+	int symbol;
+
+	for (symbol = 0; symbol < 144; symbol++)
+		lengths[symbol] = 8;
+	for (; symbol < 256; symbol++)
+		lengths[symbol] = 9;
+	for (; symbol < 280; symbol++)
+		lengths[symbol] = 7;
+	for (; symbol < FIXLCODES; symbol++)
+		lengths[symbol] = 8;
+	construct(&lencode, lengths, FIXLCODES);
+	for (symbol = 0; symbol < MAXDCODES; symbol++)
+		lengths[symbol] = 5;
+	construct(&distcode, lengths, MAXDCODES);
+}
+
+/* Tables for a block with dynamic codes, return 0 if they are good. */
+static int
+dynamic(void)
+{
+	static const unsigned char order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	short lengths[MAXLCODES + MAXDCODES];
+	int nlen, ndist, ncode, index, symbol, len, err;
+
+	nlen = bits(5) + 257;
+	ndist = bits(5) + 1;
+	ncode = bits(4) + 4;
+	if (nlen > MAXLCODES || ndist > MAXDCODES)
+		return (-1);
+	for (index = 0; index < ncode; index++)
+		lengths[order[index]] = bits(3);
+	for (; index < 19; index++)
+		lengths[order[index]] = 0;
+	if (construct(&lencode, lengths, 19) != 0)
+		return (-1);
+
+	index = 0;
+	while (index < nlen + ndist) {
+		if ((symbol = decode(&lencode)) < 0)
+			return (-1);
+		if (symbol < 16)
+			lengths[index++] = symbol;
+		else {
+			len = 0;
+			if (symbol == 16) {
+				if (index == 0)
+					return (-1);
+				len = lengths[index - 1];
+				symbol = 3 + bits(2);
+			} else if (symbol == 17)
+				symbol = 3 + bits(3);
+			else
+				symbol = 11 + bits(7);
+			if (index + symbol > nlen + ndist)
+				return (-1);
+			while (symbol--)
+				lengths[index++] = len;
+		}
+	}
+	if (lengths[256] == 0)
+		return (-1);
+	/* incomplete codes are only allowed for a single length */
+	err = construct(&lencode, lengths, nlen);
+	if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+		return (-1);
+	err = construct(&distcode, lengths + nlen, ndist);
+	if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+		return (-1);
+	return (0);
+}
+
+/* Inflate until at least n bytes are waiting, or the stream ends. */
+static void
+inflate_more(unsigned int n)
+{
+	int c, symbol;
+	unsigned int len, dist, from;
+
+	while (avail < n && gzstate != GZ_END && gzstate != GZ_ERROR) {
+		switch (gzstate) {
+		case GZ_BLOCK:
+			if (gzlast) {
+				/* the trailer is byte aligned */
+				bitbuf = 0;
+				bitcnt = 0;
+				file_crc = (unsigned int)bits(16);
+				file_crc |= (unsigned long)(unsigned int)bits(16) << 16;
+				file_size = (unsigned int)bits(16);
+				file_size |= (unsigned long)(unsigned int)bits(16) << 16;
+				if (gzstate != GZ_ERROR)
+					gzstate = GZ_END;
+				break;
+			}
+			gzlast = bits(1);
+			switch (bits(2)) {
+			case 0:
+				bitbuf = 0;
+				bitcnt = 0;
+				stored_left = bits(16);
+				if ((bits(16) ^ 0xffff) != stored_left)
+					gzstate = GZ_ERROR;
+				else if (gzstate != GZ_ERROR)
+					gzstate = GZ_STORED;
+				break;
+			case 1:
+				fixed();
+				if (gzstate != GZ_ERROR)
+					gzstate = GZ_CODES;
+				break;
+			case 2:
+				if (dynamic() != 0)
+					gzstate = GZ_ERROR;
+				else if (gzstate != GZ_ERROR)
+					gzstate = GZ_CODES;
+				break;
+			default:
+				gzstate = GZ_ERROR;
+			}
+			break;
+
+		case GZ_STORED:
+			if (stored_left == 0) {
+				gzstate = GZ_BLOCK;
+				break;
+			}
+			if ((c = getc(gzin)) == EOF) {
+				gzstate = GZ_ERROR;
+				break;
+			}
+			window[wpos++ & WMASK] = c;
+			avail++;
+			outcnt++;
+			stored_left--;
+			break;
+
+		case GZ_CODES:
+			symbol = decode(&lencode);
+			if (symbol < 0 || gzstate == GZ_ERROR) {
+				gzstate = GZ_ERROR;
+				break;
+			}
+			if (symbol < 256) {
+				window[wpos++ & WMASK] = symbol;
+				avail++;
+				outcnt++;
+				break;
+			}
+			if (symbol == 256) {
+				gzstate = GZ_BLOCK;
+				break;
+			}
+			symbol -= 257;
+			if (symbol >= 29) {
+				gzstate = GZ_ERROR;
+				break;
+			}
+			len = lbase[symbol] + bits(lext[symbol]);
+			symbol = decode(&distcode);
+			if (symbol < 0 || symbol >= 30) {
+				gzstate = GZ_ERROR;
+				break;
+			}
+			dist = dbase[symbol] + bits(dext[symbol]);
+			if (dist > outcnt || gzstate == GZ_ERROR) {
+				gzstate = GZ_ERROR;
+				break;
+			}
+			/* the match may overlap itself, copy a byte at a time */
+			from = wpos - dist;
+			avail += len;
+			outcnt += len;
+			while (len--)
+				window[wpos++ & WMASK] = window[from++ & WMASK];
+			break;
+		}
+	}
+}
+
+/* Hand out up to n inflated bytes, return how many. */
+static size_t
+gz_read(char *buf, unsigned int n)
+{
+	unsigned int i, rpos;
+	unsigned long c;
+
+	inflate_more(n);
+	if (n > avail)
+		n = avail;
+	rpos = wpos - avail;
+	c = crc;
+	for (i = 0; i < n; i++) {
+		buf[i] = window[rpos++ & WMASK];
+		c ^= (unsigned char)buf[i];
+		c = (c >> 4) ^ crc_nibble[c & 15];
+		c = (c >> 4) ^ crc_nibble[c & 15];
+	}
+	crc = c;
+	avail -= n;
+	return (n);
+}
+
+/* Read the gzip header, return 0 if a deflate stream follows. */
+static int
+gz_open(FILE *a)
+{
+	int c, flags, n;
+
+	if (getc(a) != 0x1f || getc(a) != 0x8b || getc(a) != 8)
+		return (-1);
+	flags = getc(a);
+	for (n = 0; n < 6; n++)		/* mtime, extra flags, os */
+		getc(a);
+	if (flags & 4) {		/* FEXTRA */
+		n = getc(a);
+		n |= getc(a) << 8;
+		while (n-- > 0)
+			getc(a);
+	}
+	if (flags & 8)			/* FNAME */
+		while ((c = getc(a)) != 0 && c != EOF)
+			;
+	if (flags & 16)			/* FCOMMENT */
+		while ((c = getc(a)) != 0 && c != EOF)
+			;
+	if (flags & 2) {		/* FHCRC */
+		getc(a);
+		getc(a);
+	}
+	if (feof(a) || (flags & 0xe0))
+		return (-1);
+	gzin = a;
+	wpos = avail = 0;
+	outcnt = 0;
+	bitbuf = 0;
+	bitcnt = 0;
+	gzstate = GZ_BLOCK;
+	gzlast = 0;
+	crc = 0xffffffffL;
+	return (0);
+}
+
+/* Inflate what is left after the tar end blocks and check the trailer. */
+static void
+gz_close(const char *path)
+{
+	char buff[512];
+
+	while (gz_read(buff, sizeof(buff)) > 0)
+		;
+	if (gzstate != GZ_END)
+		fprintf(stderr, "Compressed data in %s is damaged\n", path);
+	else if ((crc ^ 0xffffffffL) != file_crc
+	    || (outcnt & 0xffffffffL) != file_size)
+		fprintf(stderr, "CRC error in %s\n", path);
+	gzin = NULL;
+}
+#endif
+
+/* Read the next 512 byte block, from the .gz stream if there is one. */
+static size_t
+readblock(char *buff, FILE *a)
+{
+#ifndef NOGZIP
+	if (gzin != NULL)
+		return (gz_read(buff, 512));
+#endif
+	return (fread(buff, 1, 512, a));
+}
+
 /* Extract a tar archive. */
 static void
 untar(FILE *a, const char *path)
@@ -103,8 +514,18 @@ untar(FILE *a, const char *path)
 	int filesize;
 
 	printf("Extracting from %s\n", path);
+#ifndef NOGZIP
+	if (getc(a) == 0x1f && getc(a) == 0x8b) {
+		rewind(a);
+		if (gz_open(a) != 0) {
+			fprintf(stderr, "Unsupported gzip file %s\n", path);
+			return;
+		}
+	} else
+		rewind(a);
+#endif
 	for (;;) {
-		bytes_read = fread(buff, 1, 512, a);
+		bytes_read = readblock(buff, a);
 		if (bytes_read < 512) {
 			fprintf(stderr,
 			    "Short read on %s: expected 512, got %d\n",
@@ -112,6 +533,10 @@ untar(FILE *a, const char *path)
 			return;
 		}
 		if (is_end_of_archive(buff)) {
+#ifndef NOGZIP
+			if (gzin != NULL)
+				gz_close(path);
+#endif
 			printf("End of %s\n", path);
 			return;
 		}
@@ -152,7 +577,7 @@ untar(FILE *a, const char *path)
 			break;
 		}
 		while (filesize > 0) {
-			bytes_read = fread(buff, 1, 512, a);
+			bytes_read = readblock(buff, a);
 			if (bytes_read < 512) {
 				fprintf(stderr,
 				    "Short read on %s: Expected 512, got %d\n",
@@ -190,7 +615,7 @@ main(int argc, char **argv)
 
       if (argc != 2)
       {
-			printf("Usage:  untar file.tar\n");
+			printf("Usage:  untar file.tar[.gz]\n");
 			exit(1);
       }
 
@@ -1,17 +1,17 @@
 /* Program to unsqueeze files formed by sq.com
  *
  * Build hints (z88dk - OSCA):
- * zcc +osca -ousq -O3 -create-app --opt-code-size -pragma-define:CRT_INITIALIZE_BSS=0 -lflosxdos -DWILDCARD usq.c 
+ * zcc +osca -ousq -O3 -create-app --opt-code-size -pragma-define:CRT_INITIALIZE_BSS=0 -lflosxdos -DWILDCARD -DUSQ usq.c unpack.c
  * --or--
- * zcc +osca -ousq -create-app -SO3 --max-allocs-per-node400000 -pragma-define:CRT_INITIALIZE_BSS=0 -lflosxdos -DWILDCARD -compiler=sdcc usq.c
+ * zcc +osca -ousq -create-app -SO3 --max-allocs-per-node400000 -pragma-define:CRT_INITIALIZE_BSS=0 -lflosxdos -DWILDCARD -DUSQ -compiler=sdcc usq.c unpack.c
  *
  * Build hints (z88dk - CP/M):
- * zcc +cpm -ousq -create-app -O3 --opt-code-size -pragma-define:CRT_INITIALIZE_BSS=0 -DWILDCARD usq.c
+ * zcc +cpm -ousq -create-app -O3 --opt-code-size -pragma-define:CRT_INITIALIZE_BSS=0 -DWILDCARD -DUSQ usq.c unpack.c
  *   -- or --)
- * zcc +cpm -ousq -create-app -SO3 --max-allocs-per-node400000 -pragma-define:CRT_INITIALIZE_BSS=0 -DWILDCARD -compiler=sdcc usq.c
+ * zcc +cpm -ousq -create-app -SO3 --max-allocs-per-node400000 -pragma-define:CRT_INITIALIZE_BSS=0 -DWILDCARD -DUSQ -compiler=sdcc usq.c unpack.c
  * 
  * Build (gcc):
- * gcc -ousq usq.c
+ * gcc -DUSQ -ousq usq.c unpack.c
  *
  *
  * The original compiled program size was 12288, 
@@ -68,19 +68,19 @@
  * 3.0  Generalized for use under UNIX
  * 3.1  Found release date: 12/19/84
  * 3.2  More generalized for use under modern UNIX and z88dk
+ * 3.3  Decoding moved to unpack.c, shared with uncr, lzdecode and lar;
+ *	checksum compare fixed (it used && rather than &)
  */
 
 
 
-#define SQMAIN
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <string.h>
-#include "sqcom.h"
-#define VERSION "3.2   23/03/2012"
+#include "unpack.h"
+#define VERSION "3.3   18/10/2026"
 
 
 
@@ -88,23 +88,12 @@
 #include "flos.h"
 #endif
 
-#define ERROR -1
 #define TRUE 1
 #define FALSE 0
 
-#define LARGE 30000
-
-/* Decoding tree */
-struct {
-	int children[2];	/* left, right */
-} dnode[NUMVALS - 1];
-
-int bpos;	/* last bit position read */
-int curin;	/* last byte value read */
-
-/* Variables associated with repetition decoding */
-int repct;	/*Number of times to retirn value*/
-int value;	/*current byte value or EOF */
+/* Decoding tree and repetition state, see unpack.c */
+struct unpack unp;
+unsigned char inbuf[UP_INSIZE];
 
 /* This must follow all include files */
 unsigned int dispcnt;	/* How much of each file to preview */
@@ -112,130 +101,6 @@ char	ffflag;		/* should formfeed separate preview from different files */
 
 
 
-/* get 16-bit word from file */
-
-#ifdef Z80
-int getw16(FILE *iob) __z88dk_fastcall
-#else
-int getw16(FILE *iob)
-#endif
-{
-int temp;
-
-temp = getc(iob);		/* get low order byte */
-temp |= getc(iob) << 8;
-if (temp & 0x8000) temp |= (~0) << 15;	/* propogate sign for big ints */
-return temp;
-
-}
-
-
-/* get 16-bit (unsigned) word from file */
-
-#ifdef Z80
-int getx16(FILE *iob) __z88dk_fastcall
-#else
-int getx16(FILE *iob)
-#endif
-{
-int temp;
-
-temp = getc(iob);		/* get low order byte */
-return temp | (getc(iob) << 8);
-
-}
-
-
-/* initialize decoding functions */
-
-void init_cr()
-{
-	repct = 0;
-}
-
-void init_huff()
-{
-	bpos = 99;	/* force initial read */
-}
-
-
-/* Decode file stream into a byte level code with only
- * repetition encoding remaining.
- */
-
-#ifdef Z80
-int getuhuff(FILE *ib) __z88dk_fastcall
-#else
-int getuhuff(FILE *ib)
-#endif
-{
-	int i;
-
-	/* Follow bit stream in tree to a leaf*/
-	i = 0;	/* Start at root of tree */
-	do {
-		if(++bpos > 7) {
-			if((curin = getc(ib)) == ERROR)
-				return ERROR;
-			bpos = 0;
-			/* move a level deeper in tree */
-			i = dnode[i].children[1 & curin];
-		} else
-			i = dnode[i].children[1 & (curin >>= 1)];
-	} while(i >= 0);
-
-	/* Decode fake node index to original data value */
-	i = -(i + 1);
-	/* Decode special endfile token to normal EOF */
-	i = (i == SPEOF) ? EOF : i;
-	return i;
-}
-
-/* Get bytes with decoding - this decodes repetition,
- * calls getuhuff to decode file stream into byte
- * level code with only repetition encoding.
- *
- * The code is simple passing through of bytes except
- * that DLE is encoded as DLE-zero and other values
- * repeated more than twice are encoded as value-DLE-count.
- */
-
-#ifdef Z80
-int getcr(FILE *ib) __z88dk_fastcall
-#else
-int getcr(FILE *ib)
-#endif
-{
-	int c;
-
-	if(repct > 0) {
-		/* Expanding a repeated char */
-		--repct;
-		return value;
-	} else {
-		/* Nothing unusual */
-		if((c = getuhuff(ib)) != DLE) {
-			/* It's not the special delimiter */
-			value = c;
-			if(value == EOF)
-				repct = LARGE;
-			return value;
-		} else {
-			/* Special token */
-			if((repct = getuhuff(ib)) == 0)
-				/* DLE, zero represents DLE */
-				return DLE;
-			else {
-				/* Begin expanding repetition */
-				repct -= 2;	/* 2nd time */
-				return value;
-			}
-		}
-	}
-}
-
-
-
 #ifdef Z80
 void unsqueeze(char *infile) __z88dk_fastcall
 #else
@@ -243,16 +108,11 @@ void unsqueeze(char *infile)
 #endif
 {
 	FILE *inbuff, *outbuff;	/* file buffers */
-	int i, c;
+	int i, n;
 	char cc;
 
-	char *p;
-	unsigned int filecrc;	/* checksum */
-	int numnodes;		/* size of decoding tree */
-	char outfile[128];	/* output file name */
 	unsigned int linect;	/* count of number of lines previewed */
-	char obuf[128];		/* output buffer */
-	int oblen;		/* length of output buffer */
+	unsigned char obuf[128];	/* output buffer */
 	static char errmsg[] = "ERROR - write failure in %s\n";
 
 	if(!(inbuff=fopen(infile, "rb"))) {
@@ -261,101 +121,82 @@ void unsqueeze(char *infile)
 	}
 	/* Initialization */
 	linect = 0;
-	crc = 0;
-	init_cr();
-	init_huff();
-
-	/* Process header */
-	if(getx16(inbuff) != RECOGNIZE) {
-		printf("%s is not a squeezed file\n", infile);
-		goto closein;
-	}
-
-	filecrc = getw16(inbuff);
-
-	/* Get original file name */
-	p = outfile;			/* send it to array */
-	do {
-		*p = getc(inbuff);
-	} while(*p++ != '\0');
-
-	printf("%s -> %s: ", infile, outfile);
-
-
-	numnodes = getw16(inbuff);
-
-	if(numnodes < 0 || numnodes >= NUMVALS) {
-		printf("%s has invalid decode tree size\n", infile);
-		goto closein;
-	}
-
-	/* Initialize for possible empty tree (SPEOF only) */
-	dnode[0].children[0] = -(SPEOF + 1);
-	dnode[0].children[1] = -(SPEOF + 1);
-
-	/* Get decoding tree from file */
-	for(i = 0; i < numnodes; ++i) {
-		dnode[i].children[0] = getw16(inbuff);
-		dnode[i].children[1] = getw16(inbuff);
-	}
-
-	if(dispcnt) {
-		/* Use standard output for previewing */
-		putchar('\n');
-		while(((c = getcr(inbuff)) != EOF) && (linect < dispcnt)) {
-			cc = 0x7f & c;	/* strip parity */
-			if((cc < ' ') || (cc > '~'))
-				/* Unprintable */
-				switch(cc) {
-				case '\r':	/* return */
-					/* newline will generate CR-LF */
-					goto next;
-				case '\n':	/* newline */
-					++linect;
-				case '\f':	/* formfeed */
-				case '\t':	/* tab */
-					break;
-				default:
-					cc = '.';
-				}
-			putchar(cc);
-		next: ;
-		}
-		if(ffflag)
-			putchar('\f');	/* formfeed */
-	} else {
-		/* Create output file */
-		if(!(outbuff=fopen(outfile, "wb"))) {
-			printf("Can't create %s\n", outfile);
-			goto closeall;
+	outbuff = NULL;
+	up_init(&unp, UP_SQ);
+
+	for(;;) {
+		if((n = up_drain(&unp, obuf, sizeof(obuf))) == UP_MORE) {
+			if((n = fread(inbuf, 1, up_room(&unp), inbuff)) == 0)
+				up_finish(&unp);
+			up_feed(&unp, inbuf, n);
+			continue;
 		}
-		printf("unsqueezing,");
-		/* Get translated output bytes and write file */
-		oblen = 0;
-		while((c = getcr(inbuff)) != EOF) {
-			crc += c;
-			obuf[oblen++] = c;
-			if (oblen >= sizeof(obuf)) {
-				if(!fwrite(obuf, sizeof(obuf), 1, outbuff)) {
-					printf(errmsg, outfile);
-					goto closeall;
-				}
-				oblen = 0;
+		if(n == UP_NAME) {
+			/* Original file name is known */
+			printf("%s -> %s: ", infile, unp.name);
+			if(dispcnt) {
+				/* Use standard output for previewing */
+				putchar('\n');
+				continue;
+			}
+			/* Create output file */
+			if(!(outbuff=fopen(unp.name, "wb"))) {
+				printf("Can't create %s\n", unp.name);
+				goto closein;
 			}
+			printf("unsqueezing,");
+			continue;
 		}
-		if (oblen && !fwrite(obuf, oblen, 1, outbuff)) {
-			printf(errmsg, outfile);
+		if(n < 0)
+			break;
+
+		if(dispcnt) {
+			for(i = 0; i < n && linect < dispcnt; ++i) {
+				cc = 0x7f & obuf[i];	/* strip parity */
+				if((cc < ' ') || (cc > '~'))
+					/* Unprintable */
+					switch(cc) {
+					case '\r':	/* return */
+						/* newline will generate CR-LF */
+						continue;
+					case '\n':	/* newline */
+						++linect;
+					case '\f':	/* formfeed */
+					case '\t':	/* tab */
+						break;
+					default:
+						cc = '.';
+					}
+				putchar(cc);
+			}
+			if(linect >= dispcnt)
+				break;
+		} else if(!fwrite(obuf, n, 1, outbuff)) {
+			printf(errmsg, unp.name);
 			goto closeall;
 		}
-
-		if((filecrc && 0xFFFF) != (crc && 0xFFFF))
-			printf("ERROR - checksum error in %s\n", outfile);
-		else	printf(" done.\n");
-
-	closeall:
-		fclose(outbuff);
 	}
 
+	if(dispcnt) {
+		if(n == UP_BADFMT)
+			printf("%s is not a squeezed file\n", infile);
+		else if(ffflag)
+			putchar('\f');	/* formfeed */
+		goto closein;
+	}
+	/* No CRC check is performed when previewing */
+	if(n == UP_BADFMT)
+		printf("%s is not a squeezed file\n", infile);
+	else if(n == UP_BADSUM)
+		printf("ERROR - checksum error in %s\n", unp.name);
+	else if(n == UP_ERROR)
+		printf("ERROR - %s is damaged\n", infile);
+	else
+		printf(" done.\n");
+
+closeall:
+	if(outbuff)
+		fclose(outbuff);
 closein:
 	fclose(inbuff);
 }
@@ -0,0 +1,83 @@
+/*
+ * uubench.c - round trip throughput of the uuencode and uudecode codecs
+ *
+ * Encodes a buffer of random bytes into uuencoded and into base64 lines
+ * with the code of uuencode.c, decodes the lines again with the code of
+ * uudecode.c, checks that the bytes came back and prints the speed of
+ * each direction in MB (of binary data) per second of CPU time.
+ *
+ * gcc -O2 -o uubench uubench.c
+ *
+ * Usage: uubench [megabytes [repeats]]      (default 16 MB, best of 3)
+ */
+
+#define UUBENCH                 /* the codecs without their main() */
+#include "uuencode.c"
+#include "uudecode.c"
+#include <time.h>
+
+double best(double t, double s) { return t < 0 || s < t ? s : t; }
+
+int main(int argc, char *argv[])
+{
+      unsigned char *data, *back;
+      char *text, *p, *q;
+      unsigned long size, len, got;
+      double tenc, tdec, mb;
+      clock_t t0;
+      int mode, rep, repeats, n;
+
+      size = (argc > 1 ? atol(argv[1]) : 16) << 20;
+      repeats = argc > 2 ? atoi(argv[2]) : 3;
+      if (size == 0 || repeats < 1)
+      {
+            printf("Usage: uubench [megabytes [repeats]]\n");
+            return 2;
+      }
+      data = malloc(size);
+      back = malloc(size + LINELEN);
+      text = malloc(size / 45 * 62 + 64);             /* uuencode lines */
+      if (data == NULL || back == NULL || text == NULL)
+      {
+            printf("Out of memory\n");
+            return 1;
+      }
+      srand(1);
+      for (len = 0; len < size; len++)
+            data[len] = rand() >> 7;
+      mb = size / 1048576.0;
+
+      for (mode = 0; mode < 2; mode++)
+      {
+            encinit(mode);
+            decinit(mode);
+            tenc = tdec = -1;
+            for (rep = 0; rep < repeats; rep++)
+            {
+                  t0 = clock();
+                  len = encblock(data, size, text);
+                  tenc = best(tenc, (double)(clock() - t0) / CLOCKS_PER_SEC);
+                  text[len] = '\0';
+
+                  t0 = clock();
+                  got = 0;
+                  for (p = text; *p; p = q + 1)
+                  {
+                        q = strchr(p, '\n');
+                        if ((n = decline(p, back + got)) < 0)
+                              break;
+                        got += n;
+                  }
+                  tdec = best(tdec, (double)(clock() - t0) / CLOCKS_PER_SEC);
+                  if (got != size || memcmp(data, back, size) != 0)
+                  {
+                        printf("%s: round trip FAILED\n", mode ? "base64" : "uuencode");
+                        return 1;
+                  }
+            }
+            printf("%-8s  %5.0f MB  encode %8.1f MB/s  decode %8.1f MB/s\n",
+                   mode ? "base64" : "uuencode", mb,
+                   tenc > 0 ? mb / tenc : 0.0, tdec > 0 ? mb / tdec : 0.0);
+      }
+      return 0;
+}
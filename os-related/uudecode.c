@@ -19,15 +19,51 @@
 #endif
 
 
+/*
+** Decodes uuencoded files, and base64 (begin-base64 ... ====) as
+** written by uuencode -m.  Whole lines are decoded into a block
+** that is written with one fwrite; hosted builds look up each
+** character already shifted into place, so a group of four takes
+** four lookups and three stores.
+**
+** gcc -O2 -o uudecode uudecode.c
+*/
+
 #include        <stdio.h>
 #include        <stdlib.h>
+#include        <string.h>
 
 #define         DEC(c)  (char)(((c)-' ')&077)
 
+#ifdef Z80
+#define         LINELEN 128
+#define         OUTBUF  512
+#else
+#define         LINELEN 4096
+#define         OUTBUF  65536
+#define         WIDE            /* shifted 32 bit tables */
+#endif
+
+#define         BAD     0x80    /* not in the alphabet */
+
+unsigned char   dectab[256];    /* character -> 6 bits, or BAD */
+int             b64dec;         /* decoding base64 */
+#ifdef WIDE
+unsigned long   dec4[4][256];   /* dectab shifted for each place */
+#define         BADBIT  0x1000000L
+#endif
+
+void decinit(int base64);
+int decline(char *line, unsigned char *out);
+
+#ifndef UUBENCH
 int main(int argc, char *argv[])
 {
+      static unsigned char out[OUTBUF];
+      char    buf[LINELEN];
+      char    *name;
+      unsigned len;
       int     n;
-      char    buf[128],a,b,c,d;
 
       if (argc == 2)
       {
@@ -40,32 +76,141 @@ int main(int argc, char *argv[])
             }
       }
 
-      scanf("begin %o ", &n);
-      gets(buf);                              /* filename */
-      printf ("Creating file: %s\n",buf);
-      
-      if (!freopen(buf, "wb", stdout))         /* oops.. */
+      /* skip to the begin line: "begin mode name" */
+      do {
+            if (fgets(buf, sizeof buf, stdin) == NULL)
+            {
+                  printf("No begin line\n");
+                  exit(1);
+            }
+      } while (strncmp(buf, "begin ", 6) != 0
+            && strncmp(buf, "begin-base64 ", 13) != 0);
+      decinit(buf[5] == '-');
+      buf[strcspn(buf, "\r\n")] = '\0';
+      name = strchr(strchr(buf, ' ') + 1, ' ');
+      if (name == NULL)
       {
-            printf("Error creating output file.. %s\n",buf);
+            printf("No file name in: %s\n", buf);
             exit(1);
       }
+      ++name;                                 /* filename */
+      printf ("Creating file: %s\n",name);
 
-      while ((n=getchar())!=EOF&&((n=DEC(n))!=0))
+      if (!freopen(name, "wb", stdout))       /* oops.. */
       {
-            while (n>0)
+            printf("Error creating output file.. %s\n",name);
+            exit(1);
+      }
+
+      len = 0;
+      while (fgets(buf, sizeof buf, stdin) != NULL)
+      {
+            if (len > OUTBUF - LINELEN / 4 * 3)
             {
-                  a=DEC(getchar());
-                  b=DEC(getchar());
-                  c=DEC(getchar());
-                  d=DEC(getchar());
-                  if (n-->0)
-                        putchar((a<<2)|(b>>4));
-                  if (n-->0)
-                        putchar((b<<4)|(c>>2));
-                  if (n-->0)
-                        putchar((c<<6)|d);
+                  fwrite(out, 1, len, stdout);
+                  len = 0;
             }
-            n=getchar();                    /* skip \n */
+            if ((n = decline(buf, out + len)) <= 0)
+                  break;
+            len += n;
+      }
+      fwrite(out, 1, len, stdout);
+      if (n < 0)
+      {
+            fprintf(stderr, "Bad line: %s", buf);
+            return 1;
       }
       return 0;
 }
+#endif
+
+/*
+** set up the tables for uuencode or base64
+*/
+
+void decinit(int base64)
+{
+      static const char b64chars[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      int     c;
+
+      b64dec = base64;
+      for (c = 0; c < 256; c++)
+            dectab[c] = base64 ? BAD : DEC(c);
+      if (base64)
+      {
+            for (c = 0; c < 64; c++)
+                  dectab[(unsigned char)b64chars[c]] = c;
+            dectab['='] = 0;                /* padding, counted apart */
+      }
+#ifdef WIDE
+      for (c = 0; c < 256; c++)
+      {
+            if (dectab[c] == BAD)
+                  dec4[0][c] = dec4[1][c] = dec4[2][c] = dec4[3][c] = BADBIT;
+            else
+            {
+                  dec4[0][c] = (unsigned long)dectab[c] << 18;
+                  dec4[1][c] = (unsigned long)dectab[c] << 12;
+                  dec4[2][c] = (unsigned long)dectab[c] << 6;
+                  dec4[3][c] = dectab[c];
+            }
+      }
+#endif
+}
+
+/*
+** decode one line into out: return the byte count, 0 at the end
+** line and -1 for a line that can't be decoded.
+*/
+
+int decline(char *line, unsigned char *out)
+{
+      unsigned char *p, *o;
+      unsigned long v;
+      int     n, len, groups;
+
+      len = strcspn(line, "\r\n");
+      if (b64dec)
+      {
+            if (len >= 4 && strncmp(line, "====", 4) == 0)
+                  return 0;
+            if (len % 4 != 0)
+                  return -1;
+            groups = len / 4;
+            n = groups * 3;
+            if (len > 0 && line[len - 1] == '=')
+                  n -= line[len - 2] == '=' ? 2 : 1;
+            p = (unsigned char *)line;
+      }
+      else
+      {
+            if (len == 0 || (n = DEC(line[0])) == 0)
+                  return 0;
+            groups = (n + 2) / 3;
+            /* trailing blanks may have been lost in the mail */
+            while (len < 1 + groups * 4 && len < LINELEN - 1)
+                  line[len++] = ' ';
+            if (len < 1 + groups * 4)
+                  return -1;
+            p = (unsigned char *)line + 1;
+      }
+
+      for (o = out; groups > 0; groups--, p += 4, o += 3)
+      {
+#ifdef WIDE
+            v = dec4[0][p[0]] | dec4[1][p[1]] | dec4[2][p[2]] | dec4[3][p[3]];
+            if (v & BADBIT)
+                  return -1;
+#else
+            if ((dectab[p[0]] | dectab[p[1]] | dectab[p[2]] | dectab[p[3]]) & BAD)
+                  return -1;
+            v = ((unsigned long)dectab[p[0]] << 18) | ((unsigned long)dectab[p[1]] << 12)
+                  | (dectab[p[2]] << 6) | dectab[p[3]];
+#endif
+            o[0] = v >> 16;
+            o[1] = v >> 8;
+            o[2] = v;
+      }
+      return n;
+}
@@ -36,13 +36,21 @@ BITNET: kneller@ucsfcgl.BITNET
 #endif
 
 /*
- * uuencode [input] output
+ * uuencode [-m] [input] output
  *
  * Encode a file so it can be mailed to a remote system.
+ * -m writes base64 (begin-base64 ... ====) rather than uuencode.
+ *
+ * The input is read in blocks of whole lines and each block goes out
+ * with one fwrite.  Hosted builds encode twelve bits per table lookup.
+ *
+ * zcc +cpm -create-app -O3 -ouuencode uuencode.c
+ * gcc -O2 -o uuencode uuencode.c
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -51,15 +59,43 @@ BITNET: kneller@ucsfcgl.BITNET
 
 #define ENC(c) (((c) & 077) + ' ')
 
-void encode(FILE *in, FILE *out);
-void outdec(char *p, FILE *f);
-int fr(FILE *fd, char *buf, int cnt);
+#define UULINE      45          /* input bytes per uuencoded line */
+#define B64LINE     57          /* and per base64 line (76 characters) */
+
+#ifdef Z80
+#define LINES       8           /* lines per block */
+#else
+#define LINES       1024
+#define WIDE                    /* 12 bit pair table */
+#endif
+
+static const char b64chars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+char enctab[64];                /* the alphabet in use */
+int  b64mode;                   /* -m */
+#ifdef WIDE
+char enc2[4096][2];             /* two characters for twelve bits */
+#endif
 
+void encinit(int base64);
+unsigned encblock(const unsigned char *in, unsigned n, char *out);
+
+#ifndef UUBENCH
 main(int argc, char *argv[])
 {
+      static unsigned char inbuf[LINES * B64LINE];
+      static char outbuf[LINES * (B64LINE / 3 * 4 + 2)];
       FILE *in;
       struct stat sbuf;
       int mode;
+      unsigned n, block;
+
+      if (argc > 1 && argv[1][0] == '-' && (argv[1][1] == 'm' || argv[1][1] == 'M'))
+      {
+            b64mode = 1;
+            argv++; argc--;
+      }
 
       /* optional 1st argument */
 
@@ -78,7 +114,7 @@ main(int argc, char *argv[])
 
       if (argc != 2)
       {
-            printf("Usage: uuencode [infile] storedfname >outfile\n");
+            printf("Usage: uuencode [-m] [infile] storedfname >outfile\n");
             exit(2);
       }
 
@@ -89,69 +125,96 @@ main(int argc, char *argv[])
       fstat(fileno(in), &sbuf);
       mode = sbuf.st_mode & 0777;
 #endif
-      printf("begin %o %s\n", mode, argv[1]);
+      printf("begin%s %o %s\n", b64mode ? "-base64" : "", mode, argv[1]);
 
-      encode(in, stdout);
+      /* whole lines per block, so that only the last line is short */
+      encinit(b64mode);
+      block = LINES * (b64mode ? B64LINE : UULINE);
+      while ((n = fread(inbuf, 1, block, in)) > 0)
+      {
+            fwrite(outbuf, 1, encblock(inbuf, n, outbuf), stdout);
+            if (n < block)
+                  break;
+      }
 
-      printf("end\n");
+      if (b64mode)
+            printf("====\n");
+      else
+            printf("%c\nend\n", ENC(0));
       return 0;
 }
+#endif
 
 /*
- * copy from in to out, encoding as you go along.
+ * set up the tables for uuencode or base64
  */
 
-void encode(FILE *in, FILE *out)
+void encinit(int base64)
 {
-      char buf[80];
-      int i, n;
+      int i;
 
-      for (;;)
+      b64mode = base64;
+      for (i = 0; i < 64; i++)
+            enctab[i] = base64 ? b64chars[i] : ENC(i);
+#ifdef WIDE
+      for (i = 0; i < 4096; i++)
       {
-            /* 1 (up to) 45 character line */
-
-            n = fr(in, buf, 45);
-            putc(ENC(n), out);
-
-            for (i = 0; i < n; i += 3)
-                  outdec(&buf[i], out);
-
-            putc('\n', out);
-            if (n <= 0)
-                  break;
+            enc2[i][0] = enctab[i >> 6];
+            enc2[i][1] = enctab[i & 077];
       }
+#endif
 }
 
 /*
- * output one group of 3 bytes, pointed at by p, on file f.
+ * encode n bytes from in as lines of text at out, return the length.
  */
 
-void outdec(char *p, FILE *f)
+unsigned encblock(const unsigned char *in, unsigned n, char *out)
 {
-      int c1, c2, c3, c4;
-
-      c1 = *p >> 2;
-      c2 = ((p[0] << 4) & 060) | ((p[1] >> 4) & 017);
-      c3 = ((p[1] << 2) & 074) | ((p[2] >> 6) & 03);
-      c4 = p[2] & 077;
-      putc(ENC(c1), f);
-      putc(ENC(c2), f);
-      putc(ENC(c3), f);
-      putc(ENC(c4), f);
-}
+      const unsigned char *end;
+      char *o = out;
+      unsigned long v;
+      unsigned len, line;
 
-/* fr: like read but stdio */
+      line = b64mode ? B64LINE : UULINE;
+      while (n > 0)
+      {
+            len = n < line ? n : line;
+            n -= len;
+            if (!b64mode)
+                  *o++ = ENC(len);
 
-int fr(FILE *fd, char *buf, int cnt)
-{
-      int c, i;
+            /* the whole groups of 3 bytes */
+            for (end = in + len - len % 3; in < end; in += 3)
+            {
+                  v = ((unsigned long)in[0] << 16) | (in[1] << 8) | in[2];
+#ifdef WIDE
+                  memcpy(o, enc2[v >> 12], 2);
+                  memcpy(o + 2, enc2[v & 07777], 2);
+#else
+                  o[0] = enctab[(v >> 18) & 077];
+                  o[1] = enctab[(v >> 12) & 077];
+                  o[2] = enctab[(v >> 6) & 077];
+                  o[3] = enctab[v & 077];
+#endif
+                  o += 4;
+            }
 
-      for (i = 0; i < cnt; i++)
-      {
-            c = getc(fd);
-            if (c == EOF)
-                  return(i);
-            buf[i] = (char)c;
+            /* and the last 1 or 2, padded with zeros (base64: '=') */
+            if (len % 3)
+            {
+                  v = (unsigned long)in[0] << 16;
+                  if (len % 3 == 2)
+                        v |= in[1] << 8;
+                  o[0] = enctab[(v >> 18) & 077];
+                  o[1] = enctab[(v >> 12) & 077];
+                  o[2] = len % 3 == 2 ? enctab[(v >> 6) & 077] : b64mode ? '=' : ENC(0);
+                  o[3] = b64mode ? '=' : ENC(0);
+                  o += 4;
+                  in += len % 3;
+            }
+            *o++ = '\n';
       }
-      return (cnt);
+      return o - out;
 }
+